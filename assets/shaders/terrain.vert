@@ -1,6 +1,12 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+//Compact terrain vertices, only the height and normal are stored. The position and uv come from
+//gl_VertexIndex and the chunk's place in the terrain, see TerrainChunkPushConstant in Terrain.h
+
+//must match NumCells in TerrainChunkBuilder.h
+const int NumCells = 64;
+
 //Global information
 layout(set = 0, binding = 0) uniform GlobalData {
 	float time;
@@ -19,11 +25,17 @@ layout(set = 2, binding = 0) uniform ModelMatrixData {
 	mat4 normal;
 } mnd;
 
+//per chunk information
+layout(push_constant) uniform ChunkData {
+	vec2 gridOffset;
+	float gridSize;
+	float widthScale;
+	float heightMin;
+	float heightRange;
+} chunk;
 
-
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec2 inTexCoord;
+layout(location = 0) in float inHeight;
+layout(location = 1) in vec2 inOctNormal;
 
 layout(location = 0) out vec3 outFragPos;
 layout(location = 1) out vec3 outNormal;
@@ -33,11 +45,26 @@ out gl_PerVertex {
     vec4 gl_Position;
 };
 
+//inverse of EncodeOctNormal in TerrainChunkBuilder.cpp, y is up
+vec3 DecodeOctNormal(vec2 e) {
+	vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+	if (n.y < 0.0) {
+		n.xz = (1.0 - abs(n.zx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.z >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
 void main() {
+	int i = gl_VertexIndex / (NumCells + 1);
+	int j = gl_VertexIndex % (NumCells + 1);
+
+	//integer grid positions keep the edges of neighbouring chunks exactly the same
+	vec2 uv = (chunk.gridOffset + vec2(i, j)) / chunk.gridSize;
+	vec3 inPosition = vec3(uv.x * chunk.widthScale, chunk.heightMin + inHeight * chunk.heightRange, uv.y * chunk.widthScale);
 
     gl_Position = cam.projView * mnd.model * vec4(inPosition, 1.0);
 
-	outTexCoord = inTexCoord;
-	outNormal = inNormal;
+	outTexCoord = uv;
+	outNormal = DecodeOctNormal(inOctNormal);
 	outFragPos = (mnd.model * vec4(inPosition, 1.0)).xyz;		
-}
\ No newline at end of file
+}
@@ -0,0 +1,225 @@
+//Checks DoubleBufferArray, the triple buffer behind TransformManager, against a plain model.
+//Covers publishes the reader never picks up, swaps with nothing new, dirty ranges across
+//64 slot words, random sequences of writes, publishes and swaps, and a writer and reader
+//running on separate threads.
+//
+//usage: double_buffer_test, exits with a failure if any check fails
+
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../util/DoubleBuffer.h"
+
+constexpr int SlotCount = 256; //four words of dirty bits
+
+using TestBuffer = DoubleBufferArray<int, SlotCount>;
+using Ranges = std::vector<std::pair<int, int>>;
+
+static int failures = 0;
+
+static void Check(bool condition, const char* what) {
+	if (!condition) {
+		std::printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+//the ranges split at the given chunk size, like CalcMatrices' ParallelFor would
+static Ranges DirtyRanges(const TestBuffer& buffer, int chunkSize = SlotCount) {
+	Ranges ranges;
+	for (int begin = 0; begin < SlotCount; begin += chunkSize) {
+		buffer.ForEachDirtyRange(begin, begin + chunkSize, [&](int rangeBegin, int rangeEnd) {
+			//joins ranges cut by a chunk edge, so the result doesn't depend on the chunk size
+			if (!ranges.empty() && ranges.back().second == rangeBegin)
+				ranges.back().second = rangeEnd;
+			else
+				ranges.push_back({ rangeBegin, rangeEnd });
+		});
+	}
+	return ranges;
+}
+
+static bool IsCovered(const Ranges& ranges, int index) {
+	for (auto& range : ranges)
+		if (index >= range.first && index < range.second)
+			return true;
+	return false;
+}
+
+static void UnreadPublishThenPublish() {
+	auto buffer = std::make_unique<TestBuffer>();
+	buffer->Write(5, 1);
+	buffer->Publish();
+	//the reader never swaps here, so the next publish has to carry this one's changes too
+	buffer->Write(70, 2);
+	buffer->Publish();
+
+	Check(buffer->Swap(), "swap after two publishes finds the newest");
+	Check(buffer->Read(5) == 1, "unread publish's write reaches the reader");
+	Check(buffer->Read(70) == 2, "second publish's write reaches the reader");
+	Check(DirtyRanges(*buffer) == Ranges{ { 5, 6 }, { 70, 71 } }, "dirty ranges cover both publishes");
+
+	//and a later publish still starts from both writes
+	buffer->Write(6, 3);
+	buffer->Publish();
+	Check(buffer->Swap(), "swap after the third publish");
+	Check(buffer->Read(5) == 1 && buffer->Read(6) == 3 && buffer->Read(70) == 2, "copy forward keeps older writes");
+	//the writer can't know the reader picked up the last publish, so its writes may be dirty again
+	Ranges ranges = DirtyRanges(*buffer);
+	Check(IsCovered(ranges, 6), "the new write is dirty");
+	for (int i = 0; i < SlotCount; i++)
+		if (i != 5 && i != 6 && i != 70 && IsCovered(ranges, i))
+			Check(false, "slots never written aren't dirty");
+}
+
+static void SwapWithNothingNew() {
+	auto buffer = std::make_unique<TestBuffer>();
+	Check(!buffer->Swap(), "swap before any publish finds nothing");
+	Check(DirtyRanges(*buffer).empty(), "nothing dirty before any publish");
+
+	buffer->Write(3, 7);
+	buffer->Publish();
+	Check(buffer->Swap(), "swap after a publish");
+	Check(!buffer->Swap(), "second swap finds nothing new");
+	Check(buffer->Read(3) == 7, "read buffer is kept on an empty swap");
+	Check(DirtyRanges(*buffer).empty(), "an empty swap has no dirty ranges");
+
+	//writes that aren't published yet stay out of sight
+	buffer->Write(3, 8);
+	Check(!buffer->Swap(), "unpublished writes don't count");
+	Check(buffer->Read(3) == 7, "unpublished writes aren't read");
+}
+
+static void RangesAcrossWords() {
+	auto buffer = std::make_unique<TestBuffer>();
+	for (int i = 60; i < 70; i++)
+		buffer->Write(i, i);
+	buffer->Write(127, 1);
+	buffer->Write(128, 1);
+	buffer->Write(255, 1);
+	buffer->Publish();
+	Check(buffer->Swap(), "swap after writes across words");
+
+	Ranges expected = { { 60, 70 }, { 127, 129 }, { 255, 256 } };
+	Check(DirtyRanges(*buffer) == expected, "ranges join across word edges");
+	for (int chunk : { 1, 7, 32, 64, 100 })
+		Check(DirtyRanges(*buffer, chunk) == expected, "ranges are the same for any chunk size");
+
+	//a range that starts inside a word
+	Ranges partial;
+	buffer->ForEachDirtyRange(65, 128, [&](int rangeBegin, int rangeEnd) { partial.push_back({ rangeBegin, rangeEnd }); });
+	Check(partial == Ranges{ { 65, 70 }, { 127, 128 } }, "ranges are clipped to [begin, end)");
+}
+
+//Random writes, publishes and swaps on one thread, checked against snapshots of what was published
+static void RandomSequences() {
+	std::mt19937 rng(1234);
+	auto buffer = std::make_unique<TestBuffer>();
+	std::array<int, SlotCount> written{}; //what the writer has written
+	std::array<int, SlotCount> published{}; //as of the last publish
+	std::array<int, SlotCount> read{}; //what the reader saw after its last swap
+	bool hasUnread = false;
+	int nextValue = 1;
+
+	for (int step = 0; step < 20000; step++) {
+		int action = rng() % 10;
+		if (action < 6) {
+			int index = rng() % SlotCount;
+			written[index] = nextValue++;
+			buffer->Write(index, written[index]);
+		}
+		else if (action < 8) {
+			buffer->Publish();
+			published = written;
+			hasUnread = true;
+		}
+		else {
+			bool swapped = buffer->Swap();
+			if (swapped != hasUnread) {
+				Check(false, "swap matches whether anything was published");
+				return;
+			}
+			Ranges ranges = DirtyRanges(*buffer, 48);
+			if (!swapped) {
+				if (!ranges.empty()) {
+					Check(false, "no dirty ranges without a new publish");
+					return;
+				}
+				continue;
+			}
+			for (int i = 0; i < SlotCount; i++) {
+				if (buffer->Read(i) != published[i]) {
+					Check(false, "reader sees the last published values");
+					return;
+				}
+				if (read[i] != published[i] && !IsCovered(ranges, i)) {
+					Check(false, "every changed slot is in a dirty range");
+					return;
+				}
+			}
+			read = published;
+			hasUnread = false;
+		}
+	}
+}
+
+//Every publish writes one generation to all slots, the reader must never see two generations at once
+static void WriterAndReaderThreads() {
+	auto buffer = std::make_unique<TestBuffer>();
+	constexpr int Generations = 20000;
+	std::atomic_bool writerDone = false;
+	bool torn = false;
+	bool wentBack = false;
+
+	std::thread writer([&] {
+		for (int generation = 1; generation <= Generations; generation++) {
+			for (int i = 0; i < SlotCount; i++)
+				buffer->Write(i, generation);
+			buffer->Publish();
+		}
+		writerDone = true;
+	});
+
+	int lastGeneration = 0;
+	while (true) {
+		bool done = writerDone.load();
+		bool swapped = buffer->Swap();
+		if (swapped) {
+			int generation = buffer->Read(0);
+			for (int i = 1; i < SlotCount; i++)
+				if (buffer->Read(i) != generation)
+					torn = true;
+			if (generation < lastGeneration)
+				wentBack = true;
+			lastGeneration = generation;
+		}
+		//the last publish was made before done was set, so once nothing new is left it has been seen
+		else if (done)
+			break;
+	}
+	writer.join();
+
+	Check(!torn, "reader never sees a half published buffer");
+	Check(!wentBack, "reader never goes back to an older publish");
+	Check(lastGeneration == Generations, "reader ends on the last publish");
+}
+
+int main() {
+	UnreadPublishThenPublish();
+	SwapWithNothingNew();
+	RangesAcrossWords();
+	RandomSequences();
+	WriterAndReaderThreads();
+
+	if (failures == 0)
+		std::printf("passed\n");
+	else
+		std::printf("%d checks FAILED\n", failures);
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,130 @@
+//Checks that the job system doesn't touch the heap in steady state, runs without a window or vulkan.
+//Every frame submits single job tasks, a ParallelFor and an async task that splits its own
+//ParallelFor, while one async task keeps running across all the frames. After a few warm up
+//frames to let the arenas, queues and background pool reach their working size, no frame may allocate.
+//Bursts bigger than the frame arenas are run in the warm up too, so growing them is covered.
+//
+//usage: job_allocation_test, exits with a failure if any steady state frame allocated
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "../core/JobSystem.h"
+
+static std::atomic<uint64_t> allocationCount = 0;
+
+void* operator new(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size == 0 ? 1 : size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+static constexpr int WarmUpFrames = 20;
+static constexpr int MeasuredFrames = 200;
+static constexpr int TasksPerFrame = 2000;
+static constexpr int BurstTasks = 50000; //well past one 2 MiB frame arena
+
+//returns the allocations made over the measured frames
+static uint64_t RunFrames(int workerCount) {
+	job::TaskManager taskManager;
+	job::WorkerPool workerPool(taskManager, workerCount);
+	workerPool.StartWorkers();
+
+	std::vector<float> values(100000);
+	std::vector<float> asyncValues(10000);
+	std::atomic_int frameTasksRun = 0;
+	std::atomic_int asyncTasksLeft = 0;
+
+	//keeps going till the last frame, so it spans every arena switch. It ties up a worker, so it
+	//needs one for itself and one left over for the rest of the async work
+	bool hasLongTask = workerCount >= 2;
+	std::atomic_bool keepRunning = true;
+	std::atomic_bool longTaskStarted = false;
+	std::atomic_bool longTaskDone = false;
+	if (hasLongTask) {
+		job::Task longTask(job::TaskType::async);
+		longTask.Add(job::Job([&keepRunning, &longTaskStarted, &longTaskDone] {
+			longTaskStarted = true;
+			while (keepRunning.load())
+				std::this_thread::yield();
+			longTaskDone = true;
+		}));
+		taskManager.AddTask(std::move(longTask));
+
+		//has to be running on a worker before this thread starts helping with async work
+		while (!longTaskStarted.load())
+			std::this_thread::yield();
+	}
+
+	auto frame = [&](int taskCount) {
+		for (int i = 0; i < taskCount; i++) {
+			job::Task task(job::TaskType::currentFrame);
+			task.Add(job::Job([&frameTasksRun] { frameTasksRun++; }));
+			taskManager.AddTask(std::move(task));
+		}
+
+		asyncTasksLeft++;
+		job::Task asyncTask(job::TaskType::async);
+		asyncTask.Add(job::Job([&taskManager, &asyncValues, &asyncTasksLeft] {
+			taskManager.ParallelFor(0, static_cast<int>(asyncValues.size()), 0, [&asyncValues](int begin, int end) {
+				for (int i = begin; i < end; i++)
+					asyncValues[i] += 1.0f;
+			});
+			asyncTasksLeft--;
+		}));
+		taskManager.AddTask(std::move(asyncTask));
+
+		taskManager.ParallelFor(0, static_cast<int>(values.size()), 0, [&values](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				values[i] += 1.0f;
+		});
+		taskManager.EndSubmission();
+
+		//the async work has to keep up, otherwise the background pool grows without bound
+		while (asyncTasksLeft.load() > 0) {
+			if (!taskManager.RunAsyncTask())
+				std::this_thread::yield();
+		}
+	};
+
+	for (int i = 0; i < WarmUpFrames; i++)
+		frame(i % 4 == 0 ? BurstTasks : TasksPerFrame);
+
+	uint64_t before = allocationCount.load();
+	for (int i = 0; i < MeasuredFrames; i++)
+		frame(TasksPerFrame);
+	uint64_t allocations = allocationCount.load() - before;
+
+	keepRunning = false;
+	while (hasLongTask && !longTaskDone.load())
+		std::this_thread::yield();
+	return allocations;
+}
+
+int main() {
+	int maxWorkers = std::max(2, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+	bool passed = true;
+	for (int workers : { 0, 1, 2, maxWorkers }) {
+		uint64_t allocations = RunFrames(workers);
+		std::printf("%d workers: %llu allocations over %d frames\n", workers,
+			static_cast<unsigned long long>(allocations), MeasuredFrames);
+		if (allocations != 0)
+			passed = false;
+	}
+	std::printf(passed ? "passed\n" : "FAILED\n");
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,446 @@
+//Job system microbenchmarks, runs without a window or vulkan.
+//Every workload is run at 1 to N threads on both the job system and a plain
+//mutex + condition variable thread pool, results are printed as JSON.
+//
+//usage: job_bench [--threads N] [--scale S] [--out file.json]
+//  threads: highest thread count to test, defaults to the hardware thread count
+//  scale: multiplies the job counts, use < 1 for quick runs
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../core/JobSystem.h"
+
+//counts every heap allocation so the benchmarks can report allocations per job
+static std::atomic<uint64_t> allocationCount = 0;
+
+void* operator new(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size == 0 ? 1 : size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+using BenchClock = std::chrono::steady_clock;
+
+static double SecondsSince(BenchClock::time_point start) {
+	return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+//busy work standing in for what a real job would do
+static void Spin(int iterations) {
+	volatile int sink = 0;
+	for (int i = 0; i < iterations; i++)
+		sink = sink + i;
+}
+
+//Reference point, one locked queue shared by every thread
+class BasicThreadPool {
+public:
+	BasicThreadPool(int threadCount) {
+		for (int i = 0; i < threadCount; i++)
+			threads.emplace_back([this] { Work(); });
+	}
+
+	~BasicThreadPool() {
+		{
+			std::lock_guard<std::mutex> lg(lock);
+			isWorking = false;
+		}
+		workReady.notify_all();
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	void Submit(std::function<void()> func) {
+		{
+			std::lock_guard<std::mutex> lg(lock);
+			queue.push_back(std::move(func));
+			outstanding++;
+		}
+		workReady.notify_one();
+	}
+
+	//blocks until every submitted function has run, including ones submitted while waiting
+	void WaitIdle() {
+		std::unique_lock<std::mutex> lk(lock);
+		allDone.wait(lk, [this] { return outstanding == 0; });
+	}
+
+private:
+	void Work() {
+		while (true) {
+			std::function<void()> func;
+			{
+				std::unique_lock<std::mutex> lk(lock);
+				workReady.wait(lk, [this] { return !queue.empty() || !isWorking; });
+				if (!isWorking && queue.empty())
+					return;
+				func = std::move(queue.front());
+				queue.pop_front();
+			}
+			func();
+			{
+				std::lock_guard<std::mutex> lg(lock);
+				if (--outstanding == 0)
+					allDone.notify_all();
+			}
+		}
+	}
+
+	std::mutex lock;
+	std::condition_variable workReady;
+	std::condition_variable allDone;
+	std::deque<std::function<void()>> queue;
+	int outstanding = 0;
+	bool isWorking = true;
+	std::vector<std::thread> threads;
+};
+
+struct BenchResult {
+	std::string benchmark;
+	std::string scheduler;
+	int threads = 0;
+	uint64_t jobs = 0;
+	double seconds = 0.0;
+	std::vector<double> latencies; //seconds, only for benchmarks that time individual rounds
+	uint64_t allocations = 0;
+	uint64_t steals = 0;
+};
+
+static double Percentile(std::vector<double> values, double percentile) {
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	size_t index = static_cast<size_t>(percentile * (values.size() - 1) + 0.5);
+	return values[index];
+}
+
+static void WriteJson(std::ostream& out, const std::vector<BenchResult>& results, int maxThreads, double scale) {
+	out << "{\n";
+	out << "\t\"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+	out << "\t\"max_threads\": " << maxThreads << ",\n";
+	out << "\t\"scale\": " << scale << ",\n";
+	out << "\t\"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		auto& r = results[i];
+		out << "\t\t{ \"benchmark\": \"" << r.benchmark << "\""
+			<< ", \"scheduler\": \"" << r.scheduler << "\""
+			<< ", \"threads\": " << r.threads
+			<< ", \"jobs\": " << r.jobs
+			<< ", \"seconds\": " << r.seconds
+			<< ", \"jobs_per_second\": " << (r.seconds > 0.0 ? r.jobs / r.seconds : 0.0)
+			<< ", \"ns_per_job\": " << (r.jobs > 0 ? r.seconds * 1e9 / r.jobs : 0.0)
+			<< ", \"allocations_per_job\": " << (r.jobs > 0 ? double(r.allocations) / r.jobs : 0.0);
+		if (!r.latencies.empty()) {
+			out << ", \"median_us\": " << Percentile(r.latencies, 0.5) * 1e6
+				<< ", \"p99_us\": " << Percentile(r.latencies, 0.99) * 1e6
+				<< ", \"max_us\": " << Percentile(r.latencies, 1.0) * 1e6;
+		}
+		if (r.scheduler == "job_system")
+			out << ", \"steals\": " << r.steals;
+		out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "\t]\n";
+	out << "}\n";
+}
+
+//Job system side, the calling thread counts as one of the threads and helps through EndSubmission
+class JobSystemBench {
+public:
+	JobSystemBench(int threads) :
+		workerPool(taskManager, threads - 1), threads(threads)
+	{
+		workerPool.StartWorkers();
+	}
+
+	//one empty job per task, all submitted from the main thread
+	BenchResult EmptyJobs(int jobCount) {
+		return Measure("empty_jobs", jobCount, [&] {
+			for (int i = 0; i < jobCount; i++) {
+				job::Task task(job::TaskType::currentFrame);
+				task.Add(job::Job([] {}));
+				taskManager.AddTask(std::move(task));
+			}
+			taskManager.EndSubmission();
+		});
+	}
+
+	//a round is fanOut small tasks submitted together, latency is till the last one finishes
+	BenchResult FanOutFanIn(int rounds, int fanOut, int work) {
+		std::vector<double> latencies;
+		BenchResult result = Measure("fan_out_fan_in", uint64_t(rounds) * fanOut, [&] {
+			for (int r = 0; r < rounds; r++) {
+				auto start = BenchClock::now();
+				for (int i = 0; i < fanOut; i++) {
+					job::Task task(job::TaskType::currentFrame);
+					task.Add(job::Job([work] { Spin(work); }));
+					taskManager.AddTask(std::move(task));
+				}
+				taskManager.EndSubmission();
+				latencies.push_back(SecondsSince(start));
+			}
+		});
+		result.latencies = std::move(latencies);
+		return result;
+	}
+
+	//every task waits on the one before it, so only one can ever run at a time
+	BenchResult DependencyChain(int length) {
+		std::vector<std::shared_ptr<job::TaskSignal>> signals;
+		for (int i = 0; i < length; i++) {
+			signals.push_back(std::make_shared<job::TaskSignal>());
+			if (i > 0)
+				signals[i]->AddTaskToWaitOn(signals[i - 1]);
+		}
+		return Measure("dependency_chain", length, [&] {
+			for (int i = 0; i < length; i++) {
+				job::Task task(job::TaskType::currentFrame, signals[i]);
+				task.Add(job::Job([] {}));
+				taskManager.AddTask(std::move(task));
+			}
+			taskManager.EndSubmission();
+		});
+	}
+
+	//one producer task per thread, each submitting its share of empty tasks from inside the job system
+	BenchResult ManyProducers(int jobCount) {
+		int perProducer = std::max(1, jobCount / threads);
+		return Measure("many_producers", uint64_t(perProducer) * threads, [&] {
+			for (int p = 0; p < threads; p++) {
+				job::Task task(job::TaskType::currentFrame);
+				task.Add(job::Job([this, perProducer] {
+					for (int i = 0; i < perProducer; i++) {
+						job::Task child(job::TaskType::currentFrame);
+						child.Add(job::Job([] {}));
+						taskManager.AddTask(std::move(child));
+					}
+				}));
+				taskManager.AddTask(std::move(task));
+			}
+			taskManager.EndSubmission();
+		});
+	}
+
+	//every job takes the same lock, shows how the scheduler copes with workers stalling on each other
+	BenchResult Contention(int jobCount, int work) {
+		std::mutex sharedLock;
+		uint64_t sharedCounter = 0;
+		return Measure("contention", jobCount, [&] {
+			for (int i = 0; i < jobCount; i++) {
+				job::Task task(job::TaskType::currentFrame);
+				task.Add(job::Job([&sharedLock, &sharedCounter, work] {
+					std::lock_guard<std::mutex> lg(sharedLock);
+					Spin(work);
+					sharedCounter++;
+				}));
+				taskManager.AddTask(std::move(task));
+			}
+			taskManager.EndSubmission();
+		});
+	}
+
+private:
+	template<typename Func>
+	BenchResult Measure(const char* name, uint64_t jobs, Func&& func) {
+		taskManager.ResetStats();
+		BenchResult result;
+		result.benchmark = name;
+		result.scheduler = "job_system";
+		result.threads = threads;
+		result.jobs = jobs;
+
+		uint64_t allocationsBefore = allocationCount.load();
+		auto start = BenchClock::now();
+		func();
+		result.seconds = SecondsSince(start);
+		result.allocations = allocationCount.load() - allocationsBefore;
+
+		auto stats = taskManager.GetStats();
+		result.steals = stats.otherThreads.steals;
+		for (auto& worker : stats.workers)
+			result.steals += worker.steals;
+		return result;
+	}
+
+	job::TaskManager taskManager;
+	job::WorkerPool workerPool;
+	int threads;
+};
+
+//Same workloads on the baseline pool, which runs them all on its own threads
+class ThreadPoolBench {
+public:
+	ThreadPoolBench(int threads) :
+		pool(threads), threads(threads)
+	{
+
+	}
+
+	BenchResult EmptyJobs(int jobCount) {
+		return Measure("empty_jobs", jobCount, [&] {
+			for (int i = 0; i < jobCount; i++)
+				pool.Submit([] {});
+			pool.WaitIdle();
+		});
+	}
+
+	BenchResult FanOutFanIn(int rounds, int fanOut, int work) {
+		std::vector<double> latencies;
+		BenchResult result = Measure("fan_out_fan_in", uint64_t(rounds) * fanOut, [&] {
+			for (int r = 0; r < rounds; r++) {
+				auto start = BenchClock::now();
+				for (int i = 0; i < fanOut; i++)
+					pool.Submit([work] { Spin(work); });
+				pool.WaitIdle();
+				latencies.push_back(SecondsSince(start));
+			}
+		});
+		result.latencies = std::move(latencies);
+		return result;
+	}
+
+	//there are no dependencies, so each link submits the next one when it finishes
+	BenchResult DependencyChain(int length) {
+		std::function<void(int)> link = [&](int remaining) {
+			if (remaining > 1)
+				pool.Submit([&link, remaining] { link(remaining - 1); });
+		};
+		return Measure("dependency_chain", length, [&] {
+			pool.Submit([&link, length] { link(length); });
+			pool.WaitIdle();
+		});
+	}
+
+	BenchResult ManyProducers(int jobCount) {
+		int perProducer = std::max(1, jobCount / threads);
+		return Measure("many_producers", uint64_t(perProducer) * threads, [&] {
+			for (int p = 0; p < threads; p++) {
+				pool.Submit([this, perProducer] {
+					for (int i = 0; i < perProducer; i++)
+						pool.Submit([] {});
+				});
+			}
+			pool.WaitIdle();
+		});
+	}
+
+	BenchResult Contention(int jobCount, int work) {
+		std::mutex sharedLock;
+		uint64_t sharedCounter = 0;
+		return Measure("contention", jobCount, [&] {
+			for (int i = 0; i < jobCount; i++) {
+				pool.Submit([&sharedLock, &sharedCounter, work] {
+					std::lock_guard<std::mutex> lg(sharedLock);
+					Spin(work);
+					sharedCounter++;
+				});
+			}
+			pool.WaitIdle();
+		});
+	}
+
+private:
+	template<typename Func>
+	BenchResult Measure(const char* name, uint64_t jobs, Func&& func) {
+		BenchResult result;
+		result.benchmark = name;
+		result.scheduler = "thread_pool";
+		result.threads = threads;
+		result.jobs = jobs;
+
+		uint64_t allocationsBefore = allocationCount.load();
+		auto start = BenchClock::now();
+		func();
+		result.seconds = SecondsSince(start);
+		result.allocations = allocationCount.load() - allocationsBefore;
+		return result;
+	}
+
+	BasicThreadPool pool;
+	int threads;
+};
+
+//1, 2, 4 ... up to and always including maxThreads
+static std::vector<int> ThreadCounts(int maxThreads) {
+	std::vector<int> counts;
+	for (int count = 1; count < maxThreads; count *= 2)
+		counts.push_back(count);
+	counts.push_back(maxThreads);
+	return counts;
+}
+
+template<typename Bench>
+static void RunAll(Bench& bench, std::vector<BenchResult>& results, double scale) {
+	auto scaled = [scale](int count) { return std::max(1, static_cast<int>(count * scale)); };
+
+	bench.EmptyJobs(scaled(10000)); //warm up, fills the frame arenas and queues to their working size
+	results.push_back(bench.EmptyJobs(scaled(200000)));
+	results.push_back(bench.FanOutFanIn(scaled(2000), 64, 200));
+	results.push_back(bench.DependencyChain(scaled(20000)));
+	results.push_back(bench.ManyProducers(scaled(200000)));
+	results.push_back(bench.Contention(scaled(50000), 50));
+}
+
+int main(int argc, char* argv[]) {
+	int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	double scale = 1.0;
+	std::string outFile;
+
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			maxThreads = std::max(1, std::atoi(argv[++i]));
+		else if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+			scale = std::max(0.0001, std::atof(argv[++i]));
+		else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			outFile = argv[++i];
+		else {
+			std::cerr << "usage: job_bench [--threads N] [--scale S] [--out file.json]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<BenchResult> results;
+	for (int threads : ThreadCounts(maxThreads)) {
+		std::cerr << "running with " << threads << " threads\n";
+		{
+			JobSystemBench bench(threads);
+			RunAll(bench, results, scale);
+		}
+		{
+			ThreadPoolBench bench(threads);
+			RunAll(bench, results, scale);
+		}
+	}
+
+	if (outFile.empty()) {
+		WriteJson(std::cout, results, maxThreads, scale);
+	}
+	else {
+		std::ofstream out(outFile);
+		WriteJson(out, results, maxThreads, scale);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,72 @@
+//Checks that a job suspended on a fiber keeps running as background work once it resumes,
+//runs without a window or vulkan.
+//An async job waits on a signal, then a frame job runs on the same worker and waits too.
+//When the async job resumes its ParallelFor splits must not count as frame work,
+//so pendingFrameTasks has to stay at the one the waiting frame job holds.
+//
+//usage: job_fiber_test, exits with a failure if the async job's splits held up the frame
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+
+#include "../core/JobSystem.h"
+
+static void WaitFor(const std::atomic_bool& flag) {
+	while (!flag.load())
+		std::this_thread::yield();
+}
+
+int main() {
+	job::TaskManager taskManager;
+	//one worker, so both jobs share its thread
+	job::WorkerPool workerPool(taskManager, 1, true);
+	workerPool.StartWorkers();
+
+	auto asyncGo = std::make_shared<job::TaskSignal>();
+	auto frameGo = std::make_shared<job::TaskSignal>();
+	std::atomic_bool asyncStarted = false;
+	std::atomic_bool frameStarted = false;
+	std::atomic_bool asyncDone = false;
+	std::atomic_int mostPendingFrameTasks = 0;
+
+	job::Task asyncTask(job::TaskType::async);
+	asyncTask.Add(job::Job([&] {
+		asyncStarted = true;
+		asyncGo->Wait();
+		taskManager.ParallelFor(0, 4096, 16, [&](int begin, int end) {
+			int pending = taskManager.GetStats().pendingFrameTasks;
+			int most = mostPendingFrameTasks.load();
+			while (pending > most && !mostPendingFrameTasks.compare_exchange_weak(most, pending)) {}
+		});
+		asyncDone = true;
+	}));
+	taskManager.AddTask(std::move(asyncTask));
+	WaitFor(asyncStarted);
+
+	job::Task frameTask(job::TaskType::currentFrame);
+	frameTask.Add(job::Job([&] {
+		frameStarted = true;
+		frameGo->Wait();
+	}));
+	taskManager.AddTask(std::move(frameTask));
+	WaitFor(frameStarted);
+
+	//give the frame job time to suspend before the async one is resumed over it
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	asyncGo->Signal();
+	WaitFor(asyncDone);
+
+	frameGo->Signal();
+	taskManager.EndSubmission();
+
+	int most = mostPendingFrameTasks.load();
+	std::printf("most pending frame tasks while the async job ran: %d\n", most);
+	bool passed = most <= 1;
+	std::printf(passed ? "passed\n" : "FAILED\n");
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
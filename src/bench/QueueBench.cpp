@@ -0,0 +1,197 @@
+//Queue contention benchmark, compares the lock free RingBuffer against the mutex based
+//ConcurrentQueue. Half the threads produce and half consume, results are printed as JSON.
+//
+//usage: queue_bench [--items N] [--out file.json]
+//  items: how many items each producer pushes, defaults to 1000000
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../util/ConcurrentQueue.h"
+#include "../util/RingBuffer.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+constexpr size_t RingCapacity = 4096;
+constexpr size_t BatchSize = 16;
+
+struct QueueResult {
+	std::string queue;
+	int threads = 0;
+	uint64_t items = 0;
+	double seconds = 0.0;
+	bool valid = true; //every item came out exactly once
+};
+
+//Runs producers and consumers against the same queue. push(value) has to keep trying till it
+//succeeds, pop(sum) adds whatever it got to sum and returns how many items it took
+template<typename Push, typename Pop>
+static QueueResult RunContention(const char* name, int threads, uint64_t itemsPerProducer, Push&& push, Pop&& pop) {
+	int producers = std::max(1, threads / 2);
+	int consumers = std::max(1, threads - producers);
+	uint64_t totalItems = itemsPerProducer * producers;
+
+	std::atomic_bool start = false;
+	std::atomic<uint64_t> consumed = 0;
+	std::atomic<uint64_t> consumedSum = 0;
+
+	std::vector<std::thread> workers;
+	for (int p = 0; p < producers; p++) {
+		workers.emplace_back([&, p] {
+			while (!start.load(std::memory_order_acquire)) {}
+			uint64_t base = p * itemsPerProducer;
+			for (uint64_t i = 0; i < itemsPerProducer; i++)
+				push(base + i + 1);
+		});
+	}
+	for (int c = 0; c < consumers; c++) {
+		workers.emplace_back([&] {
+			while (!start.load(std::memory_order_acquire)) {}
+			uint64_t sum = 0;
+			while (consumed.load(std::memory_order_relaxed) < totalItems) {
+				uint64_t count = pop(sum);
+				if (count > 0)
+					consumed.fetch_add(count, std::memory_order_relaxed);
+				else
+					std::this_thread::yield();
+			}
+			consumedSum.fetch_add(sum);
+		});
+	}
+
+	auto startTime = BenchClock::now();
+	start.store(true, std::memory_order_release);
+	for (auto& worker : workers)
+		worker.join();
+
+	QueueResult result;
+	result.queue = name;
+	result.threads = producers + consumers;
+	result.items = totalItems;
+	result.seconds = std::chrono::duration<double>(BenchClock::now() - startTime).count();
+	result.valid = consumed.load() == totalItems && consumedSum.load() == totalItems * (totalItems + 1) / 2;
+	return result;
+}
+
+static QueueResult BenchConcurrentQueue(int threads, uint64_t items) {
+	ConcurrentQueue<uint64_t> queue;
+	return RunContention("concurrent_queue", threads, items,
+		[&](uint64_t value) { queue.push_back(value); },
+		[&](uint64_t& sum) -> uint64_t {
+			auto value = queue.pop_if();
+			if (!value.has_value())
+				return 0;
+			sum += *value;
+			return 1;
+		});
+}
+
+static QueueResult BenchConcurrentQueueBatch(int threads, uint64_t items) {
+	ConcurrentQueue<uint64_t> queue;
+	return RunContention("concurrent_queue_pop_n", threads, items,
+		[&](uint64_t value) { queue.push_back(value); },
+		[&](uint64_t& sum) -> uint64_t {
+			uint64_t values[BatchSize];
+			size_t count = queue.pop_n(values, BatchSize);
+			for (size_t i = 0; i < count; i++)
+				sum += values[i];
+			return count;
+		});
+}
+
+static QueueResult BenchRingBuffer(int threads, uint64_t items) {
+	RingBuffer<uint64_t> queue(RingCapacity);
+	return RunContention("ring_buffer", threads, items,
+		[&](uint64_t value) {
+			while (!queue.push(value))
+				std::this_thread::yield();
+		},
+		[&](uint64_t& sum) -> uint64_t {
+			auto value = queue.pop_if();
+			if (!value.has_value())
+				return 0;
+			sum += *value;
+			return 1;
+		});
+}
+
+//producers still hand over one item at a time here, consumers take up to BatchSize at once
+static QueueResult BenchRingBufferBatch(int threads, uint64_t items) {
+	RingBuffer<uint64_t> queue(RingCapacity);
+	return RunContention("ring_buffer_pop_n", threads, items,
+		[&](uint64_t value) {
+			while (!queue.push(value))
+				std::this_thread::yield();
+		},
+		[&](uint64_t& sum) -> uint64_t {
+			uint64_t values[BatchSize];
+			size_t count = queue.pop_n(values, BatchSize);
+			for (size_t i = 0; i < count; i++)
+				sum += values[i];
+			return count;
+		});
+}
+
+static void WriteJson(std::ostream& out, const std::vector<QueueResult>& results) {
+	out << "{\n";
+	out << "\t\"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+	out << "\t\"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		auto& r = results[i];
+		out << "\t\t{ \"queue\": \"" << r.queue << "\""
+			<< ", \"threads\": " << r.threads
+			<< ", \"items\": " << r.items
+			<< ", \"seconds\": " << r.seconds
+			<< ", \"items_per_second\": " << (r.seconds > 0.0 ? r.items / r.seconds : 0.0)
+			<< ", \"ns_per_item\": " << (r.items > 0 ? r.seconds * 1e9 / r.items : 0.0)
+			<< ", \"valid\": " << (r.valid ? "true" : "false")
+			<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "\t]\n";
+	out << "}\n";
+}
+
+int main(int argc, char* argv[]) {
+	uint64_t items = 1000000;
+	std::string outFile;
+
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--items") == 0 && i + 1 < argc)
+			items = std::max<uint64_t>(1, std::strtoull(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			outFile = argv[++i];
+		else {
+			std::cerr << "usage: queue_bench [--items N] [--out file.json]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<QueueResult> results;
+	for (int threads : { 2, 4, 8, 16 }) {
+		std::cerr << "running with " << threads << " threads\n";
+		results.push_back(BenchConcurrentQueue(threads, items));
+		results.push_back(BenchConcurrentQueueBatch(threads, items));
+		results.push_back(BenchRingBuffer(threads, items));
+		results.push_back(BenchRingBufferBatch(threads, items));
+	}
+
+	if (outFile.empty()) {
+		WriteJson(std::cout, results);
+	}
+	else {
+		std::ofstream out(outFile);
+		WriteJson(out, results);
+	}
+
+	bool allValid = std::all_of(results.begin(), results.end(), [](const QueueResult& r) { return r.valid; });
+	return allValid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,372 @@
+//Terrain chunk generation benchmark, runs without a window or vulkan.
+//Compares building a chunk with five height map samples per vertex against sampling the height
+//grid once and building the vertices from it, the latter once for every SIMD level the cpu supports.
+//Everything runs on one thread so chunks_per_second is per core, results are printed as JSON.
+//
+//The per vertex and scalar grid meshes have to be identical, the SIMD meshes have to be within
+//MaxRelativeError of the scalar one, otherwise the exit code is a failure.
+//Compact vertices are decoded the same way terrain.vert does and compared against the full ones,
+//heights have to be within half a quantization step and normals within MaxCompactNormalError.
+//
+//usage: terrain_bench [--chunks N] [--out file.json]
+//  chunks: how many chunks each variant builds, defaults to 2000
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../scene/TerrainChunkBuilder.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+constexpr int SourceImageResolution = 256; //same as the default terrain settings
+constexpr int MaxLevels = 4;
+
+//Stand in for the node graph's height map, sampled the same way as GraphUser::SampleHeightMap
+class BenchHeightMap {
+public:
+	BenchHeightMap(int width) : width(width), data(width * width) {
+		for (int x = 0; x < width; x++)
+			for (int z = 0; z < width; z++)
+				data[x * width + z] = 0.5f * std::sin(x * 0.05f) * std::cos(z * 0.07f) + 0.25f * std::sin((x + z) * 0.13f);
+	}
+
+	TerrainHeightSource Source() const {
+		return { data.data(), width };
+	}
+
+	float BoundedLookUp(int x, int z) const {
+		if (x >= 0 && x < width && z >= 0 && z < width)
+			return data[x * width + z];
+		throw std::runtime_error("out of bounds");
+	}
+
+	float Sample(const float x, const float z) const {
+		const int cellScale = width - 1;
+
+		const float xScaled = x * (float)cellScale;
+		const float zScaled = z * (float)cellScale;
+
+		const int realX = (int)xScaled;
+		const int realZ = (int)zScaled;
+
+		const int realXPlus1 = (int)glm::clamp(xScaled + 1, 0.0f, (float)cellScale);
+		const int realZPlus1 = (int)glm::clamp(zScaled + 1, 0.0f, (float)cellScale);
+
+		const float UL = BoundedLookUp(realX, realZ);
+		const float UR = BoundedLookUp(realX, realZPlus1);
+		const float DL = BoundedLookUp(realXPlus1, realZ);
+		const float DR = BoundedLookUp(realXPlus1, realZPlus1);
+
+		if (realX == realXPlus1 && realZ == realZPlus1)
+			return UL;
+		else if (realX == realXPlus1)
+			return (UL * ((float)realZPlus1 - zScaled) + UR * (zScaled - (float)realZ)) / ((float)realZPlus1 - (float)realZ);
+		else if (realZ == realZPlus1)
+			return (UL * ((float)realXPlus1 - xScaled) + DL * (xScaled - (float)realX)) / ((float)realXPlus1 - (float)realX);
+		return (
+			UL * ((float)realXPlus1 - xScaled) * ((float)realZPlus1 - zScaled)
+			+ DL * (xScaled - (float)realX) * ((float)realZPlus1 - zScaled)
+			+ UR * ((float)realXPlus1 - xScaled) * (zScaled - (float)realZ)
+			+ DR * (xScaled - (float)realX) * (zScaled - (float)realZ))
+			/ (((float)realXPlus1 - (float)realX) * ((float)realZPlus1 - (float)realZ));
+	}
+
+private:
+	int width;
+	std::vector<float> data;
+};
+
+struct ChunkParams {
+	int level;
+	int subDivX, subDivY;
+};
+
+struct BenchResult {
+	std::string variant;
+	int chunks = 0;
+	double seconds = 0.0;
+	uint64_t samples = 0; //height map samples taken
+	float maxError = 0.0f; //largest difference to the scalar mesh
+	size_t vertexBytes = sizeof(TerrainMeshVertices); //per chunk
+};
+
+//How far decoded compact vertices are from the full ones
+struct CompactError {
+	float position = 0.0f; //largest x or z difference, in world units
+	float heightSteps = 0.0f; //height difference in quantization steps of the chunk's range, less float rounding
+	float normalDegrees = 0.0f;
+};
+
+static const float HeightScale = 100.0f;
+static const float WidthScale = 1000.0f;
+
+//relative to the element size, or absolute for elements smaller than 1
+static const float MaxRelativeError = 1e-5f;
+
+static const float MaxCompactNormalError = 1.0f; //degrees
+
+//How chunks were built before the height grid, every vertex samples itself and its four neighbours
+static void BuildChunkPerVertex(const BenchHeightMap& heightMap, const ChunkParams& params, TerrainMeshVertices& vertices) {
+	float uvUs[HeightGridWidth];
+	float uvVs[HeightGridWidth];
+	CalcTerrainGridUVs(params.level, params.subDivX, params.subDivY, uvUs, uvVs);
+
+	float hDiff = uvUs[3] - uvUs[1];
+	for (int i = 0; i < NumCells + 1; i++) {
+		for (int j = 0; j < NumCells + 1; j++) {
+			float uvU = uvUs[(i + 1)];
+			float uvV = uvVs[(j + 1)];
+
+			float outheight = heightMap.Sample(uvU, uvV);
+			float outheightum = heightMap.Sample(uvUs[i], uvV);
+			float outheightup = heightMap.Sample(uvUs[i + 2], uvV);
+			float outheightvm = heightMap.Sample(uvU, uvVs[j]);
+			float outheightvp = heightMap.Sample(uvU, uvVs[j + 2]);
+
+			glm::vec3 normal = glm::normalize(glm::vec3((outheightvm - outheightvp) / hDiff,
+				16.0f,
+				(outheightum - outheightup)) / hDiff);
+
+			float* vert = &vertices[(i * (NumCells + 1) + j) * vertElementCount];
+			vert[0] = uvU * WidthScale;
+			vert[1] = outheight * HeightScale;
+			vert[2] = uvV * WidthScale;
+			vert[3] = normal.x;
+			vert[4] = normal.y;
+			vert[5] = normal.z;
+			vert[6] = uvU;
+			vert[7] = uvV;
+		}
+	}
+}
+
+static void BuildChunkFromGrid(const BenchHeightMap& heightMap, const ChunkParams& params,
+	TerrainHeightGrid& heights, TerrainMeshVertices& vertices)
+{
+	float uvUs[HeightGridWidth];
+	float uvVs[HeightGridWidth];
+	CalcTerrainGridUVs(params.level, params.subDivX, params.subDivY, uvUs, uvVs);
+
+	SampleTerrainHeightGrid(heightMap.Source(), uvUs, uvVs, 0, HeightGridWidth, heights);
+	BuildTerrainVertexRows(heights, uvUs, uvVs, HeightScale, WidthScale, 0, NumCells + 1, vertices);
+}
+
+static TerrainHeightRange BuildChunkCompact(const BenchHeightMap& heightMap, const ChunkParams& params,
+	TerrainHeightGrid& heights, TerrainCompactVertices& vertices)
+{
+	float uvUs[HeightGridWidth];
+	float uvVs[HeightGridWidth];
+	CalcTerrainGridUVs(params.level, params.subDivX, params.subDivY, uvUs, uvVs);
+
+	SampleTerrainHeightGrid(heightMap.Source(), uvUs, uvVs, 0, HeightGridWidth, heights);
+	TerrainHeightRange heightRange = CalcTerrainHeightRange(heights);
+	BuildTerrainCompactVertexRows(heights, uvUs, heightRange, 0, NumCells + 1, vertices);
+	return heightRange;
+}
+
+//Decodes like terrain.vert and compares against the full vertices
+static void CompareCompactChunk(const ChunkParams& params, TerrainHeightRange heightRange,
+	const TerrainCompactVertices& compact, const TerrainMeshVertices& full, CompactError& error)
+{
+	const float gridSize = (float)((1 << params.level) * NumCells);
+	const float heightStep = heightRange.range * HeightScale / 65535.0f;
+
+	for (int i = 0; i < NumCells + 1; i++) {
+		for (int j = 0; j < NumCells + 1; j++) {
+			const TerrainCompactVertex& vert = compact[i * (NumCells + 1) + j];
+			const float* expected = &full[(i * (NumCells + 1) + j) * vertElementCount];
+
+			float x = ((float)(params.subDivX * NumCells + i) / gridSize) * WidthScale;
+			float z = ((float)(params.subDivY * NumCells + j) / gridSize) * WidthScale;
+			float height = heightRange.min * HeightScale + (vert.height / 65535.0f) * (heightRange.range * HeightScale);
+
+			float u = std::max(vert.normal[0] / 127.0f, -1.0f);
+			float v = std::max(vert.normal[1] / 127.0f, -1.0f);
+			float nx = u, ny = 1.0f - std::abs(u) - std::abs(v), nz = v;
+			if (ny < 0.0f) {
+				nx = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+				nz = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+			}
+			float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+			float cosAngle = (nx * expected[3] + ny * expected[4] + nz * expected[5]) / length;
+			float degrees = std::acos(std::min(cosAngle, 1.0f)) * 57.2957795f;
+
+			error.position = std::max(error.position, std::max(std::abs(x - expected[0]), std::abs(z - expected[2])));
+			//a couple of float ulps at HeightScale come from rebuilding the height, not from quantization
+			float heightError = std::max(std::abs(height - expected[1]) - HeightScale * 2e-7f, 0.0f);
+			if (heightStep > 0.0f)
+				error.heightSteps = std::max(error.heightSteps, heightError / heightStep);
+			error.normalDegrees = std::max(error.normalDegrees, degrees);
+		}
+	}
+}
+
+static std::vector<ChunkParams> MakeChunkList(int count) {
+	std::vector<ChunkParams> chunks;
+	for (int i = 0; i < count; i++) {
+		int level = i % (MaxLevels + 1);
+		int side = 1 << level;
+		chunks.push_back({ level, (i / 3) % side, (i / 7) % side });
+	}
+	return chunks;
+}
+
+template<typename Build>
+static BenchResult RunVariant(const char* name, const std::vector<ChunkParams>& chunks, uint64_t samplesPerChunk, Build&& build) {
+	auto startTime = BenchClock::now();
+	for (auto& chunk : chunks)
+		build(chunk);
+
+	BenchResult result;
+	result.variant = name;
+	result.chunks = static_cast<int>(chunks.size());
+	result.seconds = std::chrono::duration<double>(BenchClock::now() - startTime).count();
+	result.samples = samplesPerChunk * chunks.size();
+	return result;
+}
+
+//Largest difference between two meshes, scaled down for elements bigger than 1
+static float MaxMeshError(const TerrainMeshVertices& expected, const TerrainMeshVertices& actual) {
+	float maxError = 0.0f;
+	for (size_t i = 0; i < expected.size(); i++) {
+		float error = std::abs(expected[i] - actual[i]) / std::max(1.0f, std::abs(expected[i]));
+		if (!(error <= maxError)) //keeps NaNs
+			maxError = error;
+	}
+	return maxError;
+}
+
+static void WriteJson(std::ostream& out, const std::vector<BenchResult>& results, bool identical, bool withinTolerance,
+	const CompactError& compactError, bool compactWithinTolerance)
+{
+	out << "{\n";
+	out << "\t\"num_cells\": " << NumCells << ",\n";
+	out << "\t\"simd_level\": \"" << TerrainSIMDLevelName(GetTerrainSIMDLevel()) << "\",\n";
+	out << "\t\"outputs_identical\": " << (identical ? "true" : "false") << ",\n";
+	out << "\t\"simd_within_tolerance\": " << (withinTolerance ? "true" : "false") << ",\n";
+	out << "\t\"max_relative_error\": " << MaxRelativeError << ",\n";
+	out << "\t\"compact_within_tolerance\": " << (compactWithinTolerance ? "true" : "false") << ",\n";
+	out << "\t\"compact_error\": { \"position\": " << compactError.position
+		<< ", \"height_steps\": " << compactError.heightSteps
+		<< ", \"normal_degrees\": " << compactError.normalDegrees << " },\n";
+	out << "\t\"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		auto& r = results[i];
+		out << "\t\t{ \"variant\": \"" << r.variant << "\""
+			<< ", \"chunks\": " << r.chunks
+			<< ", \"seconds\": " << r.seconds
+			<< ", \"us_per_chunk\": " << (r.chunks > 0 ? r.seconds * 1e6 / r.chunks : 0.0)
+			<< ", \"chunks_per_second\": " << (r.seconds > 0.0 ? r.chunks / r.seconds : 0.0)
+			<< ", \"samples_per_chunk\": " << (r.chunks > 0 ? r.samples / r.chunks : 0)
+			<< ", \"max_error\": " << r.maxError
+			<< ", \"vertex_bytes_per_chunk\": " << r.vertexBytes
+			<< " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "\t]\n";
+	out << "}\n";
+}
+
+int main(int argc, char* argv[]) {
+	int chunkCount = 2000;
+	std::string outFile;
+
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--chunks") == 0 && i + 1 < argc)
+			chunkCount = std::max(1, std::atoi(argv[++i]));
+		else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			outFile = argv[++i];
+		else {
+			std::cerr << "usage: terrain_bench [--chunks N] [--out file.json]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	BenchHeightMap heightMap(SourceImageResolution + 1);
+	auto chunks = MakeChunkList(chunkCount);
+
+	const TerrainSIMDLevel bestLevel = GetTerrainSIMDLevel();
+	std::vector<TerrainSIMDLevel> levels;
+	for (TerrainSIMDLevel level : { TerrainSIMDLevel::scalar, TerrainSIMDLevel::sse41, TerrainSIMDLevel::avx2 })
+		if (static_cast<int>(level) <= static_cast<int>(bestLevel))
+			levels.push_back(level);
+
+	auto vertices = std::make_unique<TerrainMeshVertices>();
+	auto gridVertices = std::make_unique<TerrainMeshVertices>();
+	auto heights = std::make_unique<TerrainHeightGrid>();
+
+	//the scalar grid path has to produce exactly the old mesh for the comparison to mean anything,
+	//the SIMD levels only have to be close to it
+	bool identical = true;
+	std::vector<float> maxErrors(levels.size(), 0.0f);
+	for (auto& chunk : chunks) {
+		BuildChunkPerVertex(heightMap, chunk, *vertices);
+		for (size_t l = 0; l < levels.size(); l++) {
+			SetTerrainSIMDLevel(levels[l]);
+			BuildChunkFromGrid(heightMap, chunk, *heights, *gridVertices);
+			if (levels[l] == TerrainSIMDLevel::scalar) {
+				if (std::memcmp(vertices->data(), gridVertices->data(), sizeof(TerrainMeshVertices)) != 0)
+					identical = false;
+			}
+			else {
+				float error = MaxMeshError(*vertices, *gridVertices);
+				if (!(error <= maxErrors[l]))
+					maxErrors[l] = error;
+			}
+		}
+	}
+
+	std::vector<BenchResult> results;
+	results.push_back(RunVariant("per_vertex_samples", chunks, vertCount * 5,
+		[&](const ChunkParams& chunk) { BuildChunkPerVertex(heightMap, chunk, *vertices); }));
+
+	bool withinTolerance = true;
+	for (size_t l = 0; l < levels.size(); l++) {
+		if (!(maxErrors[l] <= MaxRelativeError))
+			withinTolerance = false;
+
+		SetTerrainSIMDLevel(levels[l]);
+		std::string name = std::string("height_grid_") + TerrainSIMDLevelName(levels[l]);
+		auto result = RunVariant(name.c_str(), chunks, HeightGridWidth * HeightGridWidth,
+			[&](const ChunkParams& chunk) { BuildChunkFromGrid(heightMap, chunk, *heights, *gridVertices); });
+		result.maxError = maxErrors[l];
+		results.push_back(result);
+	}
+	SetTerrainSIMDLevel(bestLevel);
+
+	auto compactVertices = std::make_unique<TerrainCompactVertices>();
+	CompactError compactError;
+	for (auto& chunk : chunks) {
+		BuildChunkPerVertex(heightMap, chunk, *vertices);
+		TerrainHeightRange heightRange = BuildChunkCompact(heightMap, chunk, *heights, *compactVertices);
+		CompareCompactChunk(chunk, heightRange, *compactVertices, *vertices, compactError);
+	}
+	//positions are rebuilt from integers on the gpu, so only float rounding is allowed there
+	const bool compactWithinTolerance = compactError.position <= WidthScale * 1e-6f
+		&& compactError.heightSteps <= 0.5f && compactError.normalDegrees <= MaxCompactNormalError;
+
+	auto compactResult = RunVariant("height_grid_compact", chunks, HeightGridWidth * HeightGridWidth,
+		[&](const ChunkParams& chunk) { BuildChunkCompact(heightMap, chunk, *heights, *compactVertices); });
+	compactResult.vertexBytes = sizeof(TerrainCompactVertices);
+	results.push_back(compactResult);
+
+	if (outFile.empty()) {
+		WriteJson(std::cout, results, identical, withinTolerance, compactError, compactWithinTolerance);
+	}
+	else {
+		std::ofstream out(outFile);
+		WriteJson(out, results, identical, withinTolerance, compactError, compactWithinTolerance);
+	}
+
+	return identical && withinTolerance && compactWithinTolerance ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,54 @@
+#include "AllocationHook.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+
+static std::atomic<uint64_t> allocationCount = 0;
+
+static void* CountedAllocate(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size == 0 ? 1 : size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size) {
+	return CountedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+	return CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+namespace AllocationHook {
+	bool IsEnabled() { return true; }
+	uint64_t AllocationCount() { return allocationCount.load(std::memory_order_relaxed); }
+}
+
+#else
+
+namespace AllocationHook {
+	bool IsEnabled() { return false; }
+	uint64_t AllocationCount() { return 0; }
+}
+
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+//Counts every call to the global operator new, for checking that a steady state frame doesn't
+//touch the heap. Only active when built with the COUNT_HEAP_ALLOCATIONS cmake option, otherwise
+//the count stays at zero and no allocation overhead is added.
+namespace AllocationHook {
+
+	bool IsEnabled();
+
+	//total allocations since startup, from every thread
+	uint64_t AllocationCount();
+}
@@ -0,0 +1,163 @@
+#include "CpuTopology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "Logger.h"
+
+namespace job {
+
+	//parses cpu lists like "0-3,8,10-11"
+	static std::vector<int> ParseCpuList(const std::string& list) {
+		std::vector<int> cpus;
+		std::stringstream stream(list);
+		std::string range;
+		while (std::getline(stream, range, ',')) {
+			if (range.empty() || range == "\n")
+				continue;
+			auto dash = range.find('-');
+			try {
+				if (dash == std::string::npos) {
+					cpus.push_back(std::stoi(range));
+				}
+				else {
+					int first = std::stoi(range.substr(0, dash));
+					int last = std::stoi(range.substr(dash + 1));
+					for (int i = first; i <= last; i++)
+						cpus.push_back(i);
+				}
+			}
+			catch (std::exception&) {
+				//malformed entry, skip it
+			}
+		}
+		return cpus;
+	}
+
+	static bool ReadIntFromFile(const std::string& fileName, int& out) {
+		std::ifstream file(fileName);
+		if (!file)
+			return false;
+		file >> out;
+		return !file.fail();
+	}
+
+	static CpuTopology FlatTopology() {
+		CpuTopology topology;
+		int count = std::max(1u, std::thread::hardware_concurrency());
+		for (int i = 0; i < count; i++) {
+			CpuCore core;
+			core.coreId = i;
+			core.logicalCpus.push_back(i);
+			topology.cores.push_back(core);
+		}
+		return topology;
+	}
+
+	CpuTopology CpuTopology::Query() {
+#ifdef _WIN32
+		return FlatTopology();
+#else
+		const std::string cpuDir = "/sys/devices/system/cpu/";
+
+		std::ifstream onlineFile(cpuDir + "online");
+		std::string onlineList;
+		if (!onlineFile || !std::getline(onlineFile, onlineList))
+			return FlatTopology();
+
+		CpuTopology topology;
+		for (int cpu : ParseCpuList(onlineList)) {
+			std::string topologyDir = cpuDir + "cpu" + std::to_string(cpu) + "/topology/";
+			int package = 0, coreId = cpu;
+			ReadIntFromFile(topologyDir + "physical_package_id", package);
+			ReadIntFromFile(topologyDir + "core_id", coreId);
+
+			auto core = std::find_if(topology.cores.begin(), topology.cores.end(),
+				[&](CpuCore& c) { return c.package == package && c.coreId == coreId; });
+			if (core == topology.cores.end()) {
+				topology.cores.push_back(CpuCore{ package, coreId, {} });
+				core = topology.cores.end() - 1;
+			}
+			core->logicalCpus.push_back(cpu);
+		}
+		if (topology.cores.empty())
+			return FlatTopology();
+
+		for (auto& core : topology.cores)
+			std::sort(core.logicalCpus.begin(), core.logicalCpus.end());
+		std::sort(topology.cores.begin(), topology.cores.end(), [](const CpuCore& a, const CpuCore& b) {
+			return a.logicalCpus.front() < b.logicalCpus.front();
+		});
+		return topology;
+#endif
+	}
+
+	int CpuTopology::PhysicalCoreCount() const {
+		return static_cast<int>(cores.size());
+	}
+
+	int CpuTopology::LogicalCpuCount() const {
+		int count = 0;
+		for (auto& core : cores)
+			count += static_cast<int>(core.logicalCpus.size());
+		return count;
+	}
+
+	ThreadingPlan PlanThreads(const CpuTopology& topology, const ThreadingSettings& settings) {
+		ThreadingPlan plan;
+
+		int reserved = std::min(std::max(settings.reservedCores, 0), topology.PhysicalCoreCount() - 1);
+
+		//cpus a worker may go on, one per core first, then the SMT siblings
+		std::vector<int> slots;
+		size_t maxSiblings = 1;
+		for (auto& core : topology.cores)
+			maxSiblings = std::max(maxSiblings, core.logicalCpus.size());
+		size_t siblingsToUse = settings.avoidSMT ? 1 : maxSiblings;
+		for (size_t sibling = 0; sibling < siblingsToUse; sibling++)
+			for (size_t i = reserved; i < topology.cores.size(); i++)
+				if (sibling < topology.cores[i].logicalCpus.size())
+					slots.push_back(topology.cores[i].logicalCpus[sibling]);
+
+		int available = std::max(1, static_cast<int>(slots.size()));
+
+		plan.jobWorkers = settings.jobWorkers > 0 ? settings.jobWorkers : available;
+
+		//pinning more workers than there are slots would stack them on the same cpu
+		if (settings.pinWorkers && plan.jobWorkers <= static_cast<int>(slots.size())) {
+			plan.jobWorkerCpus.assign(slots.begin(), slots.begin() + plan.jobWorkers);
+			if (reserved > 0)
+				plan.mainThreadCpu = topology.cores.front().logicalCpus.front();
+		}
+
+		Log::Debug << "CPU topology: " << topology.PhysicalCoreCount() << " cores, "
+			<< topology.LogicalCpuCount() << " logical cpus\n";
+		Log::Debug << "Threads: " << plan.jobWorkers << " job workers" << (plan.jobWorkerCpus.empty() ? "" : " (pinned)") << "\n";
+		return plan;
+	}
+
+	bool PinCurrentThread(int cpu) {
+		if (cpu < 0)
+			return false;
+#ifdef _WIN32
+		if (cpu >= 64)
+			return false;
+		return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+#endif
+	}
+}
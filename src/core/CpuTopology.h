@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+namespace job {
+
+	struct CpuCore {
+		int package = 0;
+		int coreId = 0;
+		std::vector<int> logicalCpus; //SMT siblings share a core
+	};
+
+	class CpuTopology {
+	public:
+		//Reads /sys/devices/system/cpu on linux, elsewhere every logical cpu is treated as its own core
+		static CpuTopology Query();
+
+		int PhysicalCoreCount() const;
+		int LogicalCpuCount() const;
+
+		std::vector<CpuCore> cores; //sorted by package then core, the core holding cpu 0 comes first
+	};
+
+	//0 for any count means pick it from the topology
+	struct ThreadingSettings {
+		int jobWorkers = 0;
+		int reservedCores = 1; //kept free for the main/render thread
+		bool pinWorkers = true;
+		bool avoidSMT = true; //only put one worker on each physical core
+	};
+
+	struct ThreadingPlan {
+		int jobWorkers = 1;
+		std::vector<int> jobWorkerCpus; //cpu for each job worker, empty if they aren't pinned
+		int mainThreadCpu = -1; //-1 if not pinned
+	};
+
+	//Sizes the job system, which runs all of the engine's background work,
+	//the job workers get every core the main thread doesn't use
+	ThreadingPlan PlanThreads(const CpuTopology& topology, const ThreadingSettings& settings);
+
+	//returns false if the platform refused
+	bool PinCurrentThread(int cpu);
+}
@@ -0,0 +1,84 @@
+#include "Fiber.h"
+
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace job {
+
+#ifdef _WIN32
+
+	Fiber::Fiber() :
+		isThreadFiber(true)
+	{
+		handle = ConvertThreadToFiber(nullptr);
+		if (handle == nullptr)
+			handle = GetCurrentFiber(); //thread was already a fiber
+	}
+
+	Fiber::Fiber(EntryPoint entry, void* userData, size_t stackSize) :
+		entry(entry), userData(userData)
+	{
+		handle = CreateFiber(stackSize, [](void* fiber) { Start(fiber); }, this);
+		if (handle == nullptr)
+			throw std::runtime_error("Failed to create fiber");
+	}
+
+	Fiber::~Fiber() {
+		if (isThreadFiber)
+			ConvertFiberToThread();
+		else
+			DeleteFiber(handle);
+	}
+
+	void Fiber::SwitchTo(Fiber& target) {
+		SwitchToFiber(target.handle);
+	}
+
+#else
+
+	Fiber::Fiber() :
+		isThreadFiber(true)
+	{
+		getcontext(&context);
+	}
+
+	Fiber::Fiber(EntryPoint entry, void* userData, size_t stackSize) :
+		entry(entry), userData(userData), stack(new char[stackSize])
+	{
+		if (getcontext(&context) != 0)
+			throw std::runtime_error("Failed to create fiber");
+		context.uc_stack.ss_sp = stack.get();
+		context.uc_stack.ss_size = stackSize;
+		context.uc_link = nullptr;
+
+		//makecontext only passes ints, so the pointer is split in two
+		uintptr_t ptr = reinterpret_cast<uintptr_t>(this);
+		makecontext(&context, reinterpret_cast<void(*)()>(&Fiber::StartTrampoline), 2,
+			static_cast<unsigned int>(static_cast<uint64_t>(ptr) >> 32),
+			static_cast<unsigned int>(ptr & 0xFFFFFFFF));
+	}
+
+	Fiber::~Fiber() {
+
+	}
+
+	void Fiber::SwitchTo(Fiber& target) {
+		swapcontext(&context, &target.context);
+	}
+
+	void Fiber::StartTrampoline(unsigned int high, unsigned int low) {
+		uintptr_t ptr = static_cast<uintptr_t>((static_cast<uint64_t>(high) << 32) | low);
+		Start(reinterpret_cast<void*>(ptr));
+	}
+
+#endif
+
+	void Fiber::Start(void* fiber) {
+		Fiber* self = static_cast<Fiber*>(fiber);
+		self->entry(self->userData);
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#ifdef _WIN32
+#else
+#include <ucontext.h>
+#endif
+
+namespace job {
+
+	//Execution context with its own stack that can be switched to and from on one thread.
+	//Uses the fiber api on windows and ucontext elsewhere.
+	class Fiber {
+	public:
+		using EntryPoint = void(*)(void* userData);
+
+		//Wraps the context of the calling thread, needed to switch into any other fiber
+		Fiber();
+
+		//entry must never return, switch back to another fiber instead
+		Fiber(EntryPoint entry, void* userData, size_t stackSize);
+		~Fiber();
+
+		Fiber(const Fiber& other) = delete;
+		Fiber& operator=(const Fiber& other) = delete;
+
+		//Saves the current context into this and starts running target
+		void SwitchTo(Fiber& target);
+
+	private:
+		static void Start(void* fiber);
+#ifndef _WIN32
+		static void StartTrampoline(unsigned int high, unsigned int low);
+#endif
+
+		EntryPoint entry = nullptr;
+		void* userData = nullptr;
+		bool isThreadFiber = false;
+
+#ifdef _WIN32
+		void* handle = nullptr;
+#else
+		ucontext_t context;
+		std::unique_ptr<char[]> stack;
+#endif
+	};
+}
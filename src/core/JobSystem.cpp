@@ -1,37 +1,114 @@
 #include "JobSystem.h"
 
+#include <algorithm>
+
+#include "CpuTopology.h"
+#include "Fiber.h"
 #include "Logger.h"
 
 namespace job {
 
+	//Identifies which worker (if any) the current thread is
+	thread_local TaskManager* currentManager = nullptr;
+	thread_local int currentWorkerIndex = -1;
+	thread_local uint32_t stealSeed = 0;
+
+	//Set while running a task that the frame doesn't wait on
+	thread_local bool runningBackgroundTask = false;
+
+	//How many times an idle worker looks for work before parking
+	constexpr int IdleSpinCount = 64;
+
+	//xorshift, just needs to pick victims cheaply and spread them out
+	uint32_t NextStealVictim(uint32_t range) {
+		stealSeed ^= stealSeed << 13;
+		stealSeed ^= stealSeed >> 17;
+		stealSeed ^= stealSeed << 5;
+		return stealSeed % range;
+	}
+
+	Job::Job(Job&& other) noexcept {
+		if (other.ops) {
+			other.ops->move(storage, other.storage);
+			ops = other.ops;
+			other.ops = nullptr;
+		}
+	}
+
+	Job& Job::operator=(Job&& other) noexcept {
+		if (this != &other) {
+			Reset();
+			if (other.ops) {
+				other.ops->move(storage, other.storage);
+				ops = other.ops;
+				other.ops = nullptr;
+			}
+		}
+		return *this;
+	}
+
+	Job::~Job() {
+		Reset();
+	}
+
+	void Job::operator()() {
+		if (ops)
+			ops->invoke(storage);
+	}
+
+	void Job::Reset() {
+		if (ops) {
+			ops->destroy(storage);
+			ops = nullptr;
+		}
+	}
+
+	CancellationToken CancellationToken::Create() {
+		CancellationToken token;
+		token.cancelled = std::make_shared<std::atomic_bool>(false);
+		return token;
+	}
+
+	void CancellationToken::Cancel() {
+		if (cancelled)
+			cancelled->store(true, std::memory_order_relaxed);
+	}
+
+	bool CancellationToken::IsCancelled() const {
+		return cancelled && cancelled->load(std::memory_order_relaxed);
+	}
+
 	Task::Task(TaskType type,
-		std::weak_ptr<TaskSignal> signalBlock) :
-		type(type), signalBlock(signalBlock) {
+		std::shared_ptr<TaskSignal> signalBlock, CancellationToken cancelToken) :
+		type(type), signalBlock(signalBlock), cancelToken(std::move(cancelToken)) {
 
 	}
 
 	void Task::Add(Job&& newJob) {
-		jobs.push_back(std::move(newJob));
+		if (inlineJobCount < InlineJobCount)
+			inlineJobs[inlineJobCount++] = std::move(newJob);
+		else
+			extraJobs.push_back(std::move(newJob));
 	}
 
 	void Task::operator()() {
-		if (auto sbp = signalBlock.lock()) {
-			for (auto& job : jobs)
+		if (!cancelToken.IsCancelled()) {
+			for (int i = 0; i < inlineJobCount; i++)
+				inlineJobs[i]();
+			for (auto& job : extraJobs)
 				job();
-			sbp->Signal();
 		}
+		if (signalBlock)
+			signalBlock->Signal();
 	}
 
 	void Task::WaitOn() {
-		if (auto sbp = signalBlock.lock())
-			sbp->Wait();
+		if (signalBlock)
+			signalBlock->Wait();
 	}
 
-	bool Task::IsReadyToRun() {
-		if (auto sbp = signalBlock.lock()) {
-			return sbp->IsReadyToRun();
-		}
-		return true; //Is this right? no signal block to wait on
+	std::shared_ptr<TaskSignal>& Task::GetSignal() {
+		return signalBlock;
 	}
 
 	TaskSignal::TaskSignal()
@@ -44,66 +121,672 @@ namespace job {
 	}
 
 	void TaskSignal::Signal() {
-		finished = true;
+		std::vector<std::shared_ptr<TaskSignal>> readySuccessors;
+		std::vector<WaitingFiber> resumedFibers;
+		{
+			std::lock_guard<std::mutex> lg(lock);
+			finished = true;
+			readySuccessors.swap(successors);
+			resumedFibers.swap(waitingFibers);
+		}
 		condVar.notify_all();
+
+		for (auto& waiting : resumedFibers)
+			waiting.scheduler->Resume(waiting.fiber);
+
+		for (auto& successor : readySuccessors)
+			successor->PredecessorFinished();
 	}
 
 	void TaskSignal::Wait() {
-		if (finished)
+		FiberScheduler* scheduler = FiberScheduler::Current();
+		if (scheduler != nullptr && scheduler->CurrentFiber() != nullptr) {
+			{
+				std::lock_guard<std::mutex> lg(lock);
+				if (finished)
+					return;
+				waitingFibers.push_back({ scheduler, scheduler->CurrentFiber() });
+				if (currentManager != nullptr)
+					currentManager->CountersForThisThread().dependencyWaits.fetch_add(1, std::memory_order_relaxed);
+			}
+			//Resume only ever runs the fiber on this thread, so it can't continue before it is switched out
+			scheduler->Suspend();
 			return;
-		std::unique_lock<std::mutex> mlock(condVar_lock);
-		condVar.wait(mlock);
+		}
+
+		std::unique_lock<std::mutex> mlock(lock);
+		if (!finished && currentManager != nullptr)
+			currentManager->CountersForThisThread().dependencyWaits.fetch_add(1, std::memory_order_relaxed);
+		condVar.wait(mlock, [this] { return finished; });
+	}
+
+	bool TaskSignal::IsFinished() {
+		std::lock_guard<std::mutex> lg(lock);
+		return finished;
 	}
 
 	void TaskSignal::AddTaskToWaitOn(std::shared_ptr<TaskSignal> taskSig) {
-		std::lock_guard<std::mutex>lg(pred_lock);
-		predicates.push_back(taskSig);
+		unfinishedPredecessors++;
+		if (!taskSig->AddSuccessor(shared_from_this()))
+			unfinishedPredecessors--;
 	}
 
-	bool TaskSignal::IsReadyToRun() {
-		std::lock_guard<std::mutex>lg(pred_lock);
-		for (auto& task : predicates) {
-			if (!task->IsReadyToRun())
-				return false;
-		}
+	bool TaskSignal::AddSuccessor(std::shared_ptr<TaskSignal> successor) {
+		std::lock_guard<std::mutex> lg(lock);
+		if (finished)
+			return false;
+		successors.push_back(successor);
 		return true;
 	}
 
+	bool TaskSignal::Submit(TaskManager* taskManager, Task* task) {
+		manager = taskManager;
+		waitingTask = task;
+		if (--unfinishedPredecessors == 0) {
+			waitingTask = nullptr;
+			return true;
+		}
+		return false;
+	}
+
+	void TaskSignal::PredecessorFinished() {
+		if (--unfinishedPredecessors == 0) {
+			Task* task = waitingTask;
+			waitingTask = nullptr;
+			manager->Schedule(task);
+		}
+	}
+
 	TaskPool::TaskPool() {
 
 	}
 
-	void TaskPool::AddTask(Task&& task) {
+	void TaskPool::AddTask(Task* task) {
 		std::lock_guard<std::mutex>lg(queueLock);
-		tasks.push(std::move(task));
+		size_t size = static_cast<size_t>(count.load(std::memory_order_relaxed));
+		if (size == tasks.size()) {
+			//full, unwrap into a bigger ring
+			std::vector<Task*> bigger(tasks.empty() ? 64 : tasks.size() * 2);
+			for (size_t i = 0; i < size; i++)
+				bigger[i] = tasks[(head + i) % tasks.size()];
+			tasks.swap(bigger);
+			head = 0;
+		}
+		tasks[(head + size) % tasks.size()] = task;
+		count++;
+		if (static_cast<int>(size) + 1 > highWater.load(std::memory_order_relaxed))
+			highWater.store(static_cast<int>(size) + 1, std::memory_order_relaxed);
 	}
 
-	std::optional<Task> TaskPool::GetTask() {
+	Task* TaskPool::GetTask() {
+		if (count.load(std::memory_order_relaxed) == 0)
+			return nullptr;
 		std::lock_guard<std::mutex>lg(queueLock);
-		while (!tasks.empty()) {
-			auto val = tasks.front();
-			tasks.pop();
-			if (val.IsReadyToRun())
-				return val;
-			tasks.push(val); //possible infinite wait...
+		if (count.load(std::memory_order_relaxed) == 0)
+			return nullptr;
+		Task* task = tasks[head];
+		head = (head + 1) % tasks.size();
+		count--;
+		return task;
+	}
+
+	bool TaskPool::Empty() {
+		return count.load() == 0;
+	}
+
+	int TaskPool::Size() {
+		return count.load(std::memory_order_relaxed);
+	}
+
+	int TaskPool::HighWater() {
+		return highWater.load(std::memory_order_relaxed);
+	}
+
+	void TaskPool::ResetHighWater() {
+		highWater.store(count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	void TaskManager::ThreadCounters::Reset() {
+		tasksExecuted.store(0, std::memory_order_relaxed);
+		busyNanoseconds.store(0, std::memory_order_relaxed);
+		parkedNanoseconds.store(0, std::memory_order_relaxed);
+		steals.store(0, std::memory_order_relaxed);
+		dependencyWaits.store(0, std::memory_order_relaxed);
+		queueHighWater.store(0, std::memory_order_relaxed);
+	}
+
+	WorkerStats TaskManager::ThreadCounters::Read() {
+		WorkerStats stats;
+		stats.tasksExecuted = tasksExecuted.load(std::memory_order_relaxed);
+		stats.busyTime = busyNanoseconds.load(std::memory_order_relaxed) / 1.0e9;
+		stats.parkedTime = parkedNanoseconds.load(std::memory_order_relaxed) / 1.0e9;
+		stats.steals = steals.load(std::memory_order_relaxed);
+		stats.dependencyWaits = dependencyWaits.load(std::memory_order_relaxed);
+		stats.queueHighWater = queueHighWater.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	TaskManager::TaskManager() :
+		statsStartTime(std::chrono::steady_clock::now().time_since_epoch().count())
+	{
+
+	}
+
+	TaskManager::~TaskManager() {
+		while (Task* task = currentFrameTasks.GetTask())
+			ReleaseTask(task);
+		while (Task* task = asyncTasks.GetTask())
+			ReleaseTask(task);
+		for (Task* task : nextFrameTasks)
+			ReleaseTask(task);
+		for (auto& queue : workerQueues) {
+			Task* task;
+			while (queue->pop(task))
+				ReleaseTask(task);
+		}
+	}
+
+	void TaskManager::SetupWorkerQueues(int workerCount) {
+		workerQueues.clear();
+		workerCounters.clear();
+		parkSlots.clear();
+		for (int i = 0; i < workerCount; i++) {
+			workerQueues.push_back(std::make_unique<WorkStealingQueue<Task*>>());
+			workerCounters.push_back(std::make_unique<ThreadCounters>());
+			parkSlots.push_back(std::make_unique<ParkSlot>());
 		}
-		return {};
+		maxAsyncWorkers = std::max(1, workerCount - 1);
 	}
 
-	TaskManager::TaskManager() {
+	int TaskManager::WorkerCount() const {
+		return static_cast<int>(workerQueues.size());
+	}
 
+	void TaskManager::RegisterWorkerThread(int workerIndex) {
+		currentManager = this;
+		currentWorkerIndex = workerIndex;
+		stealSeed = 2463534242u + static_cast<uint32_t>(workerIndex) * 7919u;
 	}
 
 	void TaskManager::AddTask(Task&& task) {
-		currentFrameTasks.AddTask(std::move(task));
+		if (task.type == TaskType::currentFrame && task.holdsFrame)
+			pendingFrameTasks++;
+		Task* newTask = AllocateTask(std::move(task));
+		auto& signal = newTask->GetSignal();
+		if (signal && !signal->Submit(this, newTask))
+			return; //the last predecessor to finish will schedule it
+		Schedule(newTask);
+	}
+
+	bool TaskManager::OutlivesFrame(const Task& task) {
+		return task.type == TaskType::async || !task.holdsFrame;
+	}
+
+	Task* TaskManager::AllocateTask(Task&& task) {
+		if (OutlivesFrame(task)) {
+			void* memory;
+			{
+				std::lock_guard<std::mutex> lg(backgroundTaskLock);
+				if (freeBackgroundTasks.empty())
+					AddBackgroundTaskBlock();
+				memory = freeBackgroundTasks.back();
+				freeBackgroundTasks.pop_back();
+			}
+			Task* newTask = new (memory) Task(std::move(task));
+			newTask->arenaIndex = -1;
+			return newTask;
+		}
+
+		while (true) {
+			int index = currentArena.load();
+			FrameArena& arena = frameArenas[index];
+
+			//counting first keeps EndSubmission from resetting the arena underneath us,
+			//if the arena was switched in the meantime try again with the new one
+			arena.liveTasks++;
+			if (currentArena.load() != index) {
+				arena.liveTasks--;
+				continue;
+			}
+
+			Task* newTask = new (arena.Allocate(sizeof(Task), alignof(Task))) Task(std::move(task));
+			newTask->arenaIndex = index;
+			return newTask;
+		}
+	}
+
+	void TaskManager::ReleaseTask(Task* task) {
+		int index = task->arenaIndex;
+		task->~Task();
+		if (index < 0) {
+			std::lock_guard<std::mutex> lg(backgroundTaskLock);
+			freeBackgroundTasks.push_back(task);
+			return;
+		}
+		frameArenas[index].liveTasks--;
+	}
+
+	void TaskManager::AddBackgroundTaskBlock() {
+		backgroundTaskBlocks.push_back(std::make_unique<BackgroundTaskSlot[]>(BackgroundTaskBlockSize));
+		//enough room for every slot, so releasing tasks never has to grow it
+		freeBackgroundTasks.reserve(backgroundTaskBlocks.size() * BackgroundTaskBlockSize);
+		for (size_t i = 0; i < BackgroundTaskBlockSize; i++)
+			freeBackgroundTasks.push_back(&backgroundTaskBlocks.back()[i]);
+	}
+
+	TaskManager::FrameArena::FrameArena() {
+		blocks.push_back(std::make_unique<LinearAllocator>(FrameArenaSize));
+		currentBlock.store(blocks.back().get());
+	}
+
+	void* TaskManager::FrameArena::Allocate(size_t size, size_t alignment) {
+		while (true) {
+			LinearAllocator* block = currentBlock.load(std::memory_order_acquire);
+			if (void* memory = block->allocate(size, alignment))
+				return memory;
+
+			//only the first thread to find the block full chains a new one, the rest retry on it
+			std::lock_guard<std::mutex> lg(growLock);
+			if (currentBlock.load(std::memory_order_relaxed) == block) {
+				blocks.push_back(std::make_unique<LinearAllocator>(block->capacity() * 2));
+				currentBlock.store(blocks.back().get(), std::memory_order_release);
+			}
+		}
+	}
+
+	void TaskManager::FrameArena::Reset() {
+		if (blocks.size() == 1) {
+			blocks.front()->reset();
+			return;
+		}
+		size_t total = 0;
+		for (auto& block : blocks)
+			total += block->capacity();
+		blocks.clear();
+		blocks.push_back(std::make_unique<LinearAllocator>(total));
+		currentBlock.store(blocks.back().get());
+	}
+
+	void TaskManager::EndSubmission() {
+		while (pendingFrameTasks.load() > 0) {
+			if (!RunTask(false))
+				std::this_thread::yield();
+		}
+
+		//nothing else can run async work
+		if (WorkerCount() == 0)
+			RunAsyncTask();
+
+		std::vector<Task*> readyTasks;
+		{
+			std::lock_guard<std::mutex> lg(nextFrameLock);
+			readyTasks.swap(nextFrameTasks);
+		}
+		for (Task* task : readyTasks) {
+			task->type = TaskType::currentFrame;
+			pendingFrameTasks++;
+			Schedule(task);
+		}
+
+		int next = (currentArena.load() + 1) % FrameArenaCount;
+		FrameArena& arena = frameArenas[next];
+		//tasks still alive from an older frame keep the arena, it grows instead
+		if (arena.liveTasks.load() == 0)
+			arena.Reset();
+		currentArena.store(next);
 	}
 
-	std::optional<Task> TaskManager::GetTask() {
-		return currentFrameTasks.GetTask();
+	void TaskManager::Schedule(Task* task) {
+		switch (task->type) {
+		case TaskType::currentFrame:
+			if (currentManager == this && currentWorkerIndex >= 0) {
+				auto& queue = workerQueues.at(currentWorkerIndex);
+				queue->push(task);
+				auto& highWater = workerCounters[currentWorkerIndex]->queueHighWater;
+				int64_t size = queue->size();
+				if (size > highWater.load(std::memory_order_relaxed))
+					highWater.store(size, std::memory_order_relaxed);
+			}
+			else
+				currentFrameTasks.AddTask(task);
+			break;
+		case TaskType::async:
+			//kept out of the deques so frame work never sits behind it
+			asyncTasks.AddTask(task);
+			break;
+		case TaskType::nextFrame: {
+			std::lock_guard<std::mutex> lg(nextFrameLock);
+			nextFrameTasks.push_back(task);
+			return; //nothing to run till EndSubmission
+		}
+		}
+		NotifyWorker();
+	}
+
+	void TaskManager::NotifyWorker() {
+		//pairs with the fence in Park, either the parking worker sees the new task
+		//or this sees the parked worker
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (parkedWorkers.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lg(parkLock);
+			for (auto& slot : parkSlots) {
+				if (slot->isParked) {
+					slot->isParked = false;
+					slot->condVar.notify_one();
+					return;
+				}
+			}
+		}
+	}
+
+	Task* TaskManager::Steal(int thiefIndex) {
+		int queueCount = static_cast<int>(workerQueues.size());
+		if (queueCount == 0)
+			return nullptr;
+		if (stealSeed == 0)
+			stealSeed = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())) | 1u;
+
+		int start = NextStealVictim(queueCount);
+		Task* task = nullptr;
+		for (int i = 0; i < queueCount; i++) {
+			int victim = (start + i) % queueCount;
+			if (victim == thiefIndex)
+				continue;
+			if (workerQueues[victim]->steal(task)) {
+				CountersForThisThread().steals.fetch_add(1, std::memory_order_relaxed);
+				return task;
+			}
+		}
+		return nullptr;
+	}
+
+	Task* TaskManager::GetTask(bool allowAsync) {
+		int workerIndex = (currentManager == this) ? currentWorkerIndex : -1;
+
+		Task* task = nullptr;
+		if (workerIndex >= 0 && workerQueues[workerIndex]->pop(task))
+			return task;
+		if ((task = currentFrameTasks.GetTask()) != nullptr)
+			return task;
+		if ((task = Steal(workerIndex)) != nullptr)
+			return task;
+		if (allowAsync && workerIndex >= 0)
+			return GetAsyncTask();
+		return nullptr;
+	}
+
+	Task* TaskManager::GetAsyncTask() {
+		int running = runningAsyncTasks.load();
+		do {
+			if (running >= maxAsyncWorkers || asyncTasks.Empty())
+				return nullptr;
+		} while (!runningAsyncTasks.compare_exchange_weak(running, running + 1));
+
+		Task* task = asyncTasks.GetTask();
+		if (task == nullptr)
+			runningAsyncTasks--;
+		return task;
+	}
+
+	bool TaskManager::RunTask(bool allowAsync) {
+		Task* task = GetTask(allowAsync);
+		if (task == nullptr)
+			return false;
+		ExecuteTask(task);
+		return true;
+	}
+
+	bool TaskManager::RunAsyncTask() {
+		//the calling thread is waiting anyway, so it doesn't count against maxAsyncWorkers
+		Task* task = asyncTasks.GetTask();
+		if (task == nullptr)
+			return false;
+		runningAsyncTasks++;
+		ExecuteTask(task);
+		return true;
+	}
+
+	void TaskManager::ExecuteTask(Task* task) {
+		bool wasBackground = runningBackgroundTask;
+		runningBackgroundTask = task->type == TaskType::async || !task->holdsFrame;
+		(*task)();
+		runningBackgroundTask = wasBackground;
+		CountersForThisThread().tasksExecuted.fetch_add(1, std::memory_order_relaxed);
+
+		if (task->type == TaskType::currentFrame && task->holdsFrame)
+			pendingFrameTasks--;
+		else if (task->type == TaskType::async)
+			runningAsyncTasks--;
+		ReleaseTask(task);
+	}
+
+	TaskManager::ThreadCounters& TaskManager::CountersForThisThread() {
+		if (currentManager == this && currentWorkerIndex >= 0)
+			return *workerCounters[currentWorkerIndex];
+		return otherThreadCounters;
+	}
+
+	void TaskManager::AddBusyTime(std::chrono::steady_clock::duration time) {
+		auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(time);
+		CountersForThisThread().busyNanoseconds.fetch_add(nanoseconds.count(), std::memory_order_relaxed);
+	}
+
+	JobSystemStats TaskManager::GetStats() {
+		JobSystemStats stats;
+		auto start = std::chrono::steady_clock::time_point(
+			std::chrono::steady_clock::duration(statsStartTime.load(std::memory_order_relaxed)));
+		stats.elapsedTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		for (auto& counters : workerCounters)
+			stats.workers.push_back(counters->Read());
+		stats.otherThreads = otherThreadCounters.Read();
+
+		stats.currentFrameQueueHighWater = currentFrameTasks.HighWater();
+		stats.asyncQueueHighWater = asyncTasks.HighWater();
+		stats.queuedAsyncTasks = asyncTasks.Size();
+		stats.runningAsyncTasks = runningAsyncTasks.load(std::memory_order_relaxed);
+		stats.pendingFrameTasks = pendingFrameTasks.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void TaskManager::ResetStats() {
+		for (auto& counters : workerCounters)
+			counters->Reset();
+		otherThreadCounters.Reset();
+		currentFrameTasks.ResetHighWater();
+		asyncTasks.ResetHighWater();
+		statsStartTime.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+	}
+
+	bool TaskManager::ShouldSplit() {
+		if (currentManager == this && currentWorkerIndex >= 0)
+			return workerQueues[currentWorkerIndex]->empty();
+		return currentFrameTasks.Empty();
+	}
+
+	bool TaskManager::IsRunningBackgroundTask() const {
+		return runningBackgroundTask;
+	}
+
+	int TaskManager::DefaultGrainSize(int count) const {
+		//enough chunks for each thread to split a few times, more would just be overhead
+		int chunks = 8 * (WorkerCount() + 1);
+		return std::max(1, count / chunks);
+	}
+
+	bool TaskManager::HasWork() {
+		if (!currentFrameTasks.Empty())
+			return true;
+		if (!asyncTasks.Empty() && runningAsyncTasks.load() < maxAsyncWorkers)
+			return true;
+		for (auto& queue : workerQueues)
+			if (!queue->empty())
+				return true;
+		return false;
+	}
+
+	void TaskManager::Park(std::atomic_bool& isWorking, const std::atomic_int* pendingWork) {
+		std::unique_lock<std::mutex> lk(parkLock);
+		parkedWorkers++;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool hasPendingWork = pendingWork != nullptr && pendingWork->load() > 0;
+		if (isWorking && !hasPendingWork && !HasWork()) {
+			ParkSlot& slot = *parkSlots[currentWorkerIndex];
+			auto start = std::chrono::steady_clock::now();
+			slot.isParked = true;
+			slot.condVar.wait(lk);
+			slot.isParked = false;
+			auto parked = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+			CountersForThisThread().parkedNanoseconds.fetch_add(parked.count(), std::memory_order_relaxed);
+		}
+		parkedWorkers--;
 	}
 
-	Worker::Worker(TaskManager& taskMan) :
+	void TaskManager::WakeAllWorkers() {
+		std::lock_guard<std::mutex> lg(parkLock);
+		for (auto& slot : parkSlots) {
+			slot->isParked = false;
+			slot->condVar.notify_one();
+		}
+	}
+
+	void TaskManager::WakeWorker(int workerIndex) {
+		//always takes the lock, so a worker that is about to park either sees the new work or gets woken
+		std::lock_guard<std::mutex> lg(parkLock);
+		ParkSlot& slot = *parkSlots[workerIndex];
+		slot.isParked = false;
+		slot.condVar.notify_one();
+	}
+
+	thread_local FiberScheduler* currentFiberScheduler = nullptr;
+
+	FiberScheduler::FiberScheduler(TaskManager& taskMan) :
+		taskMan(taskMan)
+	{
+
+	}
+
+	FiberScheduler::~FiberScheduler() {
+		if (currentFiberScheduler == this)
+			currentFiberScheduler = nullptr;
+	}
+
+	FiberScheduler* FiberScheduler::Current() {
+		return currentFiberScheduler;
+	}
+
+	Fiber* FiberScheduler::CurrentFiber() {
+		return currentFiber;
+	}
+
+	void FiberScheduler::Run(std::atomic_bool& isWorking) {
+		currentFiberScheduler = this;
+		workerIndex = currentWorkerIndex;
+		threadFiber = std::make_unique<Fiber>();
+
+		int idleSpins = 0;
+		while (isWorking || waitingFiberCount > 0) {
+			Fiber* next = PopReadyFiber();
+			bool resumed = next != nullptr;
+			if (resumed)
+				waitingFiberCount--;
+			else
+				next = GetIdleFiber();
+
+			ranTask = false;
+			currentFiber = next;
+			auto start = std::chrono::steady_clock::now();
+			threadFiber->SwitchTo(*next);
+			Fiber* previous = currentFiber;
+			currentFiber = nullptr;
+			//only time spent in a fiber counts, so a suspended job's wait isn't busy time
+			if (ranTask || resumed)
+				taskMan.AddBusyTime(std::chrono::steady_clock::now() - start);
+
+			if (switchReason == SwitchReason::idle)
+				idleFibers.push_back(previous);
+			else
+				waitingFiberCount++;
+
+			if (ranTask || readyCount.load() > 0) {
+				idleSpins = 0;
+			}
+			else if (idleSpins < IdleSpinCount) {
+				idleSpins++;
+				std::this_thread::yield();
+			}
+			else {
+				taskMan.Park(isWorking, &readyCount);
+				idleSpins = 0;
+			}
+		}
+
+		//every fiber is idle at this point, so they can be freed
+		idleFibers.clear();
+		fibers.clear();
+		threadFiber.reset();
+		currentFiberScheduler = nullptr;
+	}
+
+	void FiberScheduler::FiberMain(void* userData) {
+		FiberScheduler* self = static_cast<FiberScheduler*>(userData);
+		while (true) {
+			//a resumed fiber is in the middle of a job, let it finish first
+			while (self->readyCount.load(std::memory_order_relaxed) == 0 && self->taskMan.RunTask())
+				self->ranTask = true;
+			self->SwitchToThread(SwitchReason::idle);
+		}
+	}
+
+	void FiberScheduler::SwitchToThread(SwitchReason reason) {
+		switchReason = reason;
+		currentFiber->SwitchTo(*threadFiber);
+	}
+
+	void FiberScheduler::Suspend() {
+		//the flag belongs to the job, not the thread, other jobs change it while this one waits
+		bool wasBackground = runningBackgroundTask;
+		SwitchToThread(SwitchReason::waiting);
+		runningBackgroundTask = wasBackground;
+	}
+
+	void FiberScheduler::Resume(Fiber* fiber) {
+		{
+			std::lock_guard<std::mutex> lg(readyLock);
+			readyFibers.push_back(fiber);
+		}
+		readyCount++;
+		//the fiber can only continue on its own worker, the others have nothing to do with it
+		taskMan.WakeWorker(workerIndex);
+	}
+
+	Fiber* FiberScheduler::PopReadyFiber() {
+		if (readyCount.load() == 0)
+			return nullptr;
+		std::lock_guard<std::mutex> lg(readyLock);
+		if (readyFibers.empty())
+			return nullptr;
+		Fiber* fiber = readyFibers.back();
+		readyFibers.pop_back();
+		readyCount--;
+		return fiber;
+	}
+
+	Fiber* FiberScheduler::GetIdleFiber() {
+		if (!idleFibers.empty()) {
+			Fiber* fiber = idleFibers.back();
+			idleFibers.pop_back();
+			return fiber;
+		}
+		fibers.push_back(std::make_unique<Fiber>(&FiberScheduler::FiberMain, this, FiberStackSize));
+		return fibers.back().get();
+	}
+
+	Worker::Worker(TaskManager& taskMan, int workerIndex, bool useFibers, int cpu) :
 		taskMan(taskMan),
+		workerIndex(workerIndex),
+		useFibers(useFibers),
+		cpu(cpu),
 		workerThread{ &Worker::Work, this }
 	{
 	}
@@ -114,30 +797,58 @@ namespace job {
 	}
 	void Worker::Stop() {
 		isWorking = false;
+		taskMan.WakeAllWorkers();
 	}
 
 	void Worker::Work() {
+		taskMan.RegisterWorkerThread(workerIndex);
+		if (cpu >= 0 && !PinCurrentThread(cpu))
+			Log::Debug << "Failed to pin worker " << workerIndex << " to cpu " << cpu << "\n";
+
+		if (useFibers) {
+			FiberScheduler scheduler(taskMan);
+			scheduler.Run(isWorking);
+			return;
+		}
+
+		int idleSpins = 0;
 		while (isWorking)
 		{
-			// taskMan.WaitOn();
-			auto task = taskMan.GetTask();
-			while (task.has_value()) {
-				(*task)();
-				task = taskMan.GetTask();
+			auto start = std::chrono::steady_clock::now();
+			if (taskMan.RunTask()) {
+				taskMan.AddBusyTime(std::chrono::steady_clock::now() - start);
+				idleSpins = 0;
+			}
+			else if (idleSpins < IdleSpinCount) {
+				idleSpins++;
+				std::this_thread::yield();
+			}
+			else {
+				taskMan.Park(isWorking);
+				idleSpins = 0;
 			}
 		}
 	}
 
-	WorkerPool::WorkerPool(TaskManager& taskMan, int workerCount) :
-		taskMan(taskMan), workerCount(workerCount)
+	WorkerPool::WorkerPool(TaskManager& taskMan, int workerCount, bool useFibers,
+		std::vector<int> workerCpus) :
+		taskMan(taskMan), workerCount(workerCount), useFibers(useFibers), workerCpus(workerCpus)
 	{
+		//set up here so the worker count is fixed before anything can submit work
+		if (workerCount > 0)
+			taskMan.SetupWorkerQueues(workerCount);
+	}
 
+	WorkerPool::~WorkerPool() {
+		StopWorkers();
+		workers.clear();
 	}
 
 	void WorkerPool::StartWorkers() {
 		if (workerCount > 0) {
 			for (int i = 0; i < workerCount; i++) {
-				workers.push_back(std::make_unique<Worker>(taskMan));
+				int cpu = i < static_cast<int>(workerCpus.size()) ? workerCpus[i] : -1;
+				workers.push_back(std::make_unique<Worker>(taskMan, i, useFibers, cpu));
 			}
 		}
 	}
@@ -219,8 +930,8 @@ namespace job {
 		tMan.AddTask(std::move(t2));
 
 
-		workerPool.StopWorkers();
 		signal2->Wait();
+		workerPool.StopWorkers();
 		jtc.Print();
 		Log::Debug << "Job system test: done\n";
 		return true;
@@ -10,35 +10,95 @@
 #include <thread>
 #include <atomic>
 #include <functional>
+#include <optional>
+#include <type_traits>
+#include <array>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
 
 #include "../util/ConcurrentQueue.h"
+#include "../util/WorkStealingQueue.h"
+#include "../util/LinearAllocator.h"
 
 namespace job {
 
 
+	//Move only callable stored inline, creating and moving jobs never allocates.
+	//Callables bigger than InlineSize don't compile, capture by reference or pointer instead.
 	class Job {
 	public:
-		Job(std::function<void()> work) : work(work) {}
+		static constexpr size_t InlineSize = 48;
+
+		Job() = default;
+
+		template<typename Func, typename = std::enable_if_t<!std::is_same<std::decay_t<Func>, Job>::value>>
+		Job(Func&& func);
+
+		Job(Job&& other) noexcept;
+		Job& operator=(Job&& other) noexcept;
+
+		Job(const Job& other) = delete;
+		Job& operator=(const Job& other) = delete;
+
+		~Job();
+
+		void operator()();
 
-		void operator()() {
-			if (work)
-				work();
-		}
 	private:
-		std::function<void()> work;
+		struct Operations {
+			void(*invoke)(void* storage);
+			void(*move)(void* dest, void* src); //move constructs into dest then destroys src
+			void(*destroy)(void* storage);
+		};
+
+		template<typename Func>
+		static const Operations* GetOperations();
+
+		void Reset();
+
+		alignas(std::max_align_t) unsigned char storage[InlineSize];
+		const Operations* ops = nullptr;
 	};
 
 	enum class TaskType {
-		currentFrame,
-		async,
-		nextFrame
+		currentFrame, //must finish before the frame is submitted, highest priority
+		async, //long running work done in the gaps, never holds up the frame
+		nextFrame //held back till EndSubmission, then runs as currentFrame work
 	};
 
 	class TaskSignal;
+	class TaskManager;
+	class Fiber;
+	class FiberScheduler;
+
+	//Lets the owner of some work call it off. Copies share the same flag.
+	//A task cancelled before it starts skips its jobs (its signal still fires, so dependents
+	//carry on), jobs that are already running have to poll IsCancelled themselves.
+	class CancellationToken {
+	public:
+		//A default constructed token can never be cancelled and costs nothing to copy around
+		CancellationToken() = default;
+		static CancellationToken Create();
+
+		void Cancel();
+		bool IsCancelled() const;
+
+	private:
+		std::shared_ptr<std::atomic_bool> cancelled;
+	};
 
 	class Task {
 	public:
-		Task(TaskType type, std::weak_ptr<TaskSignal> signalBlock);
+		//jobs past this count spill into a heap allocated vector
+		static constexpr int InlineJobCount = 4;
+
+		Task(TaskType type, std::shared_ptr<TaskSignal> signalBlock = nullptr,
+			CancellationToken cancelToken = {});
+
+		Task(Task&& other) = default;
+		Task& operator=(Task&& other) = default;
 
 		void Add(Job&& newJob);
 
@@ -46,67 +106,372 @@ namespace job {
 
 		void WaitOn();
 
-		bool IsReadyToRun();
+		std::shared_ptr<TaskSignal>& GetSignal();
 
 	private:
+		friend class TaskManager;
+
 		TaskType type;
-		std::vector<Job> jobs;
-		std::weak_ptr<TaskSignal> signalBlock;
+		std::array<Job, InlineJobCount> inlineJobs;
+		int inlineJobCount = 0;
+		std::vector<Job> extraJobs;
+		std::shared_ptr<TaskSignal> signalBlock;
+		CancellationToken cancelToken;
+
+		int arenaIndex = -1; //which frame arena the task lives in, -1 if in the background task pool
+
+		//currentFrame tasks split off from async work run like frame work but EndSubmission doesn't wait on them
+		bool holdsFrame = true;
 	};
 
-	class TaskSignal {
+	//Completion handle and dependency node of a task.
+	//Holds a count of unfinished predecessors, when it reaches zero the task is handed
+	//straight to the scheduler by whichever predecessor finished last.
+	class TaskSignal : public std::enable_shared_from_this<TaskSignal> {
 	public:
 		TaskSignal();
 		~TaskSignal();
 
 		void Signal(); //for task to call
 
-		void Wait(); //for owner to call
+		//for owner to call, inside a job running on a fiber only the fiber is suspended
+		void Wait();
+
+		bool IsFinished();
 
-		bool IsReadyToRun();
-		void AddTaskToWaitOn(std::shared_ptr<TaskSignal>);
+		//Must be called before the task owning this signal is submitted
+		void AddTaskToWaitOn(std::shared_ptr<TaskSignal> taskSig);
 
 	private:
-		std::atomic_bool finished = false;
+		friend class TaskManager;
+
+		//Returns false if the predecessor already finished
+		bool AddSuccessor(std::shared_ptr<TaskSignal> successor);
+		void PredecessorFinished();
+
+		//Called when the task is submitted, returns true if it can be scheduled right away
+		bool Submit(TaskManager* manager, Task* task);
 
-		std::mutex condVar_lock;
+		//starts at one, which is held until the task is submitted
+		std::atomic_int unfinishedPredecessors = 1;
+		TaskManager* manager = nullptr;
+		Task* waitingTask = nullptr;
+
+		std::mutex lock;
 		std::condition_variable condVar;
+		bool finished = false;
+		std::vector<std::shared_ptr<TaskSignal>> successors;
+
+		struct WaitingFiber {
+			FiberScheduler* scheduler;
+			Fiber* fiber;
+		};
+		std::vector<WaitingFiber> waitingFibers;
+	};
+
+	//Snapshot of one thread's counters, times are in seconds
+	struct WorkerStats {
+		uint64_t tasksExecuted = 0;
+		double busyTime = 0.0; //running tasks, not counted for non-worker threads
+		double parkedTime = 0.0; //asleep waiting for work
+		uint64_t steals = 0;
+		uint64_t dependencyWaits = 0; //TaskSignal::Wait calls that had to wait
+		int64_t queueHighWater = 0; //most tasks in the worker's deque at once
+	};
 
-		std::mutex pred_lock;
-		std::vector<std::shared_ptr<TaskSignal>> predicates;
+	struct JobSystemStats {
+		double elapsedTime = 0.0; //since the counters were last reset
+		std::vector<WorkerStats> workers;
+		WorkerStats otherThreads; //main thread and anything else that helps run tasks
+
+		int currentFrameQueueHighWater = 0;
+		int asyncQueueHighWater = 0;
+		int queuedAsyncTasks = 0;
+		int runningAsyncTasks = 0;
+		int pendingFrameTasks = 0;
 	};
 
+	//Global injection queue, holds tasks submitted from outside of the workers
+	//Stored in a ring which only allocates when it has to grow
 	class TaskPool {
 	public:
 		TaskPool();
 
-		void AddTask(Task&& task);
+		void AddTask(Task* task);
+
+		//returns nullptr if empty
+		Task* GetTask();
+
+		//lock free, approximate
+		bool Empty();
+		int Size();
 
-		std::optional<Task> GetTask();
+		int HighWater();
+		void ResetHighWater();
 
 	private:
 		std::mutex queueLock;
-		std::queue<Task> tasks;
+		std::vector<Task*> tasks;
+		size_t head = 0;
+		std::atomic_int count = 0;
+		std::atomic_int highWater = 0;
 	};
 
 	class TaskManager {
 	public:
 		TaskManager();
+		~TaskManager();
 
+		TaskManager(const TaskManager& other) = delete;
+		TaskManager& operator=(const TaskManager& other) = delete;
+
+		//Workers push onto their own deque, every other thread uses the injection queue
 		void AddTask(Task&& task);
 
-		std::optional<Task> GetTask();
+		//Runs one task from the calling thread, returns false if no work could be found
+		//Async tasks are only ever picked up by workers, and only when allowAsync is set
+		bool RunTask(bool allowAsync = true);
+
+		//Runs one queued async task on the calling thread, returns false if none are queued.
+		//For threads that have to wait on async work finishing, like tear down, so they can't
+		//hang when the workers are busy or already stopped. Ignores the async worker limit
+		bool RunAsyncTask();
 
+		//Marks the end of a frame's submissions. Helps run the frame's work till all of it
+		//has finished, then releases the nextFrame tasks and flips the frame arenas.
+		//currentFrame tasks must not depend on async ones or this waits on the async work too
 		void EndSubmission();
 
+		//Splits [begin, end) into chunks and calls func(chunkBegin, chunkEnd) on them across the workers.
+		//Ranges are only split when the splitting thread has nothing queued (lazy binary splitting),
+		//so idle workers get something to steal without flooding the queues with tiny tasks.
+		//The calling thread works on the range too and returns once every chunk has run.
+		//A grainSize of 0 picks one from the worker count. func must not throw.
+		template<typename Func>
+		void ParallelFor(int begin, int end, int grainSize, Func&& func);
+
+		//Same as above, but chunks that start after the token is cancelled are skipped
+		template<typename Func>
+		void ParallelFor(int begin, int end, int grainSize, const CancellationToken& cancelToken, Func&& func);
+
+		//func(chunkBegin, chunkEnd) returns the result of a chunk, which are merged with combine.
+		//Each split keeps its own partial result and they are merged up the split tree in range order,
+		//without any locking, so combine only has to be associative.
+		template<typename T, typename Func, typename Combine>
+		T ParallelReduce(int begin, int end, int grainSize, T identity, Func&& func, Combine&& combine);
+
+		//Must be called before any worker is started
+		void SetupWorkerQueues(int workerCount);
+		int WorkerCount() const;
+
+		//Binds the calling thread to a worker's deque
+		void RegisterWorkerThread(int workerIndex);
+
+		//Counters are cheap relaxed atomics kept per worker, safe to read from any thread
+		JobSystemStats GetStats();
+		void ResetStats();
+
+		//Blocks the calling worker until new work is submitted or it is woken
+		//pendingWork is any extra work the worker has of its own, it won't park while it is above zero
+		void Park(std::atomic_bool& isWorking, const std::atomic_int* pendingWork = nullptr);
+		void WakeAllWorkers();
+		//Only wakes the given worker, for work no other worker can run
+		void WakeWorker(int workerIndex);
+
 	private:
+		friend class TaskSignal;
+		friend class Worker;
+		friend class FiberScheduler;
+
+		//Written by the thread they belong to, except the shared one for non-worker threads
+		struct alignas(64) ThreadCounters {
+			std::atomic<uint64_t> tasksExecuted = 0;
+			std::atomic<uint64_t> busyNanoseconds = 0;
+			std::atomic<uint64_t> parkedNanoseconds = 0;
+			std::atomic<uint64_t> steals = 0;
+			std::atomic<uint64_t> dependencyWaits = 0;
+			std::atomic<int64_t> queueHighWater = 0;
+
+			void Reset();
+			WorkerStats Read();
+		};
+		ThreadCounters& CountersForThisThread();
+		void AddBusyTime(std::chrono::steady_clock::duration time);
+
+		void Schedule(Task* task);
+		void NotifyWorker();
+
+		//Frame work goes into the current frame arena, tasks that can outlive the frame into the background pool
+		Task* AllocateTask(Task&& task);
+		void ReleaseTask(Task* task);
+
+		//Lives on the stack of the thread that called ParallelFor, which waits till remaining is zero
+		template<typename Func>
+		struct ParallelForState {
+			Func* func;
+			int grainSize;
+			std::atomic_int remaining;
+		};
+
+		template<typename Func>
+		void RunRange(ParallelForState<Func>* state, int begin, int end);
+
+		//Shared by every split of a ParallelReduce, lives on the stack of the thread that called it
+		template<typename T, typename Func, typename Combine>
+		struct ParallelReduceState {
+			Func* func;
+			Combine* combine;
+			const T* identity;
+			int grainSize;
+		};
+
+		//Partial result of the upper half of a split, filled in by whichever thread runs it
+		template<typename T>
+		struct ReduceSplit {
+			std::optional<T> result;
+			std::atomic_bool done = false;
+		};
+		//every split halves the range, so an int range can't be split more often than this
+		static constexpr int MaxReduceSplits = 32;
+
+		//Reduces [begin, end) and returns the result, waiting on the splits it made
+		template<typename T, typename Func, typename Combine>
+		T RunReduceRange(ParallelReduceState<T, Func, Combine>* state, int begin, int end);
+
+		//true when the calling thread has no queued work that idle workers could steal instead
+		bool ShouldSplit();
+		int DefaultGrainSize(int count) const;
+
+		//true while the calling thread is inside an async task, or a split of one
+		bool IsRunningBackgroundTask() const;
+
+		Task* GetTask(bool allowAsync);
+		Task* GetAsyncTask();
+		void ExecuteTask(Task* task);
+		Task* Steal(int thiefIndex);
+		bool HasWork();
+
 		TaskPool currentFrameTasks;
 		TaskPool asyncTasks;
+
+		std::mutex nextFrameLock;
+		std::vector<Task*> nextFrameTasks;
+
+		//currentFrame tasks submitted but not finished, including ones waiting on dependencies
+		std::atomic_int pendingFrameTasks = 0;
+
+		//async tasks only run on this many workers at once, so frame work always has a free worker
+		std::atomic_int runningAsyncTasks = 0;
+		int maxAsyncWorkers = 1;
+
+		std::vector<std::unique_ptr<WorkStealingQueue<Task*>>> workerQueues;
+
+		std::vector<std::unique_ptr<ThreadCounters>> workerCounters;
+		ThreadCounters otherThreadCounters;
+		std::atomic<std::chrono::steady_clock::rep> statsStartTime;
+
+		//Frame task nodes are bump allocated from the current arena. EndSubmission switches arenas and
+		//only resets the next one once every task allocated from it has been released, so
+		//tasks still waiting on dependencies stay valid.
+		//A full arena chains another block twice the size of the last, on reset the blocks are
+		//merged into one so a frame that needed more only allocates again the frame after.
+		static constexpr int FrameArenaCount = 2;
+		static constexpr size_t FrameArenaSize = 2 * 1024 * 1024;
+		struct FrameArena {
+			FrameArena();
+
+			void* Allocate(size_t size, size_t alignment);
+			//nothing may be allocating from the arena
+			void Reset();
+
+			std::mutex growLock;
+			std::vector<std::unique_ptr<LinearAllocator>> blocks;
+			std::atomic<LinearAllocator*> currentBlock;
+			std::atomic_int liveTasks = 0;
+		};
+		FrameArena frameArenas[FrameArenaCount];
+		std::atomic_int currentArena = 0;
+
+		//Async tasks and the splits of them can run for many frames and would keep a frame arena
+		//from ever being reset, so their nodes are recycled through a free list instead.
+		//The list is filled a block at a time, so how many are alive at once rarely reaches a new high
+		static bool OutlivesFrame(const Task& task);
+		void AddBackgroundTaskBlock();
+		static constexpr size_t BackgroundTaskBlockSize = 64;
+		struct alignas(Task) BackgroundTaskSlot {
+			std::byte memory[sizeof(Task)];
+		};
+		std::mutex backgroundTaskLock;
+		std::vector<std::unique_ptr<BackgroundTaskSlot[]>> backgroundTaskBlocks;
+		std::vector<void*> freeBackgroundTasks;
+
+		//Every worker parks on its own condition variable, all guarded by parkLock,
+		//so a wake up can go to one worker in particular
+		struct ParkSlot {
+			std::condition_variable condVar;
+			bool isParked = false;
+		};
+		std::mutex parkLock;
+		std::vector<std::unique_ptr<ParkSlot>> parkSlots;
+		std::atomic_int parkedWorkers = 0;
+	};
+
+	//Runs a worker's tasks on a pool of fibers. A job that waits on a signal only suspends its
+	//fiber, the worker carries on with other tasks on a fresh fiber and picks the suspended one
+	//back up once the signal fires. Fibers never move between threads.
+	class FiberScheduler {
+	public:
+		FiberScheduler(TaskManager& taskMan);
+		~FiberScheduler();
+
+		//Runs tasks till isWorking is false and no fiber is left waiting
+		void Run(std::atomic_bool& isWorking);
+
+		//From inside a job, returns once Resume has been called on the running fiber
+		void Suspend();
+
+		//Any thread, queues a suspended fiber to continue on its worker
+		void Resume(Fiber* fiber);
+
+		Fiber* CurrentFiber();
+
+		//nullptr if the calling thread isn't running fibers
+		static FiberScheduler* Current();
+
+	private:
+		static void FiberMain(void* scheduler);
+
+		enum class SwitchReason {
+			idle, //ran out of tasks or has to make way for a resumed fiber
+			waiting
+		};
+		void SwitchToThread(SwitchReason reason);
+
+		Fiber* GetIdleFiber();
+		Fiber* PopReadyFiber();
+
+		static constexpr size_t FiberStackSize = 256 * 1024;
+
+		TaskManager& taskMan;
+		int workerIndex = -1;
+
+		std::unique_ptr<Fiber> threadFiber;
+		std::vector<std::unique_ptr<Fiber>> fibers;
+		std::vector<Fiber*> idleFibers;
+		Fiber* currentFiber = nullptr;
+		SwitchReason switchReason = SwitchReason::idle;
+		bool ranTask = false;
+		int waitingFiberCount = 0;
+
+		std::mutex readyLock;
+		std::vector<Fiber*> readyFibers;
+		std::atomic_int readyCount = 0;
 	};
 
 	class Worker {
 	public:
-		Worker(TaskManager& taskMan);
+		//cpu of -1 leaves the thread unpinned
+		Worker(TaskManager& taskMan, int workerIndex, bool useFibers = false, int cpu = -1);
 		~Worker();
 
 		void Stop();
@@ -114,14 +479,21 @@ namespace job {
 	private:
 		void Work();
 		TaskManager& taskMan;
+		int workerIndex;
+		bool useFibers;
+		int cpu;
 
-		std::thread workerThread;
 		std::atomic_bool isWorking = true;
+		std::thread workerThread;
 	};
 
 	class WorkerPool {
 	public:
-		WorkerPool(TaskManager& taskMan, int workerCount = 1);
+		//useFibers runs jobs on fibers so waiting on a signal inside a job doesn't block the worker
+		//workerCpus pins each worker to a cpu, leave empty to let the os place them
+		WorkerPool(TaskManager& taskMan, int workerCount = 1, bool useFibers = false,
+			std::vector<int> workerCpus = {});
+		~WorkerPool();
 
 		void StartWorkers();
 		void StopWorkers();
@@ -130,7 +502,140 @@ namespace job {
 		TaskManager & taskMan;
 		std::vector<std::unique_ptr<Worker>> workers;
 		int workerCount = 1;
+		bool useFibers = false;
+		std::vector<int> workerCpus;
 	};
 
+	template<typename Func, typename>
+	Job::Job(Func&& func) {
+		using FuncType = std::decay_t<Func>;
+		static_assert(sizeof(FuncType) <= InlineSize, "Job callable too large for inline storage");
+		static_assert(alignof(FuncType) <= alignof(std::max_align_t), "Job callable over aligned");
+		new (storage) FuncType(std::forward<Func>(func));
+		ops = GetOperations<FuncType>();
+	}
+
+	template<typename Func>
+	const Job::Operations* Job::GetOperations() {
+		static const Operations operations = {
+			[](void* storage) { (*static_cast<Func*>(storage))(); },
+			[](void* dest, void* src) {
+				new (dest) Func(std::move(*static_cast<Func*>(src)));
+				static_cast<Func*>(src)->~Func();
+			},
+			[](void* storage) { static_cast<Func*>(storage)->~Func(); }
+		};
+		return &operations;
+	}
+
+	template<typename Func>
+	void TaskManager::ParallelFor(int begin, int end, int grainSize, Func&& func) {
+		if (end <= begin)
+			return;
+		if (grainSize <= 0)
+			grainSize = DefaultGrainSize(end - begin);
+		if (WorkerCount() == 0 || end - begin <= grainSize) {
+			func(begin, end);
+			return;
+		}
+
+		using FuncType = std::remove_reference_t<Func>;
+		ParallelForState<FuncType> state{ &func, grainSize, { end - begin } };
+
+		RunRange(&state, begin, end);
+
+		//help out instead of blocking, the remaining chunks may be sitting in our own deque
+		while (state.remaining.load(std::memory_order_acquire) > 0) {
+			if (!RunTask(false))
+				std::this_thread::yield();
+		}
+	}
+
+	template<typename Func>
+	void TaskManager::ParallelFor(int begin, int end, int grainSize, const CancellationToken& cancelToken, Func&& func) {
+		ParallelFor(begin, end, grainSize, [&cancelToken, &func](int chunkBegin, int chunkEnd) {
+			if (!cancelToken.IsCancelled())
+				func(chunkBegin, chunkEnd);
+		});
+	}
+
+	template<typename Func>
+	void TaskManager::RunRange(ParallelForState<Func>* state, int begin, int end) {
+		int executed = 0;
+		while (end - begin > state->grainSize) {
+			if (ShouldSplit()) {
+				int mid = begin + (end - begin) / 2;
+				Task task(TaskType::currentFrame);
+				task.holdsFrame = !IsRunningBackgroundTask();
+				task.Add(Job([this, state, mid, end] { RunRange(state, mid, end); }));
+				AddTask(std::move(task));
+				end = mid;
+			}
+			else {
+				(*state->func)(begin, begin + state->grainSize);
+				executed += state->grainSize;
+				begin += state->grainSize;
+			}
+		}
+		(*state->func)(begin, end);
+		executed += end - begin;
+
+		//last access to state, the owner may return as soon as this hits zero
+		state->remaining.fetch_sub(executed, std::memory_order_acq_rel);
+	}
+
+	template<typename T, typename Func, typename Combine>
+	T TaskManager::ParallelReduce(int begin, int end, int grainSize, T identity, Func&& func, Combine&& combine) {
+		if (end <= begin)
+			return identity;
+		if (grainSize <= 0)
+			grainSize = DefaultGrainSize(end - begin);
+		if (WorkerCount() == 0 || end - begin <= grainSize)
+			return combine(identity, func(begin, end));
+
+		using FuncType = std::remove_reference_t<Func>;
+		using CombineType = std::remove_reference_t<Combine>;
+		ParallelReduceState<T, FuncType, CombineType> state{ &func, &combine, &identity, grainSize };
+		return RunReduceRange(&state, begin, end);
+	}
+
+	template<typename T, typename Func, typename Combine>
+	T TaskManager::RunReduceRange(ParallelReduceState<T, Func, Combine>* state, int begin, int end) {
+		ReduceSplit<T> splits[MaxReduceSplits];
+		int splitCount = 0;
+
+		T result = *state->identity;
+		while (end - begin > state->grainSize) {
+			if (splitCount < MaxReduceSplits && ShouldSplit()) {
+				int mid = begin + (end - begin) / 2;
+				ReduceSplit<T>* split = &splits[splitCount++];
+				Task task(TaskType::currentFrame);
+				task.holdsFrame = !IsRunningBackgroundTask();
+				task.Add(Job([this, state, split, mid, end] {
+					split->result = RunReduceRange(state, mid, end);
+					split->done.store(true, std::memory_order_release);
+				}));
+				AddTask(std::move(task));
+				end = mid;
+			}
+			else {
+				result = (*state->combine)(result, (*state->func)(begin, begin + state->grainSize));
+				begin += state->grainSize;
+			}
+		}
+		result = (*state->combine)(result, (*state->func)(begin, end));
+
+		//the latest split holds the range right after ours, so merging backwards keeps range order.
+		//help out instead of blocking, the splits may be sitting in our own deque
+		for (int i = splitCount - 1; i >= 0; i--) {
+			while (!splits[i].done.load(std::memory_order_acquire)) {
+				if (!RunTask(false))
+					std::this_thread::yield();
+			}
+			result = (*state->combine)(result, *splits[i].result);
+		}
+		return result;
+	}
+
 	extern bool JobTester();
 }
\ No newline at end of file
@@ -31,6 +31,17 @@ void VulkanAppSettings::Load() {
 
 		isFrameCapped = settings["is-frame-rate-capped"];
 		MaxFPS = settings["max-fps"];
+
+		//older settings files don't have these
+		useJobFibers = settings.value("use-job-fibers", useJobFibers);
+
+		if (settings.count("threading")) {
+			auto& t = settings["threading"];
+			threading.jobWorkers = t.value("job-workers", threading.jobWorkers);
+			threading.reservedCores = t.value("reserved-cores", threading.reservedCores);
+			threading.pinWorkers = t.value("pin-workers", threading.pinWorkers);
+			threading.avoidSMT = t.value("avoid-smt", threading.avoidSMT);
+		}
 	}
 	else {
 		Log::Debug << "Settings file didn't exist, creating one";
@@ -51,32 +62,35 @@ void VulkanAppSettings::Save() {
 	j["is-frame-rate-capped"] = isFrameCapped;
 	j["max-fps"] = MaxFPS;
 
+	j["use-job-fibers"] = useJobFibers;
+
+	//0 for a count picks it from the cpu topology
+	j["threading"]["job-workers"] = threading.jobWorkers;
+	j["threading"]["reserved-cores"] = threading.reservedCores;
+	j["threading"]["pin-workers"] = threading.pinWorkers;
+	j["threading"]["avoid-smt"] = threading.avoidSMT;
+
 	std::ofstream outFile(fileName);
 	outFile << std::setw(4) << j;
 	outFile.close();
 }
 
-unsigned int HardwareThreadCount() {
-	unsigned int concurentThreadsSupported = std::thread::hardware_concurrency();
-	Log::Debug << "Hardware Threads Available = " << concurentThreadsSupported << "\n";
-	//TODO: Use task pool for everything, no need for system jamming atm;
-	return 0;
-	return concurentThreadsSupported > 0 ? concurentThreadsSupported : 1;
-}
-
 VulkanApp::VulkanApp() :
 	settings("settings.json"),
-	workerPool(taskManager, HardwareThreadCount()),
+	threadingPlan(job::PlanThreads(job::CpuTopology::Query(), settings.threading)),
+	workerPool(taskManager, threadingPlan.jobWorkers, settings.useJobFibers, threadingPlan.jobWorkerCpus),
 	timeManager(),
 	window(settings.isFullscreen,
 		glm::ivec2(settings.screenWidth, settings.screenHeight),
 		glm::ivec2(10, 10)),
 	resourceManager(),
-	vulkanRenderer(settings.useValidationLayers, window, resourceManager),
+	vulkanRenderer(settings.useValidationLayers, window, resourceManager, taskManager),
 	imgui_nodeGraph_terrain(),
 	scene(resourceManager, vulkanRenderer,
-		timeManager, imgui_nodeGraph_terrain.GetGraph())
+		timeManager, taskManager, imgui_nodeGraph_terrain.GetGraph())
 {
+	//the main thread keeps the reserved core to itself
+	job::PinCurrentThread(threadingPlan.mainThreadCpu);
 
 	/*timeManager = std::make_unique<TimeManager>();
 
@@ -98,9 +112,11 @@ VulkanApp::VulkanApp() :
 }
 
 
+//workerPool is declared before the scene and renderer, so it only stops and joins the workers
+//once they are destroyed. Their tear down may still need async work run
 VulkanApp::~VulkanApp()
 {
-	workerPool.StopWorkers();
+
 }
 
 void VulkanApp::Run() {
@@ -114,12 +130,15 @@ void VulkanApp::Run() {
 		}
 
 		timeManager.StartFrameTimer();
+		uint64_t frameStartAllocations = AllocationHook::AllocationCount();
 		Input::inputDirector.UpdateInputs();
 		HandleInputs();
 		scene.UpdateScene();
 		BuildImgui();
+		taskManager.EndSubmission();
 		vulkanRenderer.RenderFrame();
 		Input::inputDirector.ResetReleasedInput();
+		lastFrameAllocations = AllocationHook::AllocationCount() - frameStartAllocations;
 
 		if (settings.isFrameCapped) {
 			if (timeManager.ExactTimeSinceFrameStart() < 1.0 / settings.MaxFPS) {
@@ -156,6 +175,9 @@ void VulkanApp::DebugOverlay(bool* show_debug_overlay) {
 	if (verbose) ImGui::Text("Run Time: %f(s)", timeManager.RunningTime());
 	if (verbose) ImGui::Text("Last frame time%f(s)", timeManager.PreviousFrameTime());
 	if (verbose) ImGui::Text("Last frame time%f(s)", timeManager.PreviousFrameTime());
+	if (verbose) ImGui::Text("Frame scratch %zu / %zu KB", vulkanRenderer.frameAllocator.used() / 1024,
+		vulkanRenderer.frameAllocator.capacity() / 1024);
+	if (verbose && AllocationHook::IsEnabled()) ImGui::Text("Heap allocations last frame %llu", (unsigned long long)lastFrameAllocations);
 	ImGui::Separator();
 	ImGui::Text("Mouse Position: (%.1f,%.1f)", ImGui::GetIO().MousePos.x, ImGui::GetIO().MousePos.y);
 	//ImGui::SliderFloat("Temp spin", &tempCameraSpeed, -5.0f, 5.0f);
@@ -163,6 +185,40 @@ void VulkanApp::DebugOverlay(bool* show_debug_overlay) {
 
 }
 
+void VulkanApp::JobSystemWindow(bool* show_job_system_window) {
+	ImGui::SetNextWindowPos(ImVec2(0, 400), ImGuiSetCond_FirstUseEver);
+	if (!ImGui::Begin("Job System", show_job_system_window))
+	{
+		ImGui::End();
+		return;
+	}
+	job::JobSystemStats stats = taskManager.GetStats();
+	double elapsed = stats.elapsedTime > 0.0 ? stats.elapsedTime : 1.0;
+
+	ImGui::Text("Sampled over %.1f(s)", stats.elapsedTime);
+	ImGui::SameLine();
+	if (ImGui::Button("Reset"))
+		taskManager.ResetStats();
+
+	ImGui::Text("Frame queue high water %d", stats.currentFrameQueueHighWater);
+	ImGui::Text("Async queue high water %d", stats.asyncQueueHighWater);
+	ImGui::Text("Async queued %d running %d", stats.queuedAsyncTasks, stats.runningAsyncTasks);
+	ImGui::Separator();
+
+	for (size_t i = 0; i < stats.workers.size(); i++) {
+		auto& worker = stats.workers[i];
+		ImGui::Text("Worker %zu: busy %.1f%% parked %.1f%%", i,
+			100.0 * worker.busyTime / elapsed, 100.0 * worker.parkedTime / elapsed);
+		ImGui::Text("  tasks %llu steals %llu waits %llu deque high water %lld",
+			(unsigned long long)worker.tasksExecuted, (unsigned long long)worker.steals,
+			(unsigned long long)worker.dependencyWaits, (long long)worker.queueHighWater);
+	}
+	ImGui::Text("Other threads: tasks %llu steals %llu waits %llu",
+		(unsigned long long)stats.otherThreads.tasksExecuted, (unsigned long long)stats.otherThreads.steals,
+		(unsigned long long)stats.otherThreads.dependencyWaits);
+	ImGui::End();
+}
+
 void VulkanApp::CameraWindow(bool* show_camera_window) {
 	ImGui::SetNextWindowPos(ImVec2(0, 100), ImGuiSetCond_FirstUseEver);
 
@@ -249,6 +305,7 @@ void VulkanApp::BuildImgui() {
 	if (debug_mode && panels.showGui) {
 
 		if (panels.debug_overlay) DebugOverlay(&panels.debug_overlay);
+		if (panels.job_system_stats) JobSystemWindow(&panels.job_system_stats);
 		if (panels.camera_controls) CameraWindow(&panels.camera_controls);
 		if (panels.controls_list) ControlsWindow(&panels.controls_list);
 
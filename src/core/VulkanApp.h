@@ -6,11 +6,13 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 
 #include "JobSystem.h"
+#include "CpuTopology.h"
 #include "Window.h"
 #include "Input.h"
 #include "Logger.h"
 #include "TimeManager.h"
 #include "CoreTools.h"
+#include "AllocationHook.h"
 
 #include "../resources/ResourceManager.h"
 
@@ -26,6 +28,7 @@ struct ImGUI_PanelSettings {
 	bool camera_controls = true;
 	bool log = true;
 	bool debug_overlay = true;
+	bool job_system_stats = true;
 	bool controls_list = true;
 };
 
@@ -43,6 +46,9 @@ public:
 
 	bool isFrameCapped = true;
 	double MaxFPS = 100.0f;
+
+	bool useJobFibers = false;
+	job::ThreadingSettings threading;
 private:
 	std::string fileName;
 };
@@ -60,6 +66,7 @@ public:
 
 private:
 	VulkanAppSettings settings;
+	job::ThreadingPlan threadingPlan;
 
 	job::TaskManager taskManager;
 	job::WorkerPool workerPool;
@@ -82,6 +89,7 @@ private:
 	void BuildImgui();
 
 	void DebugOverlay(bool* show_debug_overlay);
+	void JobSystemWindow(bool* show_job_system_window);
 	void CameraWindow(bool* show_camera_overlay);
 	void ControlsWindow(bool* show_controls_window);
 	void ControllerWindow(bool* show_controller_window);
@@ -90,5 +98,7 @@ private:
 	Log::Logger appLog;
 
 	float tempCameraSpeed = 0.0f;
+
+	uint64_t lastFrameAllocations = 0; //heap allocations in the last frame, needs COUNT_HEAP_ALLOCATIONS
 };
 
@@ -876,8 +876,9 @@ namespace InternalGraph {
 	}
 
 
-	GraphUser::GraphUser(const GraphPrototype& graph,
-		int seed, int cellsWide, glm::i32vec2 pos, float scale) :
+	GraphUser::GraphUser(const GraphPrototype& graph, job::TaskManager& taskManager,
+		int seed, int cellsWide, glm::i32vec2 pos, float scale,
+		job::CancellationToken cancelToken) :
 		info(seed, cellsWide, scale, pos)
 	{
 		//glm::ivec2(pos.x * (cellsWide) / scale, pos.y * (cellsWide) / scale), scale / (cellsWide)
@@ -897,46 +898,48 @@ namespace InternalGraph {
 		}
 
 		for (auto& node : nodeMap) {
+			if (cancelToken.IsCancelled())
+				break;
 			node.second.SetupNodeForComputation(info);
 		}
 
 		outputNode = &nodeMap[graph.GetOutputNodeID()];
 
+		//nodes are read only once setup, so rows can be evaluated in parallel
 		outputHeightMap = NoiseImage2D<float>(cellsWide);
-		for (int x = 0; x < cellsWide; x++)
-		{
-			for (int z = 0; z < cellsWide; z++)
+		taskManager.ParallelFor(0, cellsWide, 0, cancelToken, [&](int xBegin, int xEnd) {
+			for (int x = xBegin; x < xEnd; x++)
 			{
-				float val = std::get<float>(outputNode->GetHeightMapValue(x, z));
-				outputHeightMap.SetPixelValue(x, z, val);
+				for (int z = 0; z < cellsWide; z++)
+				{
+					float val = std::get<float>(outputNode->GetHeightMapValue(x, z));
+					outputHeightMap.SetPixelValue(x, z, val);
+				}
 			}
-		}
+		});
 
 		outputSplatmap = std::vector<std::byte>(cellsWide * cellsWide * 4);
-		int i = 0;
-		for (int x = 0; x < cellsWide; x++)
-		{
-			for (int z = 0; z < cellsWide; z++)
+		taskManager.ParallelFor(0, cellsWide, 0, cancelToken, [&](int xBegin, int xEnd) {
+			for (int x = xBegin; x < xEnd; x++)
 			{
-				glm::vec4 val = glm::normalize(std::get<glm::vec4>(outputNode->GetSplatMapValue(z, x)));
-				//Resource::Texture::Pixel_RGBA pixel = Resource::Texture::Pixel_RGBA(
-
-				std::byte r = static_cast<std::byte>(static_cast<uint8_t>(glm::clamp(val.x, 0.0f, 1.0f) * 255.0f));
-				std::byte g = static_cast<std::byte>(static_cast<uint8_t>(glm::clamp(val.y, 0.0f, 1.0f) * 255.0f));
-				std::byte b = static_cast<std::byte>(static_cast<uint8_t>(glm::clamp(val.z, 0.0f, 1.0f) * 255.0f));
-				std::byte a = static_cast<std::byte>(static_cast<uint8_t>(glm::clamp(val.w, 0.0f, 1.0f) * 255.0f));
-
-				outputSplatmap.at(i++) = r;
-				outputSplatmap.at(i++) = g;
-				outputSplatmap.at(i++) = b;
-				outputSplatmap.at(i++) = a;
+				int i = x * cellsWide * 4;
+				for (int z = 0; z < cellsWide; z++)
+				{
+					glm::vec4 val = glm::normalize(std::get<glm::vec4>(outputNode->GetSplatMapValue(z, x)));
+					//Resource::Texture::Pixel_RGBA pixel = Resource::Texture::Pixel_RGBA(
+
+					std::byte r = static_cast<std::byte>(static_cast<uint8_t>(glm::clamp(val.x, 0.0f, 1.0f) * 255.0f));
+					std::byte g = static_cast<std::byte>(static_cast<uint8_t>(glm::clamp(val.y, 0.0f, 1.0f) * 255.0f));
+					std::byte b = static_cast<std::byte>(static_cast<uint8_t>(glm::clamp(val.z, 0.0f, 1.0f) * 255.0f));
+					std::byte a = static_cast<std::byte>(static_cast<uint8_t>(glm::clamp(val.w, 0.0f, 1.0f) * 255.0f));
+
+					outputSplatmap.at(i++) = r;
+					outputSplatmap.at(i++) = g;
+					outputSplatmap.at(i++) = b;
+					outputSplatmap.at(i++) = a;
+				}
 			}
-		}
-		glm::vec4 val = glm::normalize(std::get<glm::vec4>(outputNode->GetSplatMapValue(0, 0)));
-
-		//Log::Debug << val.x << " "<< val.y << " "<< val.z << " "<< val.w << " " << "\n";
-
-
+		});
 
 		for (auto&[key, val] : nodeMap) {
 			val.CleanNoise();
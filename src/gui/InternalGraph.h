@@ -10,6 +10,8 @@
 
 #include "../resources/Texture.h"
 
+#include "../core/JobSystem.h"
+
 #include <glm/glm.hpp>
 
 namespace InternalGraph {
@@ -245,7 +247,10 @@ namespace InternalGraph {
 
 	class GraphUser {
 	public:
-		GraphUser(const GraphPrototype& graph, int seed, int cellsWide, glm::i32vec2 pos, float scale);
+		//Evaluation stops early if cancelToken is cancelled, leaving the maps incomplete
+		GraphUser(const GraphPrototype& graph, job::TaskManager& taskManager,
+			int seed, int cellsWide, glm::i32vec2 pos, float scale,
+			job::CancellationToken cancelToken = {});
 
 		const float SampleHeightMap(const float x, const float z) const;
 		NoiseImage2D<float>& GetHeightMap();
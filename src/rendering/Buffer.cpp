@@ -331,14 +331,19 @@ VulkanBufferStagingVertex::VulkanBufferStagingVertex(VulkanDevice& device, uint3
 //
 //}
 
-VulkanBufferIndex::VulkanBufferIndex(VulkanDevice& device, uint32_t count) :
+static VkDeviceSize IndexTypeSize(VkIndexType indexType) {
+	return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+VulkanBufferIndex::VulkanBufferIndex(VulkanDevice& device, uint32_t count, VkIndexType indexType) :
 	VulkanBuffer(device, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		sizeof(int) * count, (VkBufferUsageFlags)(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT),
-		VMA_MEMORY_USAGE_GPU_ONLY) {}
+		IndexTypeSize(indexType) * count, (VkBufferUsageFlags)(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+		VMA_MEMORY_USAGE_GPU_ONLY),
+	indexType(indexType) {}
 
 void VulkanBufferIndex::BindIndexBuffer(VkCommandBuffer cmdBuf) {
 	VkDeviceSize offsets[] = { 0 };
-	vkCmdBindIndexBuffer(cmdBuf, buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindIndexBuffer(cmdBuf, buffer.buffer, 0, indexType);
 }
 
 //void VulkanBufferIndex::CreateIndexBuffer(uint32_t count) {
@@ -349,9 +354,9 @@ void VulkanBufferIndex::BindIndexBuffer(VkCommandBuffer cmdBuf) {
 //	//device->CreateMeshBufferIndex(buffer, sizeof(int) * count);
 //}
 
-VulkanBufferStagingIndex::VulkanBufferStagingIndex(VulkanDevice& device, uint32_t count, void* pData) :
+VulkanBufferStagingIndex::VulkanBufferStagingIndex(VulkanDevice& device, uint32_t count, void* pData, VkIndexType indexType) :
 	VulkanBuffer(device, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		sizeof(int) * count, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		IndexTypeSize(indexType) * count, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 		VMA_MEMORY_USAGE_CPU_ONLY, VMA_ALLOCATION_CREATE_MAPPED_BIT, pData)
 {}
 
@@ -148,16 +148,18 @@ public:
 
 class VulkanBufferIndex : public VulkanBuffer {
 public:
-	VulkanBufferIndex(VulkanDevice& device, uint32_t count);
+	VulkanBufferIndex(VulkanDevice& device, uint32_t count, VkIndexType indexType = VK_INDEX_TYPE_UINT32);
 	void BindIndexBuffer(VkCommandBuffer cmdBuf);
 
+	VkIndexType indexType;
+
 	//void CreateIndexBuffer(uint32_t count);
 	//void CreateStagingIndexBuffer(void* pData, uint32_t count);
 };
 
 class VulkanBufferStagingIndex : public VulkanBuffer {
 public:
-	VulkanBufferStagingIndex(VulkanDevice& device, uint32_t count, void* pData);
+	VulkanBufferStagingIndex(VulkanDevice& device, uint32_t count, void* pData, VkIndexType indexType = VK_INDEX_TYPE_UINT32);
 
 };
 
@@ -1,5 +1,6 @@
 #include "Renderer.h"
 
+#include <algorithm>
 #include <fstream>
 
 #include "Initializers.h"
@@ -63,7 +64,7 @@ void RenderSettings::Save() {
 }
 
 VulkanRenderer::VulkanRenderer(bool validationLayer,
-	Window& window, Resource::ResourceManager& resourceMan)
+	Window& window, Resource::ResourceManager& resourceMan, job::TaskManager& taskManager)
 
 	:settings("render_settings.json"),
 	device(validationLayer, window),
@@ -72,19 +73,13 @@ VulkanRenderer::VulkanRenderer(bool validationLayer,
 	pipelineManager(device),
 	textureManager(*this, resourceMan.texManager),
 	graphicsPrimaryCommandPool(device,
-		VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, &device.GraphicsQueue())
-
+		VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, &device.GraphicsQueue()),
+	taskManager(taskManager)
 {
 	for (int i = 0; i < vulkanSwapChain.swapChainImages.size(); i++) {
 		frameObjects.push_back(std::make_unique<FrameObject>(device, i));
 	}
 
-	for (int i = 0; i < workerThreadCount; i++) {
-		graphicsWorkers.push_back(
-			std::make_unique < GraphicsCommandWorker>(
-				device, workQueue, finishQueue, finishQueueLock));
-	}
-
 	CreateRenderPass();
 
 	CreateDepthResources();
@@ -101,20 +96,21 @@ VulkanRenderer::~VulkanRenderer() {
 	vkDestroyPipelineLayout(device.device, frameDataDescriptorLayout, nullptr);
 	vkDestroyPipelineLayout(device.device, lightingDescriptorLayout, nullptr);
 
-	for (auto& worker : graphicsWorkers)
-		worker->StopWork();
-	workQueue.notify_all();
-	for (auto& worker : graphicsWorkers) {
-		while (!worker->IsFinishedWorking()) {}
+	//queued work still references this, help it finish
+	while (graphicsTasksInFlight.load() > 0) {
+		if (!taskManager.RunTask(false))
+			std::this_thread::yield();
 	}
 	{
 		std::lock_guard<std::mutex>lk(finishQueueLock);
-		for (auto& work : finishQueue) {
-			work.fence->WaitTillTrue();
-			work.pool->FreeCommandBuffer(work.cmdBuf);
+		for (auto work : finishQueue) {
+			work->fence->WaitTillTrue();
+			work->pool->FreeCommandBuffer(work->cmdBuf);
+			cleanUpWorkPool.deallocate(work);
 		}
+		finishQueue.clear();
 	}
-	graphicsWorkers.clear();
+	commandPools.clear();
 
 	if (settings.memory_dump)
 		device.LogMemory();
@@ -150,23 +146,21 @@ void VulkanRenderer::RenderFrame() {
 
 	SaveScreenshot();
 
-	std::vector<GraphicsCleanUpWork> nextFramesWork;
 	{
+		//unfinished work is compacted to the front in place, so the queue keeps its capacity
 		std::lock_guard<std::mutex>lk(finishQueueLock);
-		for (auto& work : finishQueue) {
-			if (work.fence->Check()) {
-				for (auto& sig : work.signals) {
-					if (sig != nullptr)
-						*sig = true;
-				}
-				work.pool->FreeCommandBuffer(work.cmdBuf);
-			}
-			else {
-				nextFramesWork.push_back(std::move(work));
+		auto unfinished = std::remove_if(finishQueue.begin(), finishQueue.end(), [this](GraphicsCleanUpWork* work) {
+			if (!work->fence->Check())
+				return false;
+			for (auto& sig : work->signals) {
+				if (sig != nullptr)
+					*sig = true;
 			}
-		}
-		finishQueue.clear();
-		finishQueue = std::move(nextFramesWork);
+			work->pool->FreeCommandBuffer(work->cmdBuf);
+			cleanUpWorkPool.deallocate(work);
+			return true;
+		});
+		finishQueue.erase(unfinished, finishQueue.end());
 	}
 }
 
@@ -338,6 +332,9 @@ void VulkanRenderer::PrepareFrame(int curFrameIndex) {
 	}
 
 	frameObjects.at(curFrameIndex)->PrepareFrame();
+
+	//the frame's fence has signalled, so nothing from its scratch memory is in use anymore
+	frameAllocator.begin_frame(curFrameIndex);
 }
 
 void VulkanRenderer::SubmitFrame(int curFrameIndex) {
@@ -506,12 +503,65 @@ void VulkanRenderer::SubmitWork(WorkType workType,
 	std::vector<std::shared_ptr<VulkanBuffer>> buffersToClean,
 	std::vector<Signal> signals)
 {
-	workQueue.push_back(GraphicsWork(work, workType,
+	GraphicsWork* graphicsWork = graphicsWorkPool.allocate(work, workType,
 		device,
 		waitSemaphores,
 		signalSemaphores,
 		buffersToClean,
-		signals));
+		signals);
+
+	//only full when the workers are far behind, so help them out till there is room
+	while (!workQueue.push(graphicsWork)) {
+		if (!taskManager.RunTask(false))
+			std::this_thread::yield();
+	}
+
+	graphicsTasksInFlight++;
+	job::Task task(job::TaskType::currentFrame);
+	task.Add(job::Job([this] { RunGraphicsWork(); }));
+	taskManager.AddTask(std::move(task));
+}
+
+//Work tends to be submitted in bursts, so drain everything queued with one set of command pools.
+//Every piece of work has its own task, the ones that find the queue already drained just return
+void VulkanRenderer::RunGraphicsWork() {
+	GraphicsCommandPools* pools = nullptr;
+	while (auto pos_work = workQueue.pop_if()) {
+		GraphicsWork* work = *pos_work;
+		if (pools == nullptr)
+			pools = AcquireCommandPools();
+		CommandPool* pool = &pools->Get(work->type);
+
+		VkCommandBuffer cmdBuf = pool->GetOneTimeUseCommandBuffer();
+		work->work(cmdBuf);
+		pool->SubmitCommandBuffer(cmdBuf, *work->fence,
+			work->waitSemaphores, work->signalSemaphores);
+
+		GraphicsCleanUpWork* cleanUp = cleanUpWorkPool.allocate(std::move(*work), pool, cmdBuf);
+		graphicsWorkPool.deallocate(work);
+
+		std::lock_guard<std::mutex>lk(finishQueueLock);
+		finishQueue.push_back(cleanUp);
+	}
+	if (pools != nullptr)
+		ReleaseCommandPools(pools);
+	graphicsTasksInFlight--;
+}
+
+GraphicsCommandPools* VulkanRenderer::AcquireCommandPools() {
+	std::lock_guard<std::mutex> lk(commandPoolsLock);
+	if (freeCommandPools.empty()) {
+		commandPools.push_back(std::make_unique<GraphicsCommandPools>(device));
+		return commandPools.back().get();
+	}
+	GraphicsCommandPools* pools = freeCommandPools.back();
+	freeCommandPools.pop_back();
+	return pools;
+}
+
+void VulkanRenderer::ReleaseCommandPools(GraphicsCommandPools* pools) {
+	std::lock_guard<std::mutex> lk(commandPoolsLock);
+	freeCommandPools.push_back(pools);
 }
 
 
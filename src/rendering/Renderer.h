@@ -12,7 +12,11 @@
 #include <vulkan/vulkan.h>
 
 #include "../core/CoreTools.h"
+#include "../core/JobSystem.h"
 #include "../util/ConcurrentQueue.h"
+#include "../util/RingBuffer.h"
+#include "../util/MemoryPool.h"
+#include "../util/FrameAllocator.h"
 
 #include "RenderTools.h"
 #include "RenderStructs.h"
@@ -50,11 +54,14 @@ private:
 	std::string fileName;
 };
 
+constexpr size_t FrameScratchSize = 256 * 1024; //starting size, grows if a frame needs more
+constexpr int FrameScratchCount = 3;
+
 class VulkanRenderer
 {
 public:
 	VulkanRenderer(bool enableValidationLayer,
-		Window& window, Resource::ResourceManager& resourceMan);
+		Window& window, Resource::ResourceManager& resourceMan, job::TaskManager& taskManager);
 
 	VulkanRenderer(const VulkanRenderer& other) = delete; //copy
 	VulkanRenderer(VulkanRenderer&& other) = delete; //move
@@ -122,6 +129,9 @@ public:
 	VulkanPipeline pipelineManager;
 	VulkanTextureManager textureManager;
 
+	//For cpu side temporaries that only live for a frame, like draw offsets and copy regions
+	FrameAllocator frameAllocator{ FrameScratchSize, FrameScratchCount };
+
 	Scene* scene;
 
 private:
@@ -153,12 +163,27 @@ private:
 
 	std::shared_ptr<VulkanTexture> depthBuffer;
 
-	int workerThreadCount = 3;
+	job::TaskManager& taskManager;
+
+	//Work items are made and freed every submission, the pools keep them out of the heap
+	//and let the queues pass pointers around instead of moving the items
+	MemoryPool<GraphicsWork, 256> graphicsWorkPool;
+	MemoryPool<GraphicsCleanUpWork, 256> cleanUpWorkPool;
 
-	ConcurrentQueue<GraphicsWork> workQueue;
-	std::vector<GraphicsCleanUpWork> finishQueue;
+	//Each SubmitWork adds a task which records and submits one item off the queue
+	RingBuffer<GraphicsWork*> workQueue{ 1024 };
+	std::atomic_int graphicsTasksInFlight = 0;
+	std::vector<GraphicsCleanUpWork*> finishQueue;
 	std::mutex finishQueueLock;
-	std::vector < std::unique_ptr<GraphicsCommandWorker>> graphicsWorkers;
+
+	void RunGraphicsWork();
+
+	//sets of command pools not being recorded into, created as more jobs record at once
+	GraphicsCommandPools* AcquireCommandPools();
+	void ReleaseCommandPools(GraphicsCommandPools* pools);
+	std::mutex commandPoolsLock;
+	std::vector<std::unique_ptr<GraphicsCommandPools>> commandPools;
+	std::vector<GraphicsCommandPools*> freeCommandPools;
 
 	//CommandBufferWorkQueue<CommandBufferWork> graphicsSetupWorkQueue;
 
@@ -294,77 +294,24 @@ void CommandPool::WriteToBuffer(VkCommandBuffer buf, std::function<void(VkComman
 	cmds(buf);
 }
 
-GraphicsCommandWorker::GraphicsCommandWorker(
-	VulkanDevice &device,
-	ConcurrentQueue<GraphicsWork>& workQueue,
-	std::vector<GraphicsCleanUpWork>& finishQueue,
-	std::mutex& finishQueueLock,
-	bool startActive) :
-
-	device(device),
+GraphicsCommandPools::GraphicsCommandPools(VulkanDevice &device) :
 	graphicsPool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, &device.GraphicsQueue()),
 	transferPool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, &device.TransferQueue()),
-	computePool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, &device.ComputeQueue()),
-	workQueue(workQueue), finishQueue(finishQueue), finishQueueLock(finishQueueLock)
+	computePool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, &device.ComputeQueue())
 {
-	workingThread = std::thread{ &GraphicsCommandWorker::Work, this };
-
-}
-
-GraphicsCommandWorker::~GraphicsCommandWorker() {
-	StopWork();
-	workingThread.join();
-}
-
-void GraphicsCommandWorker::StopWork() {
-	keepWorking = false;
-}
 
-bool GraphicsCommandWorker::IsFinishedWorking() {
-	return isDoneWorking;
 }
 
-void GraphicsCommandWorker::Work() {
-	while (keepWorking)
-	{
-
-		workQueue.wait_on_value();
-
-		while (!workQueue.empty()) {
-			auto pos_work = workQueue.pop_if();
-			if (pos_work.has_value()) {
-
-
-				VkCommandBuffer cmdBuf;
-				CommandPool* pool;
-
-				switch (pos_work->type) {
-				case(WorkType::graphics):
-					pool = &graphicsPool;
-					break;
-				case(WorkType::transfer):
-					pool = &transferPool;
-					break;
-				case(WorkType::compute):
-					pool = &computePool;
-					break;
-				}
-
-				cmdBuf = pool->GetOneTimeUseCommandBuffer();
-				//pool->BeginBufferRecording(cmdBuf);
-				pos_work->work(cmdBuf);
-				//pool->EndBufferRecording(cmdBuf);
-				pool->SubmitCommandBuffer(cmdBuf, *pos_work->fence,
-					pos_work->waitSemaphores, pos_work->signalSemaphores);
-
-				{
-					std::lock_guard<std::mutex>lk(finishQueueLock);
-					finishQueue.push_back(GraphicsCleanUpWork(*pos_work, pool, cmdBuf));
-				}
-			}
-		}
+CommandPool& GraphicsCommandPools::Get(WorkType type) {
+	switch (type) {
+	case(WorkType::transfer):
+		return transferPool;
+	case(WorkType::compute):
+		return computePool;
+	case(WorkType::graphics):
+	default:
+		return graphicsPool;
 	}
-	isDoneWorking = true;
 }
 
 
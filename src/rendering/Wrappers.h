@@ -184,16 +184,17 @@ struct GraphicsCleanUpWork {
 	std::vector<std::shared_ptr<VulkanBuffer>> buffers;
 	std::vector<Signal> signals;
 
-	explicit GraphicsCleanUpWork(GraphicsWork& work, 
+	//takes over the work's fence, semaphores, buffers and signals instead of copying them
+	explicit GraphicsCleanUpWork(GraphicsWork&& work, 
 		CommandPool* pool,
 		VkCommandBuffer cmdBuf) :
 		pool(pool),
 		cmdBuf(cmdBuf),
-		fence(work.fence),
-		buffers(work.buffersToClean),
-		signals(work.signals),
-		waitSemaphores(work.waitSemaphores),
-		signalSemaphores(work.signalSemaphores)
+		fence(std::move(work.fence)),
+		buffers(std::move(work.buffersToClean)),
+		signals(std::move(work.signals)),
+		waitSemaphores(std::move(work.waitSemaphores)),
+		signalSemaphores(std::move(work.signalSemaphores))
 	{}
 
 	explicit GraphicsCleanUpWork(std::shared_ptr<VulkanFence>& fence,
@@ -219,40 +220,21 @@ struct GraphicsCleanUpWork {
 	GraphicsCleanUpWork& operator=(GraphicsCleanUpWork&& work) = default;
 };
 
-class GraphicsCommandWorker {
+//One command pool per queue type. Recording needs the pool to itself, so each
+//job recording graphics work checks out a whole set for the duration.
+class GraphicsCommandPools {
 public:
-	GraphicsCommandWorker(VulkanDevice& device,
-		ConcurrentQueue<GraphicsWork>& workQueue,
-		std::vector<GraphicsCleanUpWork>& finishQueue,
-		std::mutex& finishQueueLock,
-		bool startActive = true);
+	GraphicsCommandPools(VulkanDevice& device);
 
-	GraphicsCommandWorker(const GraphicsCommandWorker& other) = delete; //copy
-	GraphicsCommandWorker(GraphicsCommandWorker&& other) = delete; //move
-	GraphicsCommandWorker& operator=(const GraphicsCommandWorker&) = default;
-	GraphicsCommandWorker& operator=(GraphicsCommandWorker&&) = default;
+	GraphicsCommandPools(const GraphicsCommandPools& other) = delete; //copy
+	GraphicsCommandPools(GraphicsCommandPools&& other) = delete; //move
 
-	~GraphicsCommandWorker();
-
-	void StopWork();
-
-	bool IsFinishedWorking();
+	CommandPool& Get(WorkType type);
 
 private:
-	VulkanDevice & device;
-	void Work();
-	std::thread workingThread;
-
-	std::atomic_bool keepWorking = true; //default to start working
-	ConcurrentQueue<GraphicsWork>& workQueue;
-	std::mutex& finishQueueLock;
-	std::vector<GraphicsCleanUpWork>& finishQueue;
-	std::atomic_bool isDoneWorking = false;
-
 	CommandPool graphicsPool;
 	CommandPool transferPool;
 	CommandPool computePool;
-
 };
 
 
@@ -55,7 +55,7 @@ namespace Resource::Texture {
 
 	nlohmann::json TexResource::to_json() const {
 		nlohmann::json j;
-		j["id"] = id;
+		j["id"] = id.index;
 		switch (layout) {
 		case (LayoutType::single1D):
 			j["layout"] = "single1D";
@@ -111,11 +111,10 @@ namespace Resource::Texture {
 		return j;
 	}
 
+	//ids aren't read back, the manager hands out a new handle to each resource it loads
 	// std::tuple<TexID,std::string, LayoutType,
 	//		ChannelType, FormatType,DataDescription>
 	TexResource from_json_TexResource(nlohmann::json j) {
-		int id = j["id"];
-
 		LayoutType layout;
 		if (j["layout"] == "single1D")
 			layout = LayoutType::single1D;
@@ -154,7 +153,7 @@ namespace Resource::Texture {
 		uint32_t layers = j["dataDescription"]["layers"];
 		DataDescription dataDesc(channels, width, height, depth, layers);
 
-		return TexResource(id, name, layout, channelType, format, dataDesc);
+		return TexResource(TexID{}, name, layout, channelType, format, dataDesc);
 
 		// return std::tuple<TexID, std::string, LayoutType,
 		//	ChannelType, FormatType,DataDescription>(id, fileName, layout, channel,
@@ -230,8 +229,6 @@ namespace Resource::Texture {
 
 	Manager::~Manager() {}
 
-	TexID Manager::GetNextFreeTexID() { return id_counter++; }
-
 	void Manager::LoadTextureList() {
 		nlohmann::json j;
 
@@ -253,14 +250,17 @@ namespace Resource::Texture {
 
 		try {
 			int count = j["num_texs"];
+			textureResources.reserve(count);
 			for (int i = 0; i < count; i++) {
-				textureResources[i] = from_json_TexResource(j[std::to_string(i)]);
-				LoadTextureFromFile(i);
+				TexID id = textureResources.insert(from_json_TexResource(j[std::to_string(i)]));
+				auto& texRes = textureResources.at(id);
+				texRes.id = id;
+				textureNames[texRes.name] = id;
+				LoadTextureFromFile(id);
 			}
-			id_counter = count;
 			Log::Debug << textureResources.size() << " textures loaded\n";
-			for (auto const&[key, val] : textureResources) {
-				Log::Debug << "Tex " << key << " with name " << val.name
+			for (auto const& val : textureResources) {
+				Log::Debug << "Tex " << val.id.index << " with name " << val.name
 					<< " dimensions width " << val.dataDescription.width
 					<< " height " << val.dataDescription.height << "\n";
 			}
@@ -273,8 +273,9 @@ namespace Resource::Texture {
 	void Manager::SaveTextureList() {
 		nlohmann::json j;
 		j["num_texs"] = textureResources.size();
-		for (auto const &[key, val] : textureResources) {
-			j[key] = val.to_json();
+		int i = 0;
+		for (auto const& val : textureResources) {
+			j[std::to_string(i++)] = val.to_json();
 		}
 		std::ofstream outFile("assets/TextureList.json");
 		try {
@@ -352,7 +353,7 @@ namespace Resource::Texture {
 	// }
 
 	TexID CreateNewTextureFromByteArray(int width, int height, std::byte *data) {
-		return 0;
+		return TexID{};
 	}
 
 	TexResource Manager::GetTexResourceByID(TexID id) {
@@ -362,10 +363,9 @@ namespace Resource::Texture {
 
 	TexID Manager::GetTexIDByName(std::string s) {
 		std::lock_guard<std::mutex> lk(lock);
-		for (auto const &[key, val] : textureResources) {
-			if (val.name == s)
-				return key;
-		}
+		auto found = textureNames.find(s);
+		if (found != textureNames.end())
+			return found->second;
 		throw std::runtime_error("No matching texture found with name " + s);
 	}
 
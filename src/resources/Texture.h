@@ -18,9 +18,12 @@
 
 #include <json.hpp>
 
+#include "../util/SlotMap.h"
+
 namespace Resource::Texture {
 
-using TexID = int;
+class TexResource;
+using TexID = SlotHandle<TexResource>;
 
 struct Pixel_R {
 	std::byte red;
@@ -191,12 +194,10 @@ public:
 	void LoadTextureList();
 	void SaveTextureList();
 
-	TexID GetNextFreeTexID();
-
 	void LoadTextureFromFile(TexID id); 
 
 	TexID GetTexIDByName(std::string s);
-	TexResource GetTexResourceByID(int id);
+	TexResource GetTexResourceByID(TexID id);
 	
 	// std::shared_ptr<Texture> loadTextureFromFileRGBA(std::string filename);
 	// std::shared_ptr<Texture> loadTextureFromFileGreyOnly(std::string filename);
@@ -209,10 +210,9 @@ public:
 	// std::shared_ptr<CubeMap> loadCubeMapFromFile(std::string filename, std::string fileExt);
 
 private:
-	std::atomic_int id_counter = 0;
-
 	std::mutex lock;
-	std::unordered_map<TexID, TexResource> textureResources;
+	SlotMap<TexResource> textureResources;
+	std::unordered_map<std::string, TexID> textureNames;
 	std::vector<std::unique_ptr<TexData>> textureData;
 
 	// std::vector<std::shared_ptr<Texture>> textureHandles;
@@ -10,7 +10,7 @@
 
 
 InstancedSceneObject::InstancedSceneObject(VulkanRenderer& renderer, int maxInstances)
-	: renderer(renderer), maxInstanceCount(maxInstances), instanceCount(0), instancesData(maxInstances)
+	: renderer(renderer), maxInstanceCount(maxInstances), instances(maxInstances)
 {
 	isFinishedTransfer = std::make_shared<bool>(false);
 }
@@ -208,7 +208,7 @@ void InstancedSceneObject::UploadInstances() {
 	if (isDirty) {
 
 
-		size_t instanceBufferSize = instancesData.size() * sizeof(InstanceData);
+		size_t instanceBufferSize = instances.size() * sizeof(InstanceData);
 		/*
 
 		VulkanBufferInstance stagingBuffer(renderer.device);
@@ -254,19 +254,19 @@ void InstancedSceneObject::UploadInstances() {
 }
 
 
-void InstancedSceneObject::AddInstance(InstanceData data) {
+InstancedSceneObject::InstanceHandle InstancedSceneObject::AddInstance(InstanceData data) {
 
 	//Log::Debug << "Adding instance at " << data.pos.x << " " << data.pos.z << "\n";
 
 	std::lock_guard<std::mutex> lk(instanceDataLock);
-	if (instanceCount < maxInstanceCount) {
-		instancesData.at(instanceCount) = data;
-		instanceCount++;
-	}
+	if (instances.size() >= maxInstanceCount)
+		return InstanceHandle{};
+
 	isDirty = true;
+	return instances.insert(data);
 }
 
-void InstancedSceneObject::AddInstances(std::vector<InstanceData>& newInstances) {
+std::vector<InstancedSceneObject::InstanceHandle> InstancedSceneObject::AddInstances(std::vector<InstanceData>& newInstances) {
 	//for (auto it = positions.begin(); it != positions.end(); it++) {
 	//	ModelBufferObject ubo = {};
 	//	ubo.model = glm::translate(ubo.model, *it);
@@ -278,81 +278,49 @@ void InstancedSceneObject::AddInstances(std::vector<InstanceData>& newInstances)
 	//modelUniformsBuffer.copyTo(&modelUniforms, modelUniforms.size() * sizeof(ModelBufferObject));
 	//modelUniformsBuffer.unmap();
 
-	/*for (int i = 0; i < positions.size(); i++)
-	{
-		InstanceData id;
-		id.pos = positions[i];
-		id.rot = glm::vec3(0,0,0);
-		id.scale = 1.0f;
-		instancesData.push_back(id);
-	}*/
 	//for (auto& val : newInstances)
 	//	Log::Debug << "Adding instance at " << val.pos.x << " " << val.pos.z << "\n";
 
+	std::vector<InstanceHandle> handles;
+	handles.reserve(newInstances.size());
+
 	std::lock_guard<std::mutex> lk(instanceDataLock);
-	int curFree = instanceCount;
-	for (int i = 0; i < newInstances.size(); i++) {
-		if (instanceCount < maxInstanceCount) {
-			instancesData.at(i + curFree) = newInstances.at(i);
-		}
+	for (auto& instance : newInstances) {
+		if (instances.size() < maxInstanceCount)
+			handles.push_back(instances.insert(instance));
+		else
+			handles.push_back(InstanceHandle{});
 	}
-	instanceCount += newInstances.size();
 	isDirty = true;
+	return handles;
 }
 
-void InstancedSceneObject::RemoveInstance(InstanceData instance) {
-
-
-	//Log::Debug << "Removing instance at " << instance.pos.x << " " << instance.pos.z << "\n";
+void InstancedSceneObject::RemoveInstance(InstanceHandle instance) {
 
 	std::lock_guard<std::mutex> lk(instanceDataLock);
-	auto foundInstance = std::find(std::begin(instancesData), std::end(instancesData), instance);
-	if (foundInstance != std::end(instancesData)) {
-		instancesData.erase(foundInstance);
-		instanceCount--;
-	}
-	isDirty = true;
+	if (instances.erase(instance))
+		isDirty = true;
 }
 
-void InstancedSceneObject::RemoveInstances(std::vector<InstanceData>& instances) {
-
-	//for (auto& val : instances)
-	//	Log::Debug << "Removing instance at " << val.pos.x << " " << val.pos.z << "\n";
+void InstancedSceneObject::RemoveInstances(std::vector<InstanceHandle>& handles) {
 
 	std::lock_guard<std::mutex> lk(instanceDataLock);
-	std::vector<std::vector<InstanceData>::iterator> indexesToDelete(instances.size());
-
-	for (auto& instance : instances) {
-
-		auto foundInstance = std::find(std::begin(instancesData), std::end(instancesData), instance);
-		if (foundInstance != std::end(instancesData)) {
-			indexesToDelete.push_back(foundInstance);
-			instanceCount--;
-		}
-	}
-	for (auto& index : indexesToDelete) {
-		instancesData.erase(index);
-	}
+	for (auto& instance : handles)
+		instances.erase(instance);
 	isDirty = true;
 }
 
-void InstancedSceneObject::ReplaceAllInstances(std::vector<InstanceData>& instances) {
-	std::lock_guard<std::mutex> lk(instanceDataLock);
-	instancesData.clear();
-	instanceCount = 0;
-
-	if (instances.size() > 0) {
-		for (auto& instance : instances)
-			instancesData.push_back(instance);
-
+std::vector<InstancedSceneObject::InstanceHandle> InstancedSceneObject::ReplaceAllInstances(std::vector<InstanceData>& newInstances) {
+	{
+		std::lock_guard<std::mutex> lk(instanceDataLock);
+		instances.clear();
 	}
-	isDirty = true;
+	return AddInstances(newInstances);
 }
 
 void InstancedSceneObject::RemoveAllInstances() {
 	std::lock_guard<std::mutex> lk(instanceDataLock);
-	instancesData.clear();
-	instanceCount = 0;
+	instances.clear();
 	isDirty = true;
 }
 
@@ -367,7 +335,11 @@ void InstancedSceneObject::UploadData()
 	//}
 
 	//instanceBuffer->map(renderer.device.device);
-	instanceBuffer->CopyToBuffer(instancesData.data(), instancesData.size() * instanceMemberSize);
+	{
+		std::lock_guard<std::mutex> lk(instanceDataLock);
+		instanceBuffer->CopyToBuffer(instances.data(), instances.size() * sizeof(InstanceData));
+		drawInstanceCount = static_cast<uint32_t>(instances.size());
+	}
 
 	//instanceBuffer->unmap();
 
@@ -398,7 +370,7 @@ void InstancedSceneObject::WriteToCommandBuffer(VkCommandBuffer commandBuffer, b
 	//vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer->buffer.buffer, offsets);
 	//vkCmdBindIndexBuffer(commandBuffer, vulkanModel->vmaIndicies.buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
 
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(vulkanModel->indexCount), instanceCount, 0, 0, 0);
+	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(vulkanModel->indexCount), drawInstanceCount, 0, 0, 0);
 
 }
 
@@ -14,6 +14,7 @@
 #include "../resources/Texture.h"
 
 #include "../util/DoubleBuffer.h"
+#include "../util/SlotMap.h"
 
 class InstancedSceneObject
 {
@@ -41,6 +42,8 @@ public:
 		}
 	};
 
+	using InstanceHandle = SlotHandle<InstanceData>;
+
 	InstancedSceneObject(VulkanRenderer& renderer, int maxInstances = 16384);
 	~InstancedSceneObject();
 
@@ -62,16 +65,17 @@ public:
 
 	void SetupDescriptor();
 
-	void AddInstance(InstanceData data);
-	void RemoveInstance(InstanceData data);
+	//returns an invalid handle if there is no room left for the instance
+	InstanceHandle AddInstance(InstanceData data);
+	void RemoveInstance(InstanceHandle instance);
 
-	void AddInstances(std::vector<InstanceData>& instances);
-	void RemoveInstances(std::vector<InstanceData>& instances);
+	std::vector<InstanceHandle> AddInstances(std::vector<InstanceData>& instances);
+	void RemoveInstances(std::vector<InstanceHandle>& instances);
 
 	void RemoveAllInstances();
 
 	//Resets all current instances and puts new ones in its place
-	void ReplaceAllInstances(std::vector<InstanceData>& instances);
+	std::vector<InstanceHandle> ReplaceAllInstances(std::vector<InstanceData>& instances);
 
 	void UploadInstances();
 
@@ -96,9 +100,9 @@ private:
 	std::shared_ptr<VulkanBufferUniform> uniformBuffer;
 
 	std::mutex instanceDataLock;
-	int instanceCount = 0;
 	int maxInstanceCount = 16384;
-	std::vector<InstanceData> instancesData;
+	SlotMap<InstanceData> instances; //kept packed so it can be copied straight into instanceBuffer
+	uint32_t drawInstanceCount = 0; //how many instances were last uploaded
 	std::shared_ptr<VulkanBufferInstancePersistant> instanceBuffer;
 
 	bool isDirty = false;
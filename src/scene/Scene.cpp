@@ -13,8 +13,9 @@
 Scene::Scene(Resource::ResourceManager& resourceMan,
 	VulkanRenderer& renderer,
 	TimeManager& timeManager,
+	job::TaskManager& taskManager,
 	InternalGraph::GraphPrototype& graph) :
-	renderer(renderer), resourceMan(resourceMan), timeManager(timeManager)
+	renderer(renderer), resourceMan(resourceMan), timeManager(timeManager), taskManager(taskManager)
 {
 
 	camera = std::make_unique< Camera>(glm::vec3(0, 1, -5), glm::vec3(0, 1, 0), 0, 90);
@@ -96,7 +97,7 @@ Scene::Scene(Resource::ResourceManager& resourceMan,
 	//std::shared_ptr<GameObject> pbr_test = std::make_shared<GameObject>(renderer);
 	//pbr_test->usePBR = true;
 
-	terrainManager = std::make_unique<TerrainManager>(graph, resourceMan, renderer);
+	terrainManager = std::make_unique<TerrainManager>(graph, resourceMan, renderer, taskManager);
 
 	//terrainManager->SetupResources(resourceMan, renderer);
 	//terrainManager->GenerateTerrain(resourceMan, renderer, camera);
@@ -200,7 +201,7 @@ void Scene::UpdateScene() {
 	}
 
 	if (UpdateTerrain && terrainManager != nullptr)
-		terrainManager->UpdateTerrains(camera->Position);
+		terrainManager->UpdateTerrains(camera->Position, camera->Front);
 
 
 
@@ -300,10 +301,11 @@ void Scene::UpdateSceneGUI() {
 		ImGui::DragFloat3("Rotation", ((float*)glm::value_ptr(testInstanceData.rot)));
 		ImGui::DragFloat("Scale", &testInstanceData.scale);
 		if (ImGui::Button("Add instance")) {
-			treesInstanced->AddInstance(testInstanceData);
+			testInstances.push_back(treesInstanced->AddInstance(testInstanceData));
 		}
-		if (ImGui::Button("Remove Instance")) {
-			treesInstanced->RemoveInstance(testInstanceData);
+		if (ImGui::Button("Remove Instance") && testInstances.size() > 0) {
+			treesInstanced->RemoveInstance(testInstances.back());
+			testInstances.pop_back();
 		}
 	}
 	ImGui::End();
@@ -7,6 +7,7 @@
 #include "../resources/ResourceManager.h"
 
 #include "../core/TimeManager.h"
+#include "../core/JobSystem.h"
 
 #include "Camera.h"
 #include "Terrain.h"
@@ -34,7 +35,7 @@ class Scene
 {
 public:
 	Scene(Resource::ResourceManager& resourceMan, VulkanRenderer& renderer,
-		TimeManager& timeManager, InternalGraph::GraphPrototype& graph);
+		TimeManager& timeManager, job::TaskManager& taskManager, InternalGraph::GraphPrototype& graph);
 	~Scene();
 
 	void UpdateScene();
@@ -51,6 +52,7 @@ private:
 	VulkanRenderer & renderer;
 	Resource::ResourceManager& resourceMan;
 	TimeManager& timeManager;
+	job::TaskManager& taskManager;
 
 	std::vector<DirectionalLight> directionalLights;
 	std::vector<PointLight> pointLights;
@@ -80,5 +82,6 @@ private:
 
 	PBR_Material testMat;
 	InstancedSceneObject::InstanceData testInstanceData;
+	std::vector<InstancedSceneObject::InstanceHandle> testInstances; //added by the instance tester, newest last
 };
 
@@ -7,8 +7,7 @@
 
 #include "TerrainManager.h"
 
-TerrainQuad::TerrainQuad(TerrainChunkBuffer& chunkBuffer,
-	glm::vec2 pos, glm::vec2 size,
+TerrainQuad::TerrainQuad(glm::vec2 pos, glm::vec2 size,
 	glm::i32vec2 logicalPos, glm::i32vec2 logicalSize,
 	int level, glm::i32vec2 subDivPos, float centerHeightValue,
 	Terrain* terrain) :
@@ -17,27 +16,29 @@ TerrainQuad::TerrainQuad(TerrainChunkBuffer& chunkBuffer,
 	logicalPos(logicalPos), logicalSize(logicalSize),
 	subDivPos(subDivPos), isSubdivided(false),
 	level(level), heightValAtCenter(0),
-	terrain(terrain),
-	chunkBuffer(chunkBuffer)
+	terrain(terrain)
 {
 
 }
 
-TerrainQuad::~TerrainQuad() {
-	if (index >= 0) //was setup
-		chunkBuffer.Free(index);
-}
-
 void TerrainQuad::Setup() {
-	index = chunkBuffer.Allocate();
+	chunk = terrain->chunkBuffer.Allocate();
+	state = State::waiting_create;
+
+	TryGenerate();
+	//quadSignal = chunkBuffer.GetChunkSignal(chunk);
+}
 
-	vertices = (TerrainMeshVertices*)chunkBuffer.GetDeviceVertexBufferPtr(index);
-	indices = (TerrainMeshIndices*)chunkBuffer.GetDeviceIndexBufferPtr(index);
+bool TerrainQuad::TryGenerate() {
+	TerrainChunkVertices* vertices = terrain->chunkBuffer.BeginChunkWrite(chunk);
+	if (vertices == nullptr)
+		return false;
 
-	GenerateTerrainChunk(std::ref(terrain->fastGraphUser),
-		terrain->heightScale, terrain->coordinateData.size.x);
-	chunkBuffer.SetChunkWritten(index);
-	//quadSignal = chunkBuffer.GetChunkSignal(index);
+	GenerateTerrainChunk(terrain->taskManager, terrain->fastGraphUser,
+		terrain->heightScale, terrain->coordinateData.size.x, *vertices);
+	terrain->chunkBuffer.SetChunkWritten(chunk);
+	state = State::ready;
+	return true;
 }
 
 float TerrainQuad::GetUVvalueFromLocalIndex(float i, int numCells, int level, int subDivPos) {
@@ -76,173 +77,60 @@ void RecalculateNormals(int numCells, TerrainMeshVertices* verts, TerrainMeshInd
 	}
 }
 
-void TerrainQuad::GenerateTerrainChunk(InternalGraph::GraphUser& graphUser, float heightScale, float widthScale)
+//Samples the height map once per grid point, neighbouring vertices share samples for their normals
+void TerrainQuad::GenerateTerrainChunk(job::TaskManager& taskManager, InternalGraph::GraphUser& graphUser,
+	float heightScale, float widthScale, TerrainChunkVertices& vertices)
 {
-
-	const int numCells = NumCells;
-
-	float uvUs[numCells + 3];
-	float uvVs[numCells + 3];
-
-	int powLevel = 1 << (level);
-	for (int i = 0; i < numCells + 3; i++)
-	{
-		uvUs[i] = glm::clamp((float)(i - 1) / ((float)(powLevel) * (numCells)) + (float)subDivPos.x / (float)(powLevel), 0.0f, 1.0f);
-		uvVs[i] = glm::clamp((float)(i - 1) / ((float)(powLevel) * (numCells)) + (float)subDivPos.y / (float)(powLevel), 0.0f, 1.0f);
-	}
-
-	float hDiff = uvUs[3] - uvUs[1];
-
-	for (int i = 0; i < numCells + 1; i++)
-	{
-		for (int j = 0; j < numCells + 1; j++)
-		{
-			float uvU = uvUs[(i + 1)];
-			float uvV = uvVs[(j + 1)];
-
-			float uvUminus = uvUs[(i + 1) - 1];
-			float uvUplus = uvUs[(i + 1) + 1];
-			float uvVminus = uvVs[(j + 1) - 1];
-			float uvVplus = uvVs[(j + 1) + 1];
-
-			float outheight = graphUser.SampleHeightMap(uvU, uvV);
-			float outheightum = graphUser.SampleHeightMap(uvUminus, uvV);
-			float outheightup = graphUser.SampleHeightMap(uvUplus, uvV);
-			float outheightvm = graphUser.SampleHeightMap(uvU, uvVminus);
-			float outheightvp = graphUser.SampleHeightMap(uvU, uvVplus);
-			
-			glm::vec3 normal = glm::normalize(glm::vec3((outheightvm - outheightvp)/ hDiff,
-				16.0f/*((uvUplus - uvUminus) + (uvVplus - uvVminus)) * 2*/,
-				(outheightum - outheightup))/ hDiff);
-
-			/*float y = graphUser.SampleHeightMap(uvU, uvV);
-			float um = graphUser.SampleHeightMap(uvUminus, uvV);
-			float up = graphUser.SampleHeightMap(uvUplus, uvV);
-			float vm = graphUser.SampleHeightMap(uvU, uvVminus);
-			float vp = graphUser.SampleHeightMap(uvU, uvVplus);
-
-			float midU = (um + up) / 2.0;
-			float midV = (vm + vp) / 2.0;*/
-
-
-			//float outheightum = graphUser.SampleHeightMap(uvU - 0.01, uvV);
-			//float outheightup = graphUser.SampleHeightMap(uvU + 0.01, uvV);
-			//float outheightvm = graphUser.SampleHeightMap(uvU, uvV - 0.01);
-
-  			// deduce terrain normal
-			/*glm::vec3 normal;
-  			normal.x = outheightum - outheightup;
-  			normal.z = outheightvm - outheightvp;
-  			normal.y = hDiff * 2;
-  			normal = glm::normalize(normal);
-*/
-			//float o0 = graphUser.SampleHeightMap(uvUminus,uvVminus);
-			//float o1 = graphUser.SampleHeightMap(uvU, uvVminus);
-			//float o2 = graphUser.SampleHeightMap(uvUplus, uvVminus);
-			//float o3 = graphUser.SampleHeightMap(uvUminus, uvV);
-			//float outheight = graphUser.SampleHeightMap(uvU, uvV);
-			//float o5 = graphUser.SampleHeightMap(uvUplus, uvV);
-			//float o6 = graphUser.SampleHeightMap(uvUminus, uvVplus);
-			//float o7 = graphUser.SampleHeightMap(uvU, uvVplus);
-			//float o8 = graphUser.SampleHeightMap(uvUplus, uvVplus);
-
-			//////float s[9] contains above samples
-			//float scaleX = uvUs[2] - uvUs[1];
-			//float scaleZ = uvVs[2] - uvVs[1];
-			//glm::vec3 normal = glm::vec3(0,1,0);
-			//normal.x = 10 * -(o2-o0+2*(o5-o3)+o8-o6);
-			//normal.z = 10 * -(o6-o0+2*(o7-o1)+o8-o2);
-			//normal.y = 1.0;
-			//normal = glm::normalize(normal);
-
-			(*vertices)[((i)*(numCells + 1) + j)* vertElementCount + 0] = uvU * (widthScale);
-			(*vertices)[((i)*(numCells + 1) + j)* vertElementCount + 1] = outheight * heightScale;
-			(*vertices)[((i)*(numCells + 1) + j)* vertElementCount + 2] = uvV * (widthScale);
-			(*vertices)[((i)*(numCells + 1) + j)* vertElementCount + 3] = normal.x;
-			(*vertices)[((i)*(numCells + 1) + j)* vertElementCount + 4] = normal.y;
-			(*vertices)[((i)*(numCells + 1) + j)* vertElementCount + 5] = normal.z;
-			(*vertices)[((i)*(numCells + 1) + j)* vertElementCount + 6] = uvU;
-			(*vertices)[((i)*(numCells + 1) + j)* vertElementCount + 7] = uvV;
-		}
-	}
-
-	 int counter = 0;
-	 for (int i = 0; i < numCells; i++)
-	 {
-	 	for (int j = 0; j < numCells; j++)
-	 	{
-	 		(*indices)[counter++] = i * (numCells + 1) + j;
-	 		(*indices)[counter++] = i * (numCells + 1) + j + 1;
-	 		(*indices)[counter++] = (i + 1) * (numCells + 1) + j;
-	 		(*indices)[counter++] = i * (numCells + 1) + j + 1;
-	 		(*indices)[counter++] = (i + 1) * (numCells + 1) + j + 1;
-	 		(*indices)[counter++] = (i + 1) * (numCells + 1) + j;
-	 	}
-	 }
-
-	/*int counter = 0;
-	for (int i = 0; i < numCells; i++)
-	{
-		for (int j = 0; j < numCells; j++)
-		{
-			(*indices)[counter++] = i * (numCells + 1) + j;
-			(*indices)[counter++] = i * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j;
-			
-			(*indices)[counter++] = i * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j;
-
-			j++;
-
-			(*indices)[counter++] = i * (numCells + 1) + j;
-			(*indices)[counter++] = i * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j + 1;
-			
-			(*indices)[counter++] = i * (numCells + 1) + j;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j;
-		}
-
-		i++;
-
-		for (int j = 0; j < numCells; j++)
-		{
-			(*indices)[counter++] = i * (numCells + 1) + j;
-			(*indices)[counter++] = i * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j + 1;
-
-			(*indices)[counter++] = i * (numCells + 1) + j;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j;
-		
-			j++;
-
-			(*indices)[counter++] = i * (numCells + 1) + j;
-			(*indices)[counter++] = i * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j;
-
-			(*indices)[counter++] = i * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j + 1;
-			(*indices)[counter++] = (i + 1) * (numCells + 1) + j;
-
-		}
-	}*/
-
-	//RecalculateNormals(numCells, vertices, indices);
+	float uvUs[HeightGridWidth];
+	float uvVs[HeightGridWidth];
+	CalcTerrainGridUVs(level, subDivPos.x, subDivPos.y, uvUs, uvVs);
+
+	InternalGraph::NoiseImage2D<float>& heightMap = graphUser.GetHeightMap();
+	TerrainHeightSource source{ heightMap.GetImageData(), heightMap.GetImageWidth() };
+
+	TerrainHeightGrid heights;
+	taskManager.ParallelFor(0, HeightGridWidth, 0, [&](int rowBegin, int rowEnd) {
+		SampleTerrainHeightGrid(source, uvUs, uvVs, rowBegin, rowEnd, heights);
+	});
+
+	drawData.gridOffset = glm::vec2(subDivPos) * (float)NumCells;
+	drawData.gridSize = (float)((1 << level) * NumCells);
+	drawData.widthScale = widthScale;
+
+#ifdef TERRAIN_COMPACT_VERTICES
+	TerrainHeightRange heightRange = CalcTerrainHeightRange(heights);
+	drawData.heightMin = heightRange.min * heightScale;
+	drawData.heightRange = heightRange.range * heightScale;
+
+	taskManager.ParallelFor(0, NumCells + 1, 0, [&](int rowBegin, int rowEnd) {
+		BuildTerrainCompactVertexRows(heights, uvUs, heightRange, rowBegin, rowEnd, vertices);
+	});
+#else
+	drawData.heightMin = 0.0f;
+	drawData.heightRange = heightScale;
+
+	taskManager.ParallelFor(0, NumCells + 1, 0, [&](int rowBegin, int rowEnd) {
+		BuildTerrainVertexRows(heights, uvUs, uvVs, heightScale, widthScale, rowBegin, rowEnd, vertices);
+	});
+#endif
+
+	//RecalculateNormals(NumCells, vertices, indices);
 }
 
 Terrain::Terrain(VulkanRenderer& renderer,
+	job::TaskManager& taskManager,
 	TerrainChunkBuffer& chunkBuffer,
 	InternalGraph::GraphPrototype& protoGraph,
 	int numCells, int maxLevels, float heightScale,
-	TerrainCoordinateData coords)
+	TerrainCoordinateData coords,
+	job::CancellationToken cancelToken)
 	:
 	renderer(renderer),
+	taskManager(taskManager),
 	chunkBuffer(chunkBuffer),
 	maxLevels(maxLevels), heightScale(heightScale),
 	coordinateData(coords),
-	fastGraphUser(protoGraph, 1337, coords.sourceImageResolution, coords.noisePos, coords.noiseSize.x)
+	fastGraphUser(protoGraph, taskManager, 1337, coords.sourceImageResolution, coords.noisePos, coords.noiseSize.x, cancelToken)
 
 {
 
@@ -256,13 +144,8 @@ Terrain::Terrain(VulkanRenderer& renderer,
 		maxNumQuads = 1 + 16 + 20 + 25 + 50 * maxLevels;
 		//maxNumQuads = (int)((1.0 - glm::pow(4, maxLevels + 1)) / (-3.0)); //legitimate max number of quads (like if everything was subdivided)
 	}
-	//terrainQuads = new MemoryPool<TerrainQuad, 2 * sizeof(TerrainQuad)>();
-	//terrainQuads = pool;
 	//quadHandles.reserve(maxNumQuads);
 
-	//TerrainQuad* test = terrainQuadPool->allocate();
-	//test->init(posX, posY, sizeX, sizeY, 0, meshVertexPool->allocate(), meshIndexPool->allocate());
-
 	// quadHandles.push_back(std::make_unique<TerrainQuad>(
 	// 	coordinateData.pos, coordinateData.size,
 	// 	coordinateData.noisePos, coordinateData.noiseSize,
@@ -286,11 +169,36 @@ Terrain::Terrain(VulkanRenderer& renderer,
 }
 
 Terrain::~Terrain() {
+	for (TerrainQuad& quad : quads) {
+		if (quad.chunk.valid()) //was setup and not freed
+			chunkBuffer.Free(quad.chunk);
+	}
+	quads.clear();
+
 	renderer.pipelineManager.DeleteManagedPipeline(mvp);
 }
 
-int Terrain::FindEmptyIndex() {
-	return curEmptyIndex++; //always gets an index one higher
+TerrainQuadIndex Terrain::AllocateQuadBlock() {
+	if (!freeQuadBlocks.empty()) {
+		TerrainQuadIndex first = freeQuadBlocks.back();
+		freeQuadBlocks.pop_back();
+		return first;
+	}
+	TerrainQuadIndex first = static_cast<TerrainQuadIndex>(quads.size());
+	quads.resize(quads.size() + 4);
+	return first;
+}
+
+//Only the chunks and states are cleared, so the freed quads' sub quad links can still be followed
+//until the block is allocated again
+void Terrain::FreeQuadBlock(TerrainQuadIndex first) {
+	for (TerrainQuadIndex i = first; i < first + 4; i++) {
+		if (quads[i].chunk.valid())
+			chunkBuffer.Free(quads[i].chunk);
+		quads[i].chunk = TerrainChunkHandle();
+		quads[i].state = TerrainQuad::State::free;
+	}
+	freeQuadBlocks.push_back(first);
 }
 
 void Terrain::InitTerrain(glm::vec3 cameraPos,
@@ -306,15 +214,17 @@ void Terrain::InitTerrain(glm::vec3 cameraPos,
 		terrainVulkanTextureArrayMetallic, terrainVulkanTextureArrayNormal);
 	SetupPipeline();
 
-	quadMap.emplace(std::make_pair(FindEmptyIndex(), TerrainQuad{ chunkBuffer,
+	quads.reserve(maxNumQuads + 3);
+	rootQuad = static_cast<TerrainQuadIndex>(quads.size());
+	quads.push_back(TerrainQuad(
 		coordinateData.pos, coordinateData.size,
 		coordinateData.noisePos, coordinateData.noiseSize,
 		0, glm::i32vec2(0, 0),
 		GetHeightAtLocation(TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, 0, 0),
 			TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, 0, 0)),
-		this }));
-	quadMap.at(rootQuad).Setup();
-	InitTerrainQuad(rootQuad, cameraPos);
+		this));
+	quads[rootQuad].Setup();
+	UpdateQuadTree(cameraPos);
 
 	//UpdateMeshBuffer();
 }
@@ -323,7 +233,13 @@ void Terrain::UpdateTerrain(glm::vec3 viewerPos) {
 	SimpleTimer updateTime;
 	updateTime.StartTimer();
 
-	bool shouldUpdateBuffers = UpdateTerrainQuad(rootQuad, viewerPos);
+	UpdateQuadTree(viewerPos);
+
+	//quads that didn't get staging space when they were set up
+	for (TerrainQuad& quad : quads) {
+		if (quad.state == TerrainQuad::State::waiting_create && !quad.TryGenerate())
+			break;
+	}
 
 	//if (shouldUpdateBuffers)
 	//	UpdateMeshBuffer();
@@ -433,6 +349,21 @@ void Terrain::SetupDescriptorSets(
 
 }
 
+#ifdef TERRAIN_COMPACT_VERTICES
+static std::vector<VkVertexInputBindingDescription> TerrainCompactBindingDescription() {
+	std::vector<VkVertexInputBindingDescription> bindingDescription;
+	bindingDescription.push_back(initializers::vertexInputBindingDescription(0, sizeof(TerrainCompactVertex), VK_VERTEX_INPUT_RATE_VERTEX));
+	return bindingDescription;
+}
+
+static std::vector<VkVertexInputAttributeDescription> TerrainCompactAttributeDescriptions() {
+	std::vector<VkVertexInputAttributeDescription> attrib = {};
+	attrib.push_back(initializers::vertexInputAttributeDescription(0, 0, VK_FORMAT_R16_UNORM, offsetof(TerrainCompactVertex, height)));
+	attrib.push_back(initializers::vertexInputAttributeDescription(0, 1, VK_FORMAT_R8G8_SNORM, offsetof(TerrainCompactVertex, normal)));
+	return attrib;
+}
+#endif
+
 void Terrain::SetupPipeline()
 {
 	VulkanPipeline &pipeMan = renderer.pipelineManager;
@@ -441,13 +372,21 @@ void Terrain::SetupPipeline()
 	//pipeMan.SetVertexShader(mvp, loadShaderModule(renderer.device.device, "assets/shaders/terrain.vert.spv"));
 	//pipeMan.SetFragmentShader(mvp, loadShaderModule(renderer.device.device, "assets/shaders/terrain.frag.spv"));
 
+#ifdef TERRAIN_COMPACT_VERTICES
 	auto vert = renderer.shaderManager.loadShaderModule("assets/shaders/terrain.vert.spv", ShaderModuleType::vertex);
+#else
+	auto vert = renderer.shaderManager.loadShaderModule("assets/shaders/terrain_full.vert.spv", ShaderModuleType::vertex);
+#endif
 	auto frag = renderer.shaderManager.loadShaderModule("assets/shaders/terrain.frag.spv", ShaderModuleType::fragment);
 
 	ShaderModuleSet set(vert, frag, {}, {}, {});
 	pipeMan.SetShaderModuleSet(mvp, set);
 
+#ifdef TERRAIN_COMPACT_VERTICES
+	pipeMan.SetVertexInput(mvp, TerrainCompactBindingDescription(), TerrainCompactAttributeDescriptions());
+#else
 	pipeMan.SetVertexInput(mvp, Vertex_PosNormTex::getBindingDescription(), Vertex_PosNormTex::getAttributeDescriptions());
+#endif
 	pipeMan.SetInputAssembly(mvp, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
 	pipeMan.SetViewport(mvp, (float)renderer.vulkanSwapChain.swapChainExtent.width, (float)renderer.vulkanSwapChain.swapChainExtent.height, 0.0f, 1.0f, 0.0f, 0.0f);
 	pipeMan.SetScissor(mvp, renderer.vulkanSwapChain.swapChainExtent.width, renderer.vulkanSwapChain.swapChainExtent.height, 0, 0);
@@ -472,12 +411,12 @@ void Terrain::SetupPipeline()
 	layouts.push_back(descriptor->GetLayout());
 	pipeMan.SetDescriptorSetLayout(mvp, layouts);
 
-	//VkPushConstantRange pushConstantRange = {};
-	//pushConstantRange.offset = 0;
-	//pushConstantRange.size = sizeof(TerrainPushConstant);
-	//pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(TerrainChunkPushConstant);
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-	//pipeMan.SetModelPushConstant(mvp, pushConstantRange);
+	pipeMan.SetModelPushConstant(mvp, pushConstantRange);
 
 	pipeMan.BuildPipelineLayout(mvp);
 	pipeMan.BuildPipeline(mvp, renderer.renderPass->Get(), 0);
@@ -485,6 +424,8 @@ void Terrain::SetupPipeline()
 	pipeMan.SetRasterizer(mvp, VK_POLYGON_MODE_LINE, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FALSE, VK_FALSE, 1.0f, VK_TRUE);
 	pipeMan.BuildPipeline(mvp, renderer.renderPass->Get(), 0);
 
+	//the normal debug shader reads full vertices, compact ones don't have a position or normal it can use
+#ifndef TERRAIN_COMPACT_VERTICES
 	auto normalVert = renderer.shaderManager.loadShaderModule("assets/shaders/normalVecDebug.vert.spv", ShaderModuleType::vertex);
 	auto normalFrag = renderer.shaderManager.loadShaderModule("assets/shaders/normalVecDebug.frag.spv", ShaderModuleType::fragment);
 	auto normalGeom = renderer.shaderManager.loadShaderModule("assets/shaders/normalVecDebug.geom.spv", ShaderModuleType::geometry);
@@ -492,6 +433,7 @@ void Terrain::SetupPipeline()
 	ShaderModuleSet normalSset(normalVert, normalFrag, normalGeom, {}, {});
 	pipeMan.SetShaderModuleSet(mvp, normalSset);
 	pipeMan.BuildPipeline(mvp, renderer.renderPass->Get(), 0);
+#endif
 
 
 	//pipeMan.CleanShaderResources(mvp);
@@ -698,247 +640,151 @@ void Terrain::UpdateMeshBuffer() {
 		//Log::Debug << "Execute buffer copies: " << gpuTransferTime.GetElapsedTimeMicroSeconds() << "\n";
 }
 
-void Terrain::InitTerrainQuad(int quad,
-	glm::vec3 viewerPos) {
-
-	//SimpleTimer terrainQuadCreateTime;
-
-
-	// TODO - get new quad and set it to generate a new quad
-	//std::thread* worker = new std::thread(GenerateTerrainChunk, std::ref(fastGraphUser), quad, heightScale);
-	//terrainGenerationWorkers.push_back(worker);
-
-	//terrainQuadCreateTime.EndTimer();
-	//Log::Debug << "From Parent " << terrainQuadCreateTime.GetElapsedTimeMicroSeconds() << "\n";
-
-	UpdateTerrainQuad(quad, viewerPos);
-}
-
-
-bool Terrain::UpdateTerrainQuad(int quad, glm::vec3 viewerPos) {
+//Walks the tree with quadStack instead of recursing, new sub quads are pushed too so they can
+//subdivide further in the same pass
+void Terrain::UpdateQuadTree(glm::vec3 viewerPos) {
 
 	float SubdivideDistanceBias = 2.0f;
 
-	glm::vec3 center = glm::vec3(quadMap.at(quad).pos.x + quadMap.at(quad).size.x / 2.0f,
-		quadMap.at(quad).heightValAtCenter, quadMap.at(quad).pos.y + quadMap.at(quad).size.y / 2.0f);
-	float distanceToViewer = glm::distance(viewerPos, center);
-
-	if (!quadMap.at(quad).isSubdivided) { //can only subdivide if this quad isn't already subdivided
-		if (distanceToViewer < quadMap.at(quad).size.x * SubdivideDistanceBias && quadMap.at(quad).level < maxLevels) { //must be 
-			SubdivideTerrain(quad, viewerPos);
-			return true;
+	quadStack.clear();
+	quadStack.push_back(rootQuad);
+	while (!quadStack.empty()) {
+		TerrainQuadIndex quad = quadStack.back();
+		quadStack.pop_back();
+
+		const TerrainQuad& node = quads[quad];
+		glm::vec3 center = glm::vec3(node.pos.x + node.size.x / 2.0f,
+			node.heightValAtCenter, node.pos.y + node.size.y / 2.0f);
+		float distanceToViewer = glm::distance(viewerPos, center);
+
+		if (!node.isSubdivided) { //can only subdivide if this quad isn't already subdivided
+			if (distanceToViewer >= node.size.x * SubdivideDistanceBias || node.level >= maxLevels)
+				continue;
+			SubdivideTerrain(quad); //can grow quads, node isn't used after this
+		}
+		else if (distanceToViewer > node.size.x * SubdivideDistanceBias) {
+			UnSubdivide(quad);
+			continue;
 		}
-	}
-
-	else if (distanceToViewer > quadMap.at(quad).size.x * SubdivideDistanceBias) {
-		UnSubdivide(quad);
-		return true;
-	}
-	else {
-		bool uR = UpdateTerrainQuad(quadMap.at(quad).subQuads.UpRight, viewerPos);
-		bool uL = UpdateTerrainQuad(quadMap.at(quad).subQuads.UpLeft, viewerPos);
-		bool dR = UpdateTerrainQuad(quadMap.at(quad).subQuads.DownRight, viewerPos);
-		bool dL = UpdateTerrainQuad(quadMap.at(quad).subQuads.DownLeft, viewerPos);
 
-		if (uR || uL || dR || dL)
-			return true;
+		TerrainQuadIndex first = quads[quad].firstSubQuad;
+		for (TerrainQuadIndex i = first; i < first + 4; i++)
+			quadStack.push_back(i);
 	}
-	return false;
 }
 
-void Terrain::SubdivideTerrain(int quad, glm::vec3 viewerPos) {
-	quadMap.at(quad).isSubdivided = true;
-	numQuads += 4;
-
-	glm::vec2 new_pos = glm::vec2(quadMap.at(quad).pos.x, quadMap.at(quad).pos.y);
-	glm::vec2 new_size = glm::vec2(quadMap.at(quad).size.x / 2.0, quadMap.at(quad).size.y / 2.0);
-
-	glm::i32vec2 new_lpos = glm::i32vec2(quadMap.at(quad).logicalPos.x, quadMap.at(quad).logicalPos.y);
-	glm::i32vec2 new_lsize = glm::i32vec2(quadMap.at(quad).logicalSize.x / 2.0, quadMap.at(quad).logicalSize.y / 2.0);
-
-	quadMap.at(quad).subQuads.UpRight = FindEmptyIndex();
-	quadMap.emplace(std::make_pair(quadMap.at(quad).subQuads.UpRight, TerrainQuad(
-		chunkBuffer,
-		glm::vec2(new_pos.x, new_pos.y),
-		new_size,
-		glm::i32vec2(new_lpos.x, new_lpos.y),
-		new_lsize,
-		quadMap.at(quad).level + 1,
-		glm::i32vec2(quadMap.at(quad).subDivPos.x * 2, quadMap.at(quad).subDivPos.y * 2),
-		GetHeightAtLocation(
-			TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quadMap.at(quad).level + 1, quadMap.at(quad).subDivPos.x * 2),
-			TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quadMap.at(quad).level + 1, quadMap.at(quad).subDivPos.y * 2)),
-		this
-	)));
-	quadMap.at(quadMap.at(quad).subQuads.UpRight).Setup();
-
-	quadMap.at(quad).subQuads.UpLeft = FindEmptyIndex();
-	quadMap.emplace(std::make_pair(quadMap.at(quad).subQuads.UpLeft, TerrainQuad(
-		chunkBuffer,
-		glm::vec2(new_pos.x, new_pos.y + new_size.y),
-		new_size,
-		glm::i32vec2(new_lpos.x, new_lpos.y + new_lsize.y),
-		new_lsize,
-		quadMap.at(quad).level + 1,
-		glm::i32vec2(quadMap.at(quad).subDivPos.x * 2, quadMap.at(quad).subDivPos.y * 2 + 1),
-		GetHeightAtLocation(
-			TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quadMap.at(quad).level + 1, quadMap.at(quad).subDivPos.x * 2),
-			TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quadMap.at(quad).level + 1, quadMap.at(quad).subDivPos.y * 2 + 1)),
-		this
-	)));
-	quadMap.at(quadMap.at(quad).subQuads.UpLeft).Setup();
-
-	quadMap.at(quad).subQuads.DownRight = FindEmptyIndex();
-	quadMap.emplace(std::make_pair(quadMap.at(quad).subQuads.DownRight, TerrainQuad(
-		chunkBuffer,
-		glm::vec2(new_pos.x + new_size.x, new_pos.y), new_size,
-		glm::i32vec2(new_lpos.x + new_lsize.x, new_lpos.y),
-		new_lsize,
-		quadMap.at(quad).level + 1,
-		glm::i32vec2(quadMap.at(quad).subDivPos.x * 2 + 1, quadMap.at(quad).subDivPos.y * 2),
-		GetHeightAtLocation(
-			TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quadMap.at(quad).level + 1, quadMap.at(quad).subDivPos.x * 2 + 1),
-			TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quadMap.at(quad).level + 1, quadMap.at(quad).subDivPos.y * 2)),
-		this
-	)));
-	quadMap.at(quadMap.at(quad).subQuads.DownRight).Setup();
-
-	quadMap.at(quad).subQuads.DownLeft = FindEmptyIndex();
-	quadMap.emplace(std::make_pair(quadMap.at(quad).subQuads.DownLeft, TerrainQuad(
-		chunkBuffer,
-		glm::vec2(new_pos.x + new_size.x, new_pos.y + new_size.y),
-		new_size,
-		glm::i32vec2(new_lpos.x + new_lsize.x, new_lpos.y + new_lsize.y),
-		new_lsize,
-		quadMap.at(quad).level + 1,
-		glm::i32vec2(quadMap.at(quad).subDivPos.x * 2 + 1, quadMap.at(quad).subDivPos.y * 2 + 1),
-		GetHeightAtLocation(
-			TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quadMap.at(quad).level + 1, quadMap.at(quad).subDivPos.x * 2 + 1),
-			TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quadMap.at(quad).level + 1, quadMap.at(quad).subDivPos.y * 2 + 1)),
-		this
-	)));
-	quadMap.at(quadMap.at(quad).subQuads.DownLeft).Setup();
-
-	InitTerrainQuad(quadMap.at(quad).subQuads.UpRight, viewerPos);
-	InitTerrainQuad(quadMap.at(quad).subQuads.UpLeft, viewerPos);
-	InitTerrainQuad(quadMap.at(quad).subQuads.DownRight, viewerPos);
-	InitTerrainQuad(quadMap.at(quad).subQuads.DownLeft, viewerPos);
+void Terrain::SubdivideTerrain(TerrainQuadIndex quad) {
+	TerrainQuadIndex first = AllocateQuadBlock(); //before taking a reference, it can grow quads
 
-	// quadHandles.push_back(std::make_unique<TerrainQuad>(
-	// 	glm::vec2(new_pos.x, new_pos.y),
-	// 	new_size,
-	// 	glm::i32vec2(new_lpos.x, new_lpos.y),
-	// 	new_lsize,
-	// 	quad->level + 1,
-	// 	glm::i32vec2(quad->subDivPos.x * 2, quad->subDivPos.y * 2),
-	// 	GetHeightAtLocation(
-	// 		TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quad->level + 1, quad->subDivPos.x * 2),
-	// 		TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quad->level + 1, quad->subDivPos.y * 2)),
-	// 	meshPool_vertices.allocate(), meshPool_indices.allocate(), renderer.device));
-	// quad->subQuads.UpRight = quadHandles.back().get();
-
-	// quadHandles.push_back(std::make_unique<TerrainQuad>(
-	// 	glm::vec2(new_pos.x, new_pos.y + new_size.y),
-	// 	new_size,
-	// 	glm::i32vec2(new_lpos.x, new_lpos.y + new_lsize.y),
-	// 	new_lsize,
-	// 	quad->level + 1,
-	// 	glm::i32vec2(quad->subDivPos.x * 2, quad->subDivPos.y * 2 + 1),
-	// 	GetHeightAtLocation(
-	// 		TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quad->level + 1, quad->subDivPos.x * 2),
-	// 		TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quad->level + 1, quad->subDivPos.y * 2 + 1)),
-	// 	meshPool_vertices.allocate(), meshPool_indices.allocate(), renderer.device));
-	// quad->subQuads.UpLeft = quadHandles.back().get();
-
-	// quadHandles.push_back(std::make_unique<TerrainQuad>(
-	// 	glm::vec2(new_pos.x + new_size.x, new_pos.y), new_size,
-	// 	glm::i32vec2(new_lpos.x + new_lsize.x, new_lpos.y),
-	// 	new_lsize,
-	// 	quad->level + 1,
-	// 	glm::i32vec2(quad->subDivPos.x * 2 + 1, quad->subDivPos.y * 2),
-	// 	GetHeightAtLocation(
-	// 		TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quad->level + 1, quad->subDivPos.x * 2 + 1),
-	// 		TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quad->level + 1, quad->subDivPos.y * 2)),
-	// 	meshPool_vertices.allocate(), meshPool_indices.allocate(), renderer.device));
-	// quad->subQuads.DownRight = quadHandles.back().get();
+	TerrainQuad& parent = quads[quad];
+	parent.isSubdivided = true;
+	parent.firstSubQuad = first;
+	numQuads += 4;
 
-	// quadHandles.push_back(std::make_unique<TerrainQuad>(
-	// 	glm::vec2(new_pos.x + new_size.x, new_pos.y + new_size.y),
-	// 	new_size,
-	// 	glm::i32vec2(new_lpos.x + new_lsize.x, new_lpos.y + new_lsize.y),
-	// 	new_lsize,
-	// 	quad->level + 1,
-	// 	glm::i32vec2(quad->subDivPos.x * 2 + 1, quad->subDivPos.y * 2 + 1),
-	// 	GetHeightAtLocation(
-	// 		TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quad->level + 1, quad->subDivPos.x * 2 + 1),
-	// 		TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, quad->level + 1, quad->subDivPos.y * 2 + 1)),
-	// 	meshPool_vertices.allocate(), meshPool_indices.allocate(), renderer.device));
-	// quad->subQuads.DownLeft = quadHandles.back().get();
-
-
-	// InitTerrainQuad(quad->subQuads.UpRight, viewerPos);
-	// InitTerrainQuad(quad->subQuads.UpLeft, viewerPos);
-	// InitTerrainQuad(quad->subQuads.DownRight, viewerPos);
-	// InitTerrainQuad(quad->subQuads.DownLeft, viewerPos);
+	glm::vec2 new_size = glm::vec2(parent.size.x / 2.0, parent.size.y / 2.0);
+	glm::i32vec2 new_lsize = glm::i32vec2(parent.logicalSize.x / 2.0, parent.logicalSize.y / 2.0);
+
+	//Corner_Enum order, up and down step along x, right and left along y
+	for (int corner = 0; corner < 4; corner++) {
+		glm::i32vec2 offset = glm::i32vec2(corner >> 1, corner & 1);
+		glm::i32vec2 subDivPos = parent.subDivPos * 2 + offset;
+
+		quads[first + corner] = TerrainQuad(
+			parent.pos + glm::vec2(offset) * new_size,
+			new_size,
+			parent.logicalPos + offset * new_lsize,
+			new_lsize,
+			parent.level + 1,
+			subDivPos,
+			GetHeightAtLocation(
+				TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, parent.level + 1, subDivPos.x),
+				TerrainQuad::GetUVvalueFromLocalIndex(NumCells / 2, NumCells, parent.level + 1, subDivPos.y)),
+			this);
+		quads[first + corner].Setup();
+	}
 
 	//Log::Debug << "Terrain subdivided: Level: " << quad->level << " Position: " << quad->pos.x << ", " <<quad->pos.z << " Size: " << quad->size.x << ", " << quad->size.z << "\n";
 
 }
 
-void Terrain::UnSubdivide(int quad) {
-	if (quadMap.at(quad).isSubdivided)
-	{
-		UnSubdivide(quadMap.at(quad).subQuads.UpRight);
-		UnSubdivide(quadMap.at(quad).subQuads.UpLeft);
-		UnSubdivide(quadMap.at(quad).subQuads.DownRight);
-		UnSubdivide(quadMap.at(quad).subQuads.DownLeft);
-
-		quadMap.erase(quadMap.at(quad).subQuads.UpRight);
-		quadMap.erase(quadMap.at(quad).subQuads.UpLeft);
-		quadMap.erase(quadMap.at(quad).subQuads.DownRight);
-		quadMap.erase(quadMap.at(quad).subQuads.DownLeft);
+//Uses the top of quadStack, so it can run in the middle of UpdateQuadTree's walk
+void Terrain::UnSubdivide(TerrainQuadIndex quad) {
+	size_t stackBase = quadStack.size();
+	quadStack.push_back(quad);
+	while (quadStack.size() > stackBase) {
+		TerrainQuadIndex current = quadStack.back();
+		quadStack.pop_back();
+		if (!quads[current].isSubdivided)
+			continue;
+
+		TerrainQuadIndex first = quads[current].firstSubQuad;
+		for (TerrainQuadIndex i = first; i < first + 4; i++)
+			quadStack.push_back(i);
+		FreeQuadBlock(first);
 		numQuads -= 4;
 
-		quadMap.at(quad).isSubdivided = false;
+		quads[current].isSubdivided = false;
+		quads[current].firstSubQuad = InvalidQuadIndex;
 	}
 	//numQuads -= 1;
 	//Log::Debug << "Terrain un-subdivided: Level: " << quad->level << " Position: " << quad->pos.x << ", " << quad->pos.z << " Size: " << quad->size.x << ", " << quad->size.z << "\n";
 }
 
-void Terrain::PopulateQuadOffsets(int quad, std::vector<VkDeviceSize>& vert, std::vector<VkDeviceSize>& ind) {
-	if (quadMap.at(quad).isSubdivided) {
-		PopulateQuadOffsets(quadMap.at(quad).subQuads.UpRight, vert, ind);
-		PopulateQuadOffsets(quadMap.at(quad).subQuads.UpLeft, vert, ind);
-		PopulateQuadOffsets(quadMap.at(quad).subQuads.DownRight, vert, ind);
-		PopulateQuadOffsets(quadMap.at(quad).subQuads.DownLeft, vert, ind);
-	}
-	else {
-		//if (*quadMap.at(quad).quadSignal == true) {
-		vert.push_back(quadMap.at(quad).index * sizeof(TerrainMeshVertices));
-		ind.push_back(quadMap.at(quad).index * sizeof(TerrainMeshIndices));
-		//}
+//Depth first like the tree walks, sub quads are pushed in reverse so they're drawn in Corner_Enum order
+void Terrain::PopulateQuadOffsets(FrameVector<VkDeviceSize>& vert,
+	FrameVector<TerrainChunkPushConstant>& drawData)
+{
+	auto isGenerated = [&](TerrainQuadIndex q) { return quads[q].state == TerrainQuad::State::ready; };
+
+	FrameVector<TerrainQuadIndex> stack(renderer.frameAllocator);
+	stack.push_back(rootQuad);
+	while (!stack.empty()) {
+		const TerrainQuad& quad = quads[stack.back()];
+		stack.pop_back();
+
+		TerrainQuadIndex first = quad.firstSubQuad;
+		//until all four sub quads got staging space the parent is drawn in their place
+		if (quad.isSubdivided && isGenerated(first) && isGenerated(first + 1)
+			&& isGenerated(first + 2) && isGenerated(first + 3))
+		{
+			for (TerrainQuadIndex i = first + 4; i > first; i--)
+				stack.push_back(i - 1);
+		}
+		else if (quad.state == TerrainQuad::State::ready) {
+			//if (*quad.quadSignal == true) {
+			vert.push_back(quad.chunk.index * sizeof(TerrainChunkVertices));
+			drawData.push_back(quad.drawData);
+			//}
+		}
 	}
 }
 
-void Terrain::DrawDepthPrePass(VkCommandBuffer cmdBuff){
-	VkDeviceSize offsets[] = { 0 };
-	
-	//if (!terrainVulkanSplatMap->readyToUse)
-	//	return;
+//Draws every leaf quad, the pipeline and descriptor sets have to be bound already
+void Terrain::DrawChunks(VkCommandBuffer cmdBuff) {
+	FrameVector<VkDeviceSize> vertexOffsettings(renderer.frameAllocator);
+	FrameVector<TerrainChunkPushConstant> drawData(renderer.frameAllocator);
 
-	std::vector<VkDeviceSize> vertexOffsettings;
-	std::vector<VkDeviceSize> indexOffsettings;
-
-	PopulateQuadOffsets(rootQuad, vertexOffsettings, indexOffsettings);
+	PopulateQuadOffsets(vertexOffsettings, drawData);
 
+	chunkBuffer.index_buffer.BindIndexBuffer(cmdBuff);
 	for (int i = 0; i < vertexOffsettings.size(); i++) {
 		vkCmdBindVertexBuffers(cmdBuff, 0, 1, &chunkBuffer.vert_buffer.buffer.buffer, &vertexOffsettings[i]);
-		vkCmdBindIndexBuffer(cmdBuff, chunkBuffer.index_buffer.buffer.buffer, indexOffsettings[i], VK_INDEX_TYPE_UINT32);
+		vkCmdPushConstants(cmdBuff, mvp->layout, VK_SHADER_STAGE_VERTEX_BIT,
+			0, sizeof(TerrainChunkPushConstant), &drawData[i]);
 
 		vkCmdDrawIndexed(cmdBuff, static_cast<uint32_t>(indCount), 1, 0, 0, 0);
 	}
 }
 
+void Terrain::DrawDepthPrePass(VkCommandBuffer cmdBuff){
+	VkDeviceSize offsets[] = { 0 };
+	
+	//if (!terrainVulkanSplatMap->readyToUse)
+	//	return;
+
+	DrawChunks(cmdBuff);
+}
+
 void Terrain::DrawTerrain(VkCommandBuffer cmdBuff, bool ifWireframe) {
 	VkDeviceSize offsets[] = { 0 };
 	//return;
@@ -947,11 +793,6 @@ void Terrain::DrawTerrain(VkCommandBuffer cmdBuff, bool ifWireframe) {
 
 	drawTimer.StartTimer();
 
-	std::vector<VkDeviceSize> vertexOffsettings;
-	std::vector<VkDeviceSize> indexOffsettings;
-
-	PopulateQuadOffsets(rootQuad, vertexOffsettings, indexOffsettings);
-
 	/*vkCmdPushConstants(
 		cmdBuff,
 		mvp->layout,
@@ -963,12 +804,7 @@ void Terrain::DrawTerrain(VkCommandBuffer cmdBuff, bool ifWireframe) {
 	vkCmdBindPipeline(cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, ifWireframe ? mvp->pipelines->at(1) : mvp->pipelines->at(0));
 	vkCmdBindDescriptorSets(cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, mvp->layout, 2, 1, &descriptorSet.set, 0, nullptr);
 
-	for (int i = 0; i < vertexOffsettings.size(); i++) {
-		vkCmdBindVertexBuffers(cmdBuff, 0, 1, &chunkBuffer.vert_buffer.buffer.buffer, &vertexOffsettings[i]);
-		vkCmdBindIndexBuffer(cmdBuff, chunkBuffer.index_buffer.buffer.buffer, indexOffsettings[i], VK_INDEX_TYPE_UINT32);
-
-		vkCmdDrawIndexed(cmdBuff, static_cast<uint32_t>(indCount), 1, 0, 0, 0);
-	}
+	DrawChunks(cmdBuff);
 
 	//vkCmdBindPipeline(cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, mvp->pipelines->at(2));
 	////vkCmdBindDescriptorSets(cmdBuff, VK_PIPELINE_BIND_POINT_GRAPHICS, mvp->layout, 2, 1, &descriptorSet.set, 0, nullptr);
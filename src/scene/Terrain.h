@@ -17,19 +17,15 @@
 
 #include "../resources/Texture.h"
 #include "../core/CoreTools.h"
+#include "../core/JobSystem.h"
 #include "../util/Gradient.h"
-#include "../util/MemoryPool.h"
+#include "../util/SlotMap.h"
 
 #include "../gui/InternalGraph.h"
 
+#include "InstancedSceneObject.h"
+#include "TerrainChunkBuilder.h"
 
-const int NumCells = 64;
-const int vertCount = (NumCells + 1) * (NumCells + 1);
-const int indCount = NumCells * NumCells * 6;
-const int vertElementCount = 8;
-
-using TerrainMeshVertices = std::array<float, vertCount * vertElementCount>;
-using TerrainMeshIndices = std::array<uint32_t, indCount>;
 
 enum class Corner_Enum {
 	uR = 0,
@@ -42,6 +38,16 @@ struct TerrainPushConstant {
 	glm::mat4 model;
 };
 
+//Per chunk draw data, terrain.vert rebuilds the position and uv of compact vertices from it.
+//Vertex (i, j) of a chunk has the uv (gridOffset + (i, j)) / gridSize
+struct TerrainChunkPushConstant {
+	glm::vec2 gridOffset; //subdivision position * NumCells
+	float gridSize; //cells across the whole terrain at the chunk's level
+	float widthScale;
+	float heightMin; //already multiplied by the height scale
+	float heightRange;
+};
+
 struct TerrainCoordinateData {
 	glm::vec2 pos;
 	glm::vec2 size;
@@ -59,22 +65,41 @@ struct TerrainCoordinateData {
 
 class TerrainChunkBuffer;
 class Terrain;
+struct TerrainQuad;
+
+//state of a chunk in the TerrainChunkBuffer, a chunk that isn't allocated has no state
+enum class TerrainChunkState {
+	allocated,
+	written,
+	ready,
+};
 
+//the handle's index is also the chunk's position in the chunk buffer
+using TerrainChunkHandle = SlotHandle<TerrainChunkState>;
+//index into Terrain::quads
+using TerrainQuadIndex = uint32_t;
+constexpr TerrainQuadIndex InvalidQuadIndex = UINT32_MAX;
+
+//Node of a terrain's quadtree. Nodes are plain values living in Terrain::quads, the terrain
+//frees their chunks when it frees the nodes
 struct TerrainQuad {
-	TerrainQuad(TerrainChunkBuffer& chunkBuffer,
-		glm::vec2 pos, glm::vec2 size,
+	TerrainQuad() = default;
+	TerrainQuad(glm::vec2 pos, glm::vec2 size,
 		glm::i32vec2 logicalPos, glm::i32vec2 logicalSize,
 		int level, glm::i32vec2 subDivPos, float centerHeightValue,
 		Terrain* terrain);
-	~TerrainQuad();
 
 	void Setup();
 
+	//Generates the chunk into staging ring space, when the ring is full the quad stays
+	//waiting_create and Terrain::UpdateTerrain tries again next frame
+	bool TryGenerate();
+
 	static float GetUVvalueFromLocalIndex(float i, int numCells, int level, int subDivPos);
 
-	//Create a mesh chunk for rendering using fastgraph as the input data
-	void GenerateTerrainChunk(InternalGraph::GraphUser& graphUser,
-		float heightScale, float widthScale);
+	//Create a mesh chunk for rendering using fastgraph as the input data, rows are split across the workers
+	void GenerateTerrainChunk(job::TaskManager& taskManager, InternalGraph::GraphUser& graphUser,
+		float heightScale, float widthScale, TerrainChunkVertices& vertices);
 
 	enum class State {
 		free,//nobody owns me
@@ -83,7 +108,7 @@ struct TerrainQuad {
 		waiting_upload, //finished device write, ready for upload,
 		uploading, //is uploading to gpu
 		ready, //ready to be rendered
-	} state;
+	} state = State::free;
 
 	glm::vec2 pos; //position of corner
 	glm::vec2 size; //width and length
@@ -94,22 +119,15 @@ struct TerrainQuad {
 	float heightValAtCenter = 0;
 	bool isSubdivided = false;
 
-	Terrain* terrain; //who owns it
-	TerrainChunkBuffer& chunkBuffer;
-	int index = -1; //index into chunkBuffer
+	Terrain* terrain = nullptr; //who owns it
+	TerrainChunkHandle chunk; //invalid until Setup
 
-	TerrainMeshVertices* vertices;
-	TerrainMeshIndices* indices;
+	TerrainChunkPushConstant drawData; //indices are shared, see TerrainChunkBuffer::index_buffer
 
 	Signal quadSignal;
 
-	//index into terrain's quadMap
-	struct SubQuads {
-		int UpLeft = -1;
-		int DownLeft = -1;
-		int UpRight = -1;
-		int DownRight = -1;
-	} subQuads;
+	//the four sub quads are consecutive in Terrain::quads, in Corner_Enum order
+	TerrainQuadIndex firstSubQuad = InvalidQuadIndex;
 };
 
 
@@ -117,9 +135,13 @@ class Terrain {
 public:
 	TerrainChunkBuffer & chunkBuffer;
 
-	std::unordered_map<int, TerrainQuad> quadMap;
+	//Quads are allocated and freed constantly as the camera moves. They live in one array and the
+	//sub quads of a quad are allocated as a block of four, freed blocks are reused before the array grows
+	std::vector<TerrainQuad> quads;
+	std::vector<TerrainQuadIndex> freeQuadBlocks;
+	std::vector<TerrainQuadIndex> quadStack; //scratch for the iterative tree walks in UpdateTerrain
 
-	int rootQuad = 0;
+	TerrainQuadIndex rootQuad = 0;
 
 	int maxLevels;
 	int maxNumQuads;
@@ -128,7 +150,10 @@ public:
 	TerrainCoordinateData coordinateData;
 	float heightScale = 100;
 
+	InstancedSceneObject::InstanceHandle waterInstance; //this terrain's tile in the manager's instancedWaters
+
 	VulkanRenderer& renderer;
+	job::TaskManager& taskManager;
 
 	std::shared_ptr<ManagedVulkanPipeline> mvp;
 
@@ -150,9 +175,11 @@ public:
 	SimpleTimer drawTimer;
 
 	Terrain(VulkanRenderer& renderer,
+		job::TaskManager& taskManager,
 		TerrainChunkBuffer& chunkBuffer,
 		InternalGraph::GraphPrototype& protoGraph,
-		int numCells, int maxLevels, float heightScale, TerrainCoordinateData coordinateData);
+		int numCells, int maxLevels, float heightScale, TerrainCoordinateData coordinateData,
+		job::CancellationToken cancelToken = {});
 	~Terrain();
 
 	void InitTerrain(glm::vec3 cameraPos,
@@ -169,12 +196,10 @@ public:
 
 	float GetHeightAtLocation(float x, float z);
 private:
-	int curEmptyIndex = 0;
-	int FindEmptyIndex();
-
-	void InitTerrainQuad(int quad, glm::vec3 viewerPos);
+	TerrainQuadIndex AllocateQuadBlock(); //index of the first of four unused quads, may grow quads
+	void FreeQuadBlock(TerrainQuadIndex first); //frees the four quads' chunks and gives the block back
 
-	bool UpdateTerrainQuad(int quad, glm::vec3 viewerPos);
+	void UpdateQuadTree(glm::vec3 viewerPos);
 
 	void SetupMeshbuffers();
 	void SetupUniformBuffer();
@@ -189,9 +214,11 @@ private:
 
 	void UpdateMeshBuffer();
 
-	void SubdivideTerrain(int quad, glm::vec3 viewerPos);
-	void UnSubdivide(int quad);
+	void SubdivideTerrain(TerrainQuadIndex quad);
+	void UnSubdivide(TerrainQuadIndex quad);
 
-	void PopulateQuadOffsets(int quad, std::vector<VkDeviceSize>& vert, std::vector<VkDeviceSize>& ind);
+	void PopulateQuadOffsets(FrameVector<VkDeviceSize>& vert,
+		FrameVector<TerrainChunkPushConstant>& drawData);
+	void DrawChunks(VkCommandBuffer cmdBuff);
 
 };
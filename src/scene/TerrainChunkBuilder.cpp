@@ -0,0 +1,279 @@
+#include "TerrainChunkBuilder.h"
+#include "TerrainChunkBuilder_internal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "../../third-party/FastNoiseSIMD/FastNoiseSIMD.h"
+
+namespace TerrainChunkBuilderInternal {
+
+	//Same math as BilinearImageSample2D, without the bounds checks as clamped uvs can't leave the image
+	float SampleHeight(TerrainHeightSource source, const float x, const float z) {
+		const int cellScale = source.width - 1;
+
+		const float xScaled = x * (float)cellScale;
+		const float zScaled = z * (float)cellScale;
+
+		const int realX = (int)xScaled;
+		const int realZ = (int)zScaled;
+
+		const int realXPlus1 = (int)glm::clamp(xScaled + 1, 0.0f, (float)cellScale);
+		const int realZPlus1 = (int)glm::clamp(zScaled + 1, 0.0f, (float)cellScale);
+
+		const float UL = source.data[realX * source.width + realZ];
+		const float UR = source.data[realX * source.width + realZPlus1];
+		const float DL = source.data[realXPlus1 * source.width + realZ];
+		const float DR = source.data[realXPlus1 * source.width + realZPlus1];
+
+		if (realX == realXPlus1 && realZ == realZPlus1) {
+			return UL;
+		}
+		else if (realX == realXPlus1) {
+			return (UL * ((float)realZPlus1 - zScaled) + UR * (zScaled - (float)realZ)) / ((float)realZPlus1 - (float)realZ);
+		}
+		else if (realZ == realZPlus1) {
+			return (UL * ((float)realXPlus1 - xScaled) + DL * (xScaled - (float)realX)) / ((float)realXPlus1 - (float)realX);
+		}
+		else {
+			return (
+				UL * ((float)realXPlus1 - xScaled)* ((float)realZPlus1 - zScaled)
+				+ DL * (xScaled - (float)realX)		* ((float)realZPlus1 - zScaled)
+				+ UR * ((float)realXPlus1 - xScaled)* (zScaled - (float)realZ)
+				+ DR * (xScaled - (float)realX)		* (zScaled - (float)realZ)
+				)
+				/ (((float)realXPlus1 - (float)realX) * ((float)realZPlus1 - (float)realZ));
+		}
+	}
+
+	void SampleRowTail(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+		int u, int vBegin, TerrainHeightGrid& heights)
+	{
+		for (int v = vBegin; v < HeightGridWidth; v++)
+			heights[u * HeightGridWidth + v] = SampleHeight(source, uvUs[u], uvVs[v]);
+	}
+
+	void BuildRowTail(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+		float heightScale, float widthScale, int i, int jBegin, TerrainMeshVertices& vertices)
+	{
+		const int numCells = NumCells;
+		float hDiff = uvUs[3] - uvUs[1];
+
+		//grid rows above, at and below this vertex row
+		const float* rowMinus = &heights[(i + 0) * HeightGridWidth];
+		const float* row = &heights[(i + 1) * HeightGridWidth];
+		const float* rowPlus = &heights[(i + 2) * HeightGridWidth];
+
+		float uvU = uvUs[(i + 1)];
+
+		for (int j = jBegin; j < numCells + 1; j++)
+		{
+			float uvV = uvVs[(j + 1)];
+
+			float outheight = row[j + 1];
+			float outheightum = rowMinus[j + 1];
+			float outheightup = rowPlus[j + 1];
+			float outheightvm = row[j];
+			float outheightvp = row[j + 2];
+
+			glm::vec3 normal = glm::normalize(glm::vec3((outheightvm - outheightvp) / hDiff,
+				16.0f,
+				(outheightum - outheightup)) / hDiff);
+
+			float* vert = &vertices[((i)*(numCells + 1) + j) * vertElementCount];
+			vert[0] = uvU * (widthScale);
+			vert[1] = outheight * heightScale;
+			vert[2] = uvV * (widthScale);
+			vert[3] = normal.x;
+			vert[4] = normal.y;
+			vert[5] = normal.z;
+			vert[6] = uvU;
+			vert[7] = uvV;
+		}
+	}
+
+	void SampleRows_Scalar(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+		int rowBegin, int rowEnd, TerrainHeightGrid& heights)
+	{
+		for (int u = rowBegin; u < rowEnd; u++)
+			SampleRowTail(source, uvUs, uvVs, u, 0, heights);
+	}
+
+	void BuildRows_Scalar(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+		float heightScale, float widthScale, int rowBegin, int rowEnd, TerrainMeshVertices& vertices)
+	{
+		for (int i = rowBegin; i < rowEnd; i++)
+			BuildRowTail(heights, uvUs, uvVs, heightScale, widthScale, i, 0, vertices);
+	}
+}
+
+using namespace TerrainChunkBuilderInternal;
+
+static TerrainSIMDLevel DetectTerrainSIMDLevel() {
+	int level = FastNoiseSIMD::GetSIMDLevel();
+	//FN_NEON is numbered above the x86 levels, so only compare when those kernels exist
+#ifdef TERRAIN_BUILDER_COMPILE_AVX2
+	if (level >= FN_AVX2 && level != FN_NEON)
+		return TerrainSIMDLevel::avx2;
+#endif
+#ifdef TERRAIN_BUILDER_COMPILE_SSE41
+	if (level >= FN_SSE41 && level != FN_NEON)
+		return TerrainSIMDLevel::sse41;
+#endif
+	return TerrainSIMDLevel::scalar;
+}
+
+static std::atomic<int> currentSIMDLevel = -1;
+
+TerrainSIMDLevel GetTerrainSIMDLevel() {
+	int level = currentSIMDLevel.load(std::memory_order_relaxed);
+	if (level < 0) {
+		level = static_cast<int>(DetectTerrainSIMDLevel());
+		currentSIMDLevel.store(level, std::memory_order_relaxed);
+	}
+	return static_cast<TerrainSIMDLevel>(level);
+}
+
+void SetTerrainSIMDLevel(TerrainSIMDLevel level) {
+	TerrainSIMDLevel supported = DetectTerrainSIMDLevel();
+	if (static_cast<int>(level) > static_cast<int>(supported))
+		level = supported;
+	currentSIMDLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+const char* TerrainSIMDLevelName(TerrainSIMDLevel level) {
+	switch (level) {
+	case(TerrainSIMDLevel::sse41): return "sse41";
+	case(TerrainSIMDLevel::avx2): return "avx2";
+	default: return "scalar";
+	}
+}
+
+void CalcTerrainGridUVs(int level, int subDivPosX, int subDivPosY, float* uvUs, float* uvVs)
+{
+	int powLevel = 1 << (level);
+	for (int i = 0; i < HeightGridWidth; i++)
+	{
+		uvUs[i] = glm::clamp((float)(i - 1) / ((float)(powLevel) * (NumCells)) + (float)subDivPosX / (float)(powLevel), 0.0f, 1.0f);
+		uvVs[i] = glm::clamp((float)(i - 1) / ((float)(powLevel) * (NumCells)) + (float)subDivPosY / (float)(powLevel), 0.0f, 1.0f);
+	}
+}
+
+void SampleTerrainHeightGrid(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+	int rowBegin, int rowEnd, TerrainHeightGrid& heights)
+{
+	switch (GetTerrainSIMDLevel()) {
+#ifdef TERRAIN_BUILDER_COMPILE_AVX2
+	case(TerrainSIMDLevel::avx2):
+		SampleRows_AVX2(source, uvUs, uvVs, rowBegin, rowEnd, heights);
+		break;
+#endif
+#ifdef TERRAIN_BUILDER_COMPILE_SSE41
+	case(TerrainSIMDLevel::sse41):
+		SampleRows_SSE41(source, uvUs, uvVs, rowBegin, rowEnd, heights);
+		break;
+#endif
+	default:
+		SampleRows_Scalar(source, uvUs, uvVs, rowBegin, rowEnd, heights);
+		break;
+	}
+}
+
+void BuildTerrainVertexRows(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+	float heightScale, float widthScale, int rowBegin, int rowEnd, TerrainMeshVertices& vertices)
+{
+	switch (GetTerrainSIMDLevel()) {
+#ifdef TERRAIN_BUILDER_COMPILE_AVX2
+	case(TerrainSIMDLevel::avx2):
+		BuildRows_AVX2(heights, uvUs, uvVs, heightScale, widthScale, rowBegin, rowEnd, vertices);
+		break;
+#endif
+#ifdef TERRAIN_BUILDER_COMPILE_SSE41
+	case(TerrainSIMDLevel::sse41):
+		BuildRows_SSE41(heights, uvUs, uvVs, heightScale, widthScale, rowBegin, rowEnd, vertices);
+		break;
+#endif
+	default:
+		BuildRows_Scalar(heights, uvUs, uvVs, heightScale, widthScale, rowBegin, rowEnd, vertices);
+		break;
+	}
+}
+
+TerrainHeightRange CalcTerrainHeightRange(const TerrainHeightGrid& heights)
+{
+	float minHeight = heights[HeightGridWidth + 1];
+	float maxHeight = minHeight;
+	for (int i = 1; i < NumCells + 2; i++) {
+		for (int j = 1; j < NumCells + 2; j++) {
+			minHeight = std::min(minHeight, heights[i * HeightGridWidth + j]);
+			maxHeight = std::max(maxHeight, heights[i * HeightGridWidth + j]);
+		}
+	}
+	return { minHeight, maxHeight - minHeight };
+}
+
+static int8_t QuantizeSnorm8(float value) {
+	return static_cast<int8_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 127.0f));
+}
+
+//Projects the normal onto an octahedron and unfolds it into a square, y is the axis the
+//octahedron is split along so upward facing normals, which is nearly all of them, aren't folded
+static void EncodeOctNormal(float x, float y, float z, int8_t out[2]) {
+	float invL1 = 1.0f / (std::abs(x) + std::abs(y) + std::abs(z));
+	float u = x * invL1;
+	float v = z * invL1;
+	if (y < 0.0f) {
+		float foldedU = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+		float foldedV = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+		u = foldedU;
+		v = foldedV;
+	}
+	out[0] = QuantizeSnorm8(u);
+	out[1] = QuantizeSnorm8(v);
+}
+
+void BuildTerrainCompactVertexRows(const TerrainHeightGrid& heights, const float* uvUs,
+	TerrainHeightRange heightRange, int rowBegin, int rowEnd, TerrainCompactVertices& vertices)
+{
+	const int numCells = NumCells;
+	const float hDiff = uvUs[3] - uvUs[1];
+	const float heightToUnorm = heightRange.range > 0.0f ? 65535.0f / heightRange.range : 0.0f;
+
+	for (int i = rowBegin; i < rowEnd; i++) {
+		const float* rowMinus = &heights[(i + 0) * HeightGridWidth];
+		const float* row = &heights[(i + 1) * HeightGridWidth];
+		const float* rowPlus = &heights[(i + 2) * HeightGridWidth];
+
+		for (int j = 0; j < numCells + 1; j++) {
+			glm::vec3 normal = glm::normalize(glm::vec3((row[j] - row[j + 2]) / hDiff,
+				16.0f,
+				(rowMinus[j + 1] - rowPlus[j + 1])) / hDiff);
+
+			TerrainCompactVertex& vert = vertices[i * (numCells + 1) + j];
+			float height = (row[j + 1] - heightRange.min) * heightToUnorm;
+			vert.height = static_cast<uint16_t>(glm::clamp(height + 0.5f, 0.0f, 65535.0f));
+			EncodeOctNormal(normal.x, normal.y, normal.z, vert.normal);
+		}
+	}
+}
+
+void BuildTerrainIndices(TerrainMeshIndices& indices)
+{
+	const int numCells = NumCells;
+	int counter = 0;
+	for (int i = 0; i < numCells; i++)
+	{
+		for (int j = 0; j < numCells; j++)
+		{
+			indices[counter++] = static_cast<TerrainMeshIndex>(i * (numCells + 1) + j);
+			indices[counter++] = static_cast<TerrainMeshIndex>(i * (numCells + 1) + j + 1);
+			indices[counter++] = static_cast<TerrainMeshIndex>((i + 1) * (numCells + 1) + j);
+			indices[counter++] = static_cast<TerrainMeshIndex>(i * (numCells + 1) + j + 1);
+			indices[counter++] = static_cast<TerrainMeshIndex>((i + 1) * (numCells + 1) + j + 1);
+			indices[counter++] = static_cast<TerrainMeshIndex>((i + 1) * (numCells + 1) + j);
+		}
+	}
+}
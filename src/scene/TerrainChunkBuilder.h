@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+//Mesh layout of a terrain chunk and the code that fills it in. Kept free of vulkan and the
+//node graph so it can be benchmarked on its own.
+
+const int NumCells = 64;
+const int vertCount = (NumCells + 1) * (NumCells + 1);
+const int indCount = NumCells * NumCells * 6;
+const int vertElementCount = 8;
+
+using TerrainMeshVertices = std::array<float, vertCount * vertElementCount>;
+
+//Every chunk has the same topology, so one copy of the indices is shared by all of them
+using TerrainMeshIndex = uint16_t;
+using TerrainMeshIndices = std::array<TerrainMeshIndex, indCount>;
+static_assert(vertCount - 1 <= UINT16_MAX, "terrain chunk vertices no longer fit in 16 bit indices");
+
+//Compact vertex, the position and uv are rebuilt in terrain.vert from the vertex index and the
+//chunk's grid position, so only the height and normal are stored
+struct TerrainCompactVertex {
+	uint16_t height; //unorm, from the chunk's TerrainHeightRange
+	int8_t normal[2]; //octahedral encoded snorm, with y as the up axis
+};
+static_assert(sizeof(TerrainCompactVertex) == 4, "TerrainCompactVertex has to match the terrain vertex input");
+using TerrainCompactVertices = std::array<TerrainCompactVertex, vertCount>;
+
+//What the chunk buffer and terrain shader use, see TERRAIN_COMPACT_VERTICES in CMakeLists.txt
+#ifdef TERRAIN_COMPACT_VERTICES
+using TerrainChunkVertices = TerrainCompactVertices;
+#else
+using TerrainChunkVertices = TerrainMeshVertices;
+#endif
+
+//Heights for every vertex plus a ring of one sample around the chunk, used for the normals.
+//The height at (uvUs[u], uvVs[v]) is stored at u * HeightGridWidth + v
+constexpr int HeightGridWidth = NumCells + 3;
+using TerrainHeightGrid = std::array<float, HeightGridWidth * HeightGridWidth>;
+
+//Square height map the grid gets sampled from, stored as data[x * width + z]
+struct TerrainHeightSource {
+	const float* data;
+	int width;
+};
+
+//Instruction sets the builder has kernels for
+enum class TerrainSIMDLevel {
+	scalar,
+	sse41,
+	avx2,
+};
+
+//Fastest level this cpu supports, detected once with FastNoiseSIMD's cpu check
+TerrainSIMDLevel GetTerrainSIMDLevel();
+
+//Forces a level, mostly for comparing them. Levels the cpu doesn't support fall back to the best one it does
+void SetTerrainSIMDLevel(TerrainSIMDLevel level);
+
+const char* TerrainSIMDLevelName(TerrainSIMDLevel level);
+
+//Fills in the uv coordinates of the height grid samples for a quad at the given level and
+//subdivision position, each array needs HeightGridWidth elements
+void CalcTerrainGridUVs(int level, int subDivPosX, int subDivPosY, float* uvUs, float* uvVs);
+
+//Bilinearly samples grid rows [rowBegin, rowEnd) from source, the uvs must be in [0, 1]
+void SampleTerrainHeightGrid(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+	int rowBegin, int rowEnd, TerrainHeightGrid& heights);
+
+//Writes vertex rows [rowBegin, rowEnd) from the height grid, normals come from the central
+//difference of the neighbouring heights
+void BuildTerrainVertexRows(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+	float heightScale, float widthScale, int rowBegin, int rowEnd, TerrainMeshVertices& vertices);
+
+//Lowest vertex height and the distance to the highest, compact vertices store heights relative to it
+struct TerrainHeightRange {
+	float min;
+	float range;
+};
+TerrainHeightRange CalcTerrainHeightRange(const TerrainHeightGrid& heights);
+
+//Same as BuildTerrainVertexRows but writes compact vertices, heights are left unscaled
+void BuildTerrainCompactVertexRows(const TerrainHeightGrid& heights, const float* uvUs,
+	TerrainHeightRange heightRange, int rowBegin, int rowEnd, TerrainCompactVertices& vertices);
+
+void BuildTerrainIndices(TerrainMeshIndices& indices);
@@ -0,0 +1,166 @@
+#include "TerrainChunkBuilder_internal.h"
+
+#ifdef TERRAIN_BUILDER_COMPILE_AVX2
+
+//Only this file gets built with AVX2 enabled, the kernels are only run once the cpu is known to support it
+#ifndef __AVX2__
+#ifdef __GNUC__
+#error To compile AVX2 add "-mavx2" to the build command of TerrainChunkBuilder_avx2.cpp
+#else
+#error To compile AVX2 set C++ code generation to use /arch:AVX2 on TerrainChunkBuilder_avx2.cpp
+#endif
+#endif
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+namespace TerrainChunkBuilderInternal {
+
+	//8 wide version of SampleHeight4 in the SSE4.1 kernels, with gathers for the lookups
+	static inline __m256 SampleHeight8(const float* rowX0, const float* rowX1,
+		float wx0, float wx1, __m256 z, __m256 cellScale)
+	{
+		__m256 zScaled = _mm256_mul_ps(z, cellScale);
+		__m256i realZ = _mm256_cvttps_epi32(zScaled);
+		__m256i realZPlus1 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_add_ps(zScaled, _mm256_set1_ps(1.0f)), _mm256_setzero_ps()), cellScale));
+
+		__m256 fRealZ = _mm256_cvtepi32_ps(realZ);
+		__m256 fRealZPlus1 = _mm256_cvtepi32_ps(realZPlus1);
+		__m256 atEdge = _mm256_castsi256_ps(_mm256_cmpeq_epi32(realZ, realZPlus1));
+		__m256 wz0 = _mm256_blendv_ps(_mm256_sub_ps(fRealZPlus1, zScaled), _mm256_set1_ps(1.0f), atEdge);
+		__m256 wz1 = _mm256_blendv_ps(_mm256_sub_ps(zScaled, fRealZ), _mm256_setzero_ps(), atEdge);
+
+		__m256 UL = _mm256_i32gather_ps(rowX0, realZ, 4);
+		__m256 UR = _mm256_i32gather_ps(rowX0, realZPlus1, 4);
+		__m256 DL = _mm256_i32gather_ps(rowX1, realZ, 4);
+		__m256 DR = _mm256_i32gather_ps(rowX1, realZPlus1, 4);
+
+		__m256 vwx0 = _mm256_set1_ps(wx0);
+		__m256 vwx1 = _mm256_set1_ps(wx1);
+		__m256 sum = _mm256_mul_ps(_mm256_mul_ps(UL, vwx0), wz0);
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_mul_ps(DL, vwx1), wz0));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_mul_ps(UR, vwx0), wz1));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_mul_ps(DR, vwx1), wz1));
+		return sum;
+	}
+
+	//Turns 8 registers of one element for 8 vertices into 8 registers of one whole vertex each
+	static inline void Transpose8(__m256& r0, __m256& r1, __m256& r2, __m256& r3,
+		__m256& r4, __m256& r5, __m256& r6, __m256& r7)
+	{
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		__m256 t1 = _mm256_unpackhi_ps(r0, r1);
+		__m256 t2 = _mm256_unpacklo_ps(r2, r3);
+		__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+		__m256 t4 = _mm256_unpacklo_ps(r4, r5);
+		__m256 t5 = _mm256_unpackhi_ps(r4, r5);
+		__m256 t6 = _mm256_unpacklo_ps(r6, r7);
+		__m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+		__m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+		__m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+		__m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+		r0 = _mm256_permute2f128_ps(s0, s4, 0x20);
+		r1 = _mm256_permute2f128_ps(s1, s5, 0x20);
+		r2 = _mm256_permute2f128_ps(s2, s6, 0x20);
+		r3 = _mm256_permute2f128_ps(s3, s7, 0x20);
+		r4 = _mm256_permute2f128_ps(s0, s4, 0x31);
+		r5 = _mm256_permute2f128_ps(s1, s5, 0x31);
+		r6 = _mm256_permute2f128_ps(s2, s6, 0x31);
+		r7 = _mm256_permute2f128_ps(s3, s7, 0x31);
+	}
+
+	void SampleRows_AVX2(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+		int rowBegin, int rowEnd, TerrainHeightGrid& heights)
+	{
+		const int cellScale = source.width - 1;
+		const __m256 vCellScale = _mm256_set1_ps((float)cellScale);
+
+		for (int u = rowBegin; u < rowEnd; u++) {
+			float xScaled = uvUs[u] * (float)cellScale;
+			int realX = (int)xScaled;
+			int realXPlus1 = (int)std::min(std::max(xScaled + 1, 0.0f), (float)cellScale);
+			float wx0 = realX == realXPlus1 ? 1.0f : (float)realXPlus1 - xScaled;
+			float wx1 = realX == realXPlus1 ? 0.0f : xScaled - (float)realX;
+
+			const float* rowX0 = source.data + realX * source.width;
+			const float* rowX1 = source.data + realXPlus1 * source.width;
+
+			int v = 0;
+			for (; v + 8 <= HeightGridWidth; v += 8) {
+				__m256 height = SampleHeight8(rowX0, rowX1, wx0, wx1, _mm256_loadu_ps(uvVs + v), vCellScale);
+				_mm256_storeu_ps(&heights[u * HeightGridWidth + v], height);
+			}
+			SampleRowTail(source, uvUs, uvVs, u, v, heights);
+		}
+	}
+
+	void BuildRows_AVX2(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+		float heightScale, float widthScale, int rowBegin, int rowEnd, TerrainMeshVertices& vertices)
+	{
+		const int numCells = NumCells;
+		const float hDiff = uvUs[3] - uvUs[1];
+		const __m256 vhDiff = _mm256_set1_ps(hDiff);
+		const __m256 vHeightScale = _mm256_set1_ps(heightScale);
+		const __m256 vWidthScale = _mm256_set1_ps(widthScale);
+		const __m256 normalY = _mm256_div_ps(_mm256_set1_ps(16.0f), vhDiff);
+		const __m256 normalYSquared = _mm256_mul_ps(normalY, normalY);
+
+		for (int i = rowBegin; i < rowEnd; i++) {
+			const float* rowMinus = &heights[(i + 0) * HeightGridWidth];
+			const float* row = &heights[(i + 1) * HeightGridWidth];
+			const float* rowPlus = &heights[(i + 2) * HeightGridWidth];
+
+			const float uvU = uvUs[(i + 1)];
+			const __m256 vuvU = _mm256_set1_ps(uvU);
+			const __m256 posX = _mm256_set1_ps(uvU * widthScale);
+
+			int j = 0;
+			for (; j + 8 <= numCells + 1; j += 8) {
+				__m256 uvV = _mm256_loadu_ps(uvVs + j + 1);
+
+				__m256 height = _mm256_loadu_ps(row + j + 1);
+				__m256 um = _mm256_loadu_ps(rowMinus + j + 1);
+				__m256 up = _mm256_loadu_ps(rowPlus + j + 1);
+				__m256 vm = _mm256_loadu_ps(row + j);
+				__m256 vp = _mm256_loadu_ps(row + j + 2);
+
+				__m256 nx = _mm256_div_ps(_mm256_div_ps(_mm256_sub_ps(vm, vp), vhDiff), vhDiff);
+				__m256 nz = _mm256_div_ps(_mm256_sub_ps(um, up), vhDiff);
+				__m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), normalYSquared), _mm256_mul_ps(nz, nz));
+				__m256 invLength = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(lengthSquared));
+
+				__m256 e0 = posX;
+				__m256 e1 = _mm256_mul_ps(height, vHeightScale);
+				__m256 e2 = _mm256_mul_ps(uvV, vWidthScale);
+				__m256 e3 = _mm256_mul_ps(nx, invLength);
+				__m256 e4 = _mm256_mul_ps(normalY, invLength);
+				__m256 e5 = _mm256_mul_ps(nz, invLength);
+				__m256 e6 = vuvU;
+				__m256 e7 = uvV;
+				Transpose8(e0, e1, e2, e3, e4, e5, e6, e7);
+
+				//a vertex is exactly one register wide
+				float* vert = &vertices[(i * (numCells + 1) + j) * vertElementCount];
+				_mm256_storeu_ps(vert + 0, e0);
+				_mm256_storeu_ps(vert + 8, e1);
+				_mm256_storeu_ps(vert + 16, e2);
+				_mm256_storeu_ps(vert + 24, e3);
+				_mm256_storeu_ps(vert + 32, e4);
+				_mm256_storeu_ps(vert + 40, e5);
+				_mm256_storeu_ps(vert + 48, e6);
+				_mm256_storeu_ps(vert + 56, e7);
+			}
+			BuildRowTail(heights, uvUs, uvVs, heightScale, widthScale, i, j, vertices);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "TerrainChunkBuilder.h"
+
+//Per instruction set versions of the chunk building kernels, only TerrainChunkBuilder.cpp should
+//call these, everything else goes through the dispatching functions.
+//Like FastNoiseSIMD, every instruction set lives in its own file so it can get its own compiler
+//flags, the AVX2 file needs -mavx2 (or /arch:AVX2) while the rest of the program doesn't.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TERRAIN_BUILDER_COMPILE_SSE41
+#define TERRAIN_BUILDER_COMPILE_AVX2
+#endif
+
+namespace TerrainChunkBuilderInternal {
+
+	//single sample, matches GraphUser::SampleHeightMap
+	float SampleHeight(TerrainHeightSource source, float x, float z);
+
+	//grid samples [vBegin, HeightGridWidth) of row u, for finishing rows the vector loops didn't
+	void SampleRowTail(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+		int u, int vBegin, TerrainHeightGrid& heights);
+	//vertices [jBegin, NumCells + 1) of row i
+	void BuildRowTail(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+		float heightScale, float widthScale, int i, int jBegin, TerrainMeshVertices& vertices);
+
+	void SampleRows_Scalar(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+		int rowBegin, int rowEnd, TerrainHeightGrid& heights);
+	void BuildRows_Scalar(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+		float heightScale, float widthScale, int rowBegin, int rowEnd, TerrainMeshVertices& vertices);
+
+#ifdef TERRAIN_BUILDER_COMPILE_SSE41
+	void SampleRows_SSE41(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+		int rowBegin, int rowEnd, TerrainHeightGrid& heights);
+	void BuildRows_SSE41(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+		float heightScale, float widthScale, int rowBegin, int rowEnd, TerrainMeshVertices& vertices);
+#endif
+
+#ifdef TERRAIN_BUILDER_COMPILE_AVX2
+	void SampleRows_AVX2(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+		int rowBegin, int rowEnd, TerrainHeightGrid& heights);
+	void BuildRows_AVX2(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+		float heightScale, float widthScale, int rowBegin, int rowEnd, TerrainMeshVertices& vertices);
+#endif
+
+}
@@ -0,0 +1,139 @@
+#include "TerrainChunkBuilder_internal.h"
+
+#ifdef TERRAIN_BUILDER_COMPILE_SSE41
+
+#include <algorithm>
+
+#include <smmintrin.h>
+
+namespace TerrainChunkBuilderInternal {
+
+	//Bilinear samples of 4 points that all share the x coordinate, see SampleHeight.
+	//The scalar code divides by the cell size, which is always 1, and special cases the image edge,
+	//here the edge just gets weights of 1 and 0 instead. Products are summed in the same order
+	static inline __m128 SampleHeight4(const float* rowX0, const float* rowX1,
+		float wx0, float wx1, __m128 z, __m128 cellScale)
+	{
+		__m128 zScaled = _mm_mul_ps(z, cellScale);
+		__m128i realZ = _mm_cvttps_epi32(zScaled);
+		__m128i realZPlus1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(zScaled, _mm_set1_ps(1.0f)), _mm_setzero_ps()), cellScale));
+
+		__m128 fRealZ = _mm_cvtepi32_ps(realZ);
+		__m128 fRealZPlus1 = _mm_cvtepi32_ps(realZPlus1);
+		__m128 atEdge = _mm_castsi128_ps(_mm_cmpeq_epi32(realZ, realZPlus1));
+		__m128 wz0 = _mm_blendv_ps(_mm_sub_ps(fRealZPlus1, zScaled), _mm_set1_ps(1.0f), atEdge);
+		__m128 wz1 = _mm_blendv_ps(_mm_sub_ps(zScaled, fRealZ), _mm_setzero_ps(), atEdge);
+
+		int z0[4], z1[4];
+		z0[0] = _mm_cvtsi128_si32(realZ);
+		z0[1] = _mm_extract_epi32(realZ, 1);
+		z0[2] = _mm_extract_epi32(realZ, 2);
+		z0[3] = _mm_extract_epi32(realZ, 3);
+		z1[0] = _mm_cvtsi128_si32(realZPlus1);
+		z1[1] = _mm_extract_epi32(realZPlus1, 1);
+		z1[2] = _mm_extract_epi32(realZPlus1, 2);
+		z1[3] = _mm_extract_epi32(realZPlus1, 3);
+
+		__m128 UL = _mm_setr_ps(rowX0[z0[0]], rowX0[z0[1]], rowX0[z0[2]], rowX0[z0[3]]);
+		__m128 UR = _mm_setr_ps(rowX0[z1[0]], rowX0[z1[1]], rowX0[z1[2]], rowX0[z1[3]]);
+		__m128 DL = _mm_setr_ps(rowX1[z0[0]], rowX1[z0[1]], rowX1[z0[2]], rowX1[z0[3]]);
+		__m128 DR = _mm_setr_ps(rowX1[z1[0]], rowX1[z1[1]], rowX1[z1[2]], rowX1[z1[3]]);
+
+		__m128 vwx0 = _mm_set1_ps(wx0);
+		__m128 vwx1 = _mm_set1_ps(wx1);
+		__m128 sum = _mm_mul_ps(_mm_mul_ps(UL, vwx0), wz0);
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_mul_ps(DL, vwx1), wz0));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_mul_ps(UR, vwx0), wz1));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_mul_ps(DR, vwx1), wz1));
+		return sum;
+	}
+
+	void SampleRows_SSE41(TerrainHeightSource source, const float* uvUs, const float* uvVs,
+		int rowBegin, int rowEnd, TerrainHeightGrid& heights)
+	{
+		const int cellScale = source.width - 1;
+		const __m128 vCellScale = _mm_set1_ps((float)cellScale);
+
+		for (int u = rowBegin; u < rowEnd; u++) {
+			//x is the same for the whole row, so its rows and weights are worked out once
+			float xScaled = uvUs[u] * (float)cellScale;
+			int realX = (int)xScaled;
+			int realXPlus1 = (int)std::min(std::max(xScaled + 1, 0.0f), (float)cellScale);
+			float wx0 = realX == realXPlus1 ? 1.0f : (float)realXPlus1 - xScaled;
+			float wx1 = realX == realXPlus1 ? 0.0f : xScaled - (float)realX;
+
+			const float* rowX0 = source.data + realX * source.width;
+			const float* rowX1 = source.data + realXPlus1 * source.width;
+
+			int v = 0;
+			for (; v + 4 <= HeightGridWidth; v += 4) {
+				__m128 height = SampleHeight4(rowX0, rowX1, wx0, wx1, _mm_loadu_ps(uvVs + v), vCellScale);
+				_mm_storeu_ps(&heights[u * HeightGridWidth + v], height);
+			}
+			SampleRowTail(source, uvUs, uvVs, u, v, heights);
+		}
+	}
+
+	void BuildRows_SSE41(const TerrainHeightGrid& heights, const float* uvUs, const float* uvVs,
+		float heightScale, float widthScale, int rowBegin, int rowEnd, TerrainMeshVertices& vertices)
+	{
+		const int numCells = NumCells;
+		const float hDiff = uvUs[3] - uvUs[1];
+		const __m128 vhDiff = _mm_set1_ps(hDiff);
+		const __m128 vHeightScale = _mm_set1_ps(heightScale);
+		const __m128 vWidthScale = _mm_set1_ps(widthScale);
+		const __m128 normalY = _mm_div_ps(_mm_set1_ps(16.0f), vhDiff);
+		const __m128 normalYSquared = _mm_mul_ps(normalY, normalY);
+
+		for (int i = rowBegin; i < rowEnd; i++) {
+			const float* rowMinus = &heights[(i + 0) * HeightGridWidth];
+			const float* row = &heights[(i + 1) * HeightGridWidth];
+			const float* rowPlus = &heights[(i + 2) * HeightGridWidth];
+
+			const float uvU = uvUs[(i + 1)];
+			const __m128 vuvU = _mm_set1_ps(uvU);
+			const __m128 posX = _mm_set1_ps(uvU * widthScale);
+
+			int j = 0;
+			for (; j + 4 <= numCells + 1; j += 4) {
+				__m128 uvV = _mm_loadu_ps(uvVs + j + 1);
+
+				__m128 height = _mm_loadu_ps(row + j + 1);
+				__m128 um = _mm_loadu_ps(rowMinus + j + 1);
+				__m128 up = _mm_loadu_ps(rowPlus + j + 1);
+				__m128 vm = _mm_loadu_ps(row + j);
+				__m128 vp = _mm_loadu_ps(row + j + 2);
+
+				__m128 nx = _mm_div_ps(_mm_div_ps(_mm_sub_ps(vm, vp), vhDiff), vhDiff);
+				__m128 nz = _mm_div_ps(_mm_sub_ps(um, up), vhDiff);
+				__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), normalYSquared), _mm_mul_ps(nz, nz));
+				__m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSquared));
+
+				//one register per vertex element, transposed into interleaved vertices below
+				__m128 e0 = posX;
+				__m128 e1 = _mm_mul_ps(height, vHeightScale);
+				__m128 e2 = _mm_mul_ps(uvV, vWidthScale);
+				__m128 e3 = _mm_mul_ps(nx, invLength);
+				__m128 e4 = _mm_mul_ps(normalY, invLength);
+				__m128 e5 = _mm_mul_ps(nz, invLength);
+				__m128 e6 = vuvU;
+				__m128 e7 = uvV;
+				_MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+				_MM_TRANSPOSE4_PS(e4, e5, e6, e7);
+
+				float* vert = &vertices[(i * (numCells + 1) + j) * vertElementCount];
+				_mm_storeu_ps(vert + 0, e0);
+				_mm_storeu_ps(vert + 4, e4);
+				_mm_storeu_ps(vert + 8, e1);
+				_mm_storeu_ps(vert + 12, e5);
+				_mm_storeu_ps(vert + 16, e2);
+				_mm_storeu_ps(vert + 20, e6);
+				_mm_storeu_ps(vert + 24, e3);
+				_mm_storeu_ps(vert + 28, e7);
+			}
+			BuildRowTail(heights, uvUs, uvVs, heightScale, widthScale, i, j, vertices);
+		}
+	}
+}
+
+#endif
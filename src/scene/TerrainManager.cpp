@@ -13,90 +13,99 @@
 
 constexpr auto TerrainSettingsFileName = "terrain_settings.json";
 
+//chunks requested longer ago than this go ahead of everything but the chunk under the camera
+constexpr auto ChunkCreationDeadline = std::chrono::milliseconds(1000);
+
 TerrainCreationData::TerrainCreationData(
 	int numCells, int maxLevels, int sourceImageResolution, float heightScale, TerrainCoordinateData coord) :
 	numCells(numCells),
 	maxLevels(maxLevels),
 	sourceImageResolution(sourceImageResolution),
 	heightScale(heightScale),
-	coord(coord)
+	coord(coord),
+	requestTime(std::chrono::steady_clock::now()),
+	cancelToken(job::CancellationToken::Create())
 {
 }
 
-void TerrainCreationWorker(TerrainManager* man) {
-
-	while (man->isCreatingTerrain) {
+//One task is added per requested chunk, each builds whichever pending chunk has the highest priority when it starts
+void TerrainCreationTask(TerrainManager* man) {
+	if (man->isCreatingTerrain) {
+		glm::vec3 cameraPos;
+		auto data = man->PopHighestPriorityChunk(cameraPos);
+		if (data.has_value())
 		{
-			std::unique_lock<std::mutex> lock(man->workerMutex);
-			man->workerConditionVariable.wait(lock);
-		}
+			auto terrain = std::make_unique<Terrain>(man->renderer, man->taskManager,
+				man->chunkBuffer,
+				man->protoGraph, data->numCells, data->maxLevels,
+				data->heightScale, data->coord, data->cancelToken);
 
-		while (!man->terrainCreationWork.empty()) {
-			auto data = man->terrainCreationWork.pop_if();
-			if (data.has_value())
+			if (man->CommitChunk(*data))
 			{
-				glm::vec3 center = glm::vec3((data)->coord.pos.x, man->curCameraPos.y, (data)->coord.pos.y);
-				float distanceToViewer = glm::distance(man->curCameraPos, center);
-				if (distanceToViewer < man->settings.viewDistance * man->settings.width * 1.5)
-				{
-
-
-					auto terrain = std::make_unique<Terrain>(man->renderer,
-						man->chunkBuffer,
-						man->protoGraph, data->numCells, data->maxLevels,
-						data->heightScale, data->coord);
+				// std::vector<RGBA_pixel>* imgData = terrain->LoadSplatMapFromGenerator();
 
-					// std::vector<RGBA_pixel>* imgData = terrain->LoadSplatMapFromGenerator();
+				// terrain->terrainSplatMap = man->resourceMan.
+				// 	texManager.loadTextureFromRGBAPixelData(
+				// 		data->sourceImageResolution + 1,
+				// 		data->sourceImageResolution + 1, imgData);
 
-					// terrain->terrainSplatMap = man->resourceMan.
-					// 	texManager.loadTextureFromRGBAPixelData(
-					// 		data->sourceImageResolution + 1,
-					// 		data->sourceImageResolution + 1, imgData);
+				terrain->InitTerrain(cameraPos, man->terrainVulkanTextureArrayAlbedo, 
+				man->terrainVulkanTextureArrayRoughness, man->terrainVulkanTextureArrayMetallic
+				, man->terrainVulkanTextureArrayNormal);
 
-					terrain->InitTerrain(man->curCameraPos, man->terrainVulkanTextureArrayAlbedo, 
-					man->terrainVulkanTextureArrayRoughness, man->terrainVulkanTextureArrayMetallic
-					, man->terrainVulkanTextureArrayNormal);
-
-					InstancedSceneObject::InstanceData water;
-					water.pos = glm::vec3((data)->coord.pos.x, 0, (data)->coord.pos.y);
-					water.rot = glm::vec3(0, 0, 0);
-					water.scale = man->settings.width;
-					man->instancedWaters->AddInstance(water);
-
-					{
-						std::lock_guard<std::mutex> lk(man->terrain_mutex);
-						man->terrains.push_back(std::move(terrain));
-					}
+				InstancedSceneObject::InstanceData water;
+				water.pos = glm::vec3((data)->coord.pos.x, 0, (data)->coord.pos.y);
+				water.rot = glm::vec3(0, 0, 0);
+				water.scale = man->settings.width;
+				terrain->waterInstance = man->instancedWaters->AddInstance(water);
 
+				{
+					std::lock_guard<std::mutex> lk(man->terrain_mutex);
+					man->terrains.push_back(std::move(terrain));
 				}
 			}
-			//break out of loop if work shouldn't be continued
-			if (!man->isCreatingTerrain)
-				return;
 		}
 	}
-
+	man->terrainCreationTasks--;
 }
 
 TerrainChunkBuffer::TerrainChunkBuffer(VulkanRenderer& renderer, int count,
 	TerrainManager& man) :
 	renderer(renderer), man(man),
-	vert_buffer(renderer.device, vertCount * count, vertElementCount),
-	index_buffer(renderer.device, indCount * count),
-	vert_staging(renderer.device, sizeof(TerrainMeshVertices) * count),
-	index_staging(renderer.device, sizeof(TerrainMeshIndices) * count)
+	vert_buffer(renderer.device, count, vert_size / sizeof(float)), //one "vertex" per chunk
+	index_buffer(renderer.device, indCount, TerrainIndexType),
+	indexBufferReady(std::make_shared<bool>(false)),
+	vert_staging(renderer.device, vert_size * StagingRingSlots),
+	stagingSlots(std::make_unique<StagingSlot[]>(StagingRingSlots)),
+	chunkCapacity(count),
+	chunkGenerations(std::make_unique<std::atomic<uint32_t>[]>(count)),
+	chunkStates(std::make_unique<std::atomic<ChunkState>[]>(count)),
+	chunkStagingSlots(std::make_unique<int[]>(count)),
+	freeChunks(static_cast<uint32_t>(count)),
+	writtenChunks(StagingRingSlots)
 {
 	//vert_buffer.CreateVertexBuffer(vertCount * count, vertElementCount);
-	//index_buffer.CreateIndexBuffer(indCount * count);
 
-	//vert_staging.CreateDataBuffer(sizeof(TerrainMeshVertices) * count);
-	vert_staging_ptr = (TerrainMeshVertices*)vert_staging.buffer.allocationInfo.pMappedData;
+	vert_staging_ptr = (TerrainChunkVertices*)vert_staging.buffer.allocationInfo.pMappedData;
+
+	//the indices never change, so they're uploaded once here instead of with every chunk
+	auto indices = std::make_unique<TerrainMeshIndices>();
+	BuildTerrainIndices(*indices);
+	auto index_staging = std::make_shared<VulkanBufferStagingIndex>(
+		renderer.device, indCount, indices->data(), TerrainIndexType);
 
-	//index_staging.CreateDataBuffer(sizeof(TerrainMeshIndices) * count);
-	index_staging_ptr = (TerrainMeshIndices*)index_staging.buffer.allocationInfo.pMappedData;
+	VkBuffer index = index_buffer.buffer.buffer;
+	VkBuffer index_s = index_staging->buffer.buffer;
+	renderer.SubmitWork(WorkType::transfer,
+		[=](const VkCommandBuffer cmdBuf) {
+		VkBufferCopy copyRegion = initializers::bufferCopyCreate(sizeof(TerrainMeshIndices), 0, 0);
+		vkCmdCopyBuffer(cmdBuf, index_s, index, 1, &copyRegion);
+	}, {}, {}, { index_staging }, { indexBufferReady });
 
-	chunkStates.resize(count, TerrainChunkBuffer::ChunkState::free);
 	for (int i = 0; i < count; i++) {
+		chunkGenerations[i] = 0;
+		chunkStates[i] = ChunkState::allocated;
+		chunkStagingSlots[i] = -1;
 		chunkReadySignals.push_back(std::make_shared<bool>(false));
 	}
 }
@@ -109,110 +118,149 @@ TerrainChunkBuffer::~TerrainChunkBuffer() {
 }
 
 
-int TerrainChunkBuffer::Allocate() {
-	std::lock_guard<std::mutex> guard(lock);
-	for (int i = 0; i < chunkStates.size(); i++) {
-		if (chunkStates.at(i) == TerrainChunkBuffer::ChunkState::free) {
-			chunkStates.at(i) = TerrainChunkBuffer::ChunkState::allocated;
-			chunkCount++;
-			return i;
-		}
-	}
-	//should never reach here!
-	throw std::runtime_error("Ran out of terrain chunkStates!");
+//Freed chunk indices are reused before new ones, so the handle's index never goes past the buffer
+TerrainChunkHandle TerrainChunkBuffer::Allocate() {
+	auto index = freeChunks.pop();
+	if (!index.has_value())
+		throw std::runtime_error("Ran out of terrain chunkStates!");
+
+	TerrainChunkHandle chunk;
+	chunk.index = *index;
+	chunk.generation = chunkGenerations[chunk.index].fetch_add(1) + 1;
+	chunkStates[chunk.index] = ChunkState::allocated;
+
+	chunkCount++;
+	return chunk;
 }
 
 
-void TerrainChunkBuffer::Free(int index) {
-	std::lock_guard<std::mutex> guard(lock);
-	if (chunkStates.at(index) == TerrainChunkBuffer::ChunkState::free)
+void TerrainChunkBuffer::Free(TerrainChunkHandle chunk) {
+	uint32_t generation = chunk.generation;
+	if (chunk.index >= static_cast<uint32_t>(chunkCapacity)
+		|| !chunkGenerations[chunk.index].compare_exchange_strong(generation, generation + 1))
 		throw std::runtime_error("Trying to free a free chunk! What?");
-	chunkStates.at(index) = TerrainChunkBuffer::ChunkState::free;
 	chunkCount--;
+
+	freeChunks.push(chunk.index);
 }
 
-TerrainChunkBuffer::ChunkState TerrainChunkBuffer::GetChunkState(int index) {
-	std::lock_guard<std::mutex> guard(lock);
-	return chunkStates.at(index);
+TerrainChunkBuffer::ChunkState TerrainChunkBuffer::GetChunkState(TerrainChunkHandle chunk) {
+	if (chunk.index >= static_cast<uint32_t>(chunkCapacity) || chunkGenerations[chunk.index] != chunk.generation)
+		throw std::runtime_error("Stale terrain chunk handle!");
+	return chunkStates[chunk.index];
 }
 
-void TerrainChunkBuffer::SetChunkWritten(int index) {
-	std::lock_guard<std::mutex> guard(lock);
-	chunkStates.at(index) = TerrainChunkBuffer::ChunkState::written;
+void TerrainChunkBuffer::SetChunkWritten(TerrainChunkHandle chunk) {
+	chunkStates[chunk.index] = ChunkState::written;
+	if (!writtenChunks.push(WrittenChunk{ chunk, chunkStagingSlots[chunk.index] }))
+		throw std::runtime_error("Written terrain chunk list is full!");
 }
 
-Signal TerrainChunkBuffer::GetChunkSignal(int index) {
-	std::lock_guard<std::mutex> guard(lock);
-	return chunkReadySignals.at(index);
+Signal TerrainChunkBuffer::GetChunkSignal(TerrainChunkHandle chunk) {
+	return chunkReadySignals.at(chunk.index);
 }
 
 int TerrainChunkBuffer::ActiveQuadCount() {
 	return chunkCount;
 }
 
-void TerrainChunkBuffer::UpdateChunks() {
-	std::lock_guard<std::mutex> guard(lock);
-
-	std::vector<VkBufferCopy> vertexCopyRegions;
-	std::vector<VkBufferCopy> indexCopyRegions;
-
-	std::vector<Signal> signals;
-
-	for (int i = 0; i < chunkStates.size(); i++) {
-		switch (chunkStates.at(i)) {
-		case(TerrainChunkBuffer::ChunkState::free): break;
-
-		case(TerrainChunkBuffer::ChunkState::allocated): break;
-
-			//needs to have its data uploaded
-		case(TerrainChunkBuffer::ChunkState::written):
-
-			vertexCopyRegions.push_back(initializers::bufferCopyCreate(vert_size, i * vert_size, i * vert_size));
-			indexCopyRegions.push_back(initializers::bufferCopyCreate(ind_size, i * ind_size, i * ind_size));
-
-			//*chunkReadySignals.at(i) = false;
-
-			//signals.push_back(chunkReadySignals.at(i));
-			chunkStates.at(i) = TerrainChunkBuffer::ChunkState::ready;
+//Slots free up in the order they were handed out, a slot still being written holds back the ones after it
+void TerrainChunkBuffer::ReclaimStagingSlots() {
+	std::lock_guard<std::mutex> guard(stagingLock);
+	while (stagingUsed > 0) {
+		StagingSlot& slot = stagingSlots[stagingTail];
+		if (slot.inUse && (slot.uploaded == nullptr || !*slot.uploaded))
 			break;
 
-			//data is on gpu, ready to draw
-		case(TerrainChunkBuffer::ChunkState::ready): break;
-
+		slot.inUse = false;
+		slot.uploaded = nullptr;
+		stagingTail = (stagingTail + 1) % StagingRingSlots;
+		stagingUsed--;
+	}
+}
 
+//Copies chunks written since last frame, up to ChunkUploadsPerFrame, the rest stay queued.
+//Chunks next to each other in both the staging ring and the vertex buffer share one copy region
+void TerrainChunkBuffer::UpdateChunks() {
+	ReclaimStagingSlots();
+
+	WrittenChunk written[ChunkUploadsPerFrame];
+	size_t writtenCount = writtenChunks.pop_n(written, ChunkUploadsPerFrame);
+	if (writtenCount == 0)
+		return;
+
+	//every slot copied this frame is reclaimed once this transfer's fence signals
+	Signal uploaded = std::make_shared<bool>(false);
+
+	struct ChunkCopy {
+		uint32_t chunk;
+		int slot;
+	};
+	FrameVector<ChunkCopy> copies(renderer.frameAllocator);
+	for (size_t w = 0; w < writtenCount; w++) {
+		TerrainChunkHandle chunk = written[w].chunk;
+		int slot = written[w].slot;
+		if (chunkGenerations[chunk.index] != chunk.generation) {
+			stagingSlots[slot].inUse = false; //freed before it uploaded, nothing reads the slot anymore
+			continue;
 		}
 
+		stagingSlots[slot].uploaded = uploaded;
+		copies.push_back({ chunk.index, slot });
+
+		ChunkState expected = ChunkState::written;
+		chunkStates[chunk.index].compare_exchange_strong(expected, ChunkState::ready);
 	}
+	if (copies.size() == 0)
+		return;
+
+	std::sort(copies.begin(), copies.end(),
+		[](const ChunkCopy& a, const ChunkCopy& b) { return a.chunk < b.chunk; });
+
+	FrameVector<VkBufferCopy> vertexCopyRegions(renderer.frameAllocator);
+	size_t runStart = 0;
+	for (size_t c = 1; c <= copies.size(); c++) {
+		if (c < copies.size() && copies[c].chunk == copies[c - 1].chunk + 1 && copies[c].slot == copies[c - 1].slot + 1)
+			continue;
+
+		VkDeviceSize runLength = static_cast<VkDeviceSize>(c - runStart);
+		vertexCopyRegions.push_back(initializers::bufferCopyCreate(vert_size * runLength,
+			copies[runStart].slot * vert_size, copies[runStart].chunk * vert_size));
+		runStart = c;
+	}
+
 	VkBuffer vert = vert_buffer.buffer.buffer;
 	VkBuffer vert_s = vert_staging.buffer.buffer;
-	VkBuffer index = index_buffer.buffer.buffer;
-	VkBuffer index_s = index_staging.buffer.buffer;
-
-	if (vertexCopyRegions.size() > 0) {
-		renderer.SubmitWork(WorkType::transfer,
-			[=](const VkCommandBuffer cmdBuf) {
-			std::vector<VkBufferCopy> vRegions = vertexCopyRegions;
-			std::vector<VkBufferCopy> iRegions = indexCopyRegions;
-
-			vkCmdCopyBuffer(cmdBuf, vert_s, vert,
-				vRegions.size(), vRegions.data());
-			vkCmdCopyBuffer(cmdBuf, index_s, index,
-				iRegions.size(), iRegions.data());
-		}, {}, {}, {}, std::move(signals));
-	}
 
+	renderer.SubmitWork(WorkType::transfer,
+		[=](const VkCommandBuffer cmdBuf) {
+		//the regions live in this frame's scratch memory, the work is recorded before the frame ends
+		vkCmdCopyBuffer(cmdBuf, vert_s, vert,
+			static_cast<uint32_t>(vertexCopyRegions.size()), vertexCopyRegions.data());
+	}, {}, {}, {}, { uploaded });
 }
 
-TerrainMeshVertices* TerrainChunkBuffer::GetDeviceVertexBufferPtr(int index) {
-	return vert_staging_ptr + index;
-}
-TerrainMeshIndices* TerrainChunkBuffer::GetDeviceIndexBufferPtr(int index) {
-	return index_staging_ptr + index;
+TerrainChunkVertices* TerrainChunkBuffer::BeginChunkWrite(TerrainChunkHandle chunk) {
+	int slot;
+	{
+		std::lock_guard<std::mutex> guard(stagingLock);
+		if (stagingUsed >= StagingRingSlots)
+			return nullptr;
+
+		slot = stagingHead;
+		stagingSlots[slot].inUse = true;
+		stagingHead = (stagingHead + 1) % StagingRingSlots;
+		stagingUsed++;
+	}
+
+	chunkStagingSlots[chunk.index] = slot;
+	return vert_staging_ptr + slot;
 }
 
 TerrainManager::TerrainManager(InternalGraph::GraphPrototype& protoGraph,
-	Resource::ResourceManager& resourceMan, VulkanRenderer& renderer)
-	: protoGraph(protoGraph), renderer(renderer), resourceMan(resourceMan),
+	Resource::ResourceManager& resourceMan, VulkanRenderer& renderer,
+	job::TaskManager& taskManager)
+	: protoGraph(protoGraph), renderer(renderer), resourceMan(resourceMan), taskManager(taskManager),
 	chunkBuffer(renderer, MaxChunkCount, *this)
 {
 	if (settings.maxLevels < 0) {
@@ -256,8 +304,6 @@ TerrainManager::TerrainManager(InternalGraph::GraphPrototype& protoGraph,
 
 	instancedWaters->InitInstancedSceneObject();
 
-	StartWorkerThreads();
-
 }
 
 TerrainManager::~TerrainManager()
@@ -265,35 +311,38 @@ TerrainManager::~TerrainManager()
 	CleanUpTerrain();
 }
 
-void TerrainManager::StartWorkerThreads() {
+void TerrainManager::StartTerrainCreation() {
 	isCreatingTerrain = true;
-	for (int i = 0; i < WorkerThreads; i++) {
-		terrainCreationWorkers.push_back(std::thread(TerrainCreationWorker, this));
-	}
 }
 
-void TerrainManager::StopWorkerThreads() {
+void TerrainManager::StopTerrainCreation() {
 	isCreatingTerrain = false;
-	workerConditionVariable.notify_all();
+	{
+		std::lock_guard<std::mutex> lk(pendingChunksLock);
+		for (auto& data : buildingChunks)
+			data.cancelToken.Cancel();
+	}
 
-	for (auto& thread : terrainCreationWorkers) {
-		thread.join();
+	//tasks still queued reference this, they return straight away once run. Help run them
+	//so this doesn't depend on the workers still picking up async work
+	while (terrainCreationTasks.load() > 0) {
+		if (!taskManager.RunAsyncTask())
+			std::this_thread::yield();
 	}
-	terrainCreationWorkers.clear();
+
+	std::lock_guard<std::mutex> lk(pendingChunksLock);
+	pendingChunks.clear();
+	buildingChunks.clear();
 }
 
 
 void TerrainManager::CleanUpTerrain() {
 
-	StopWorkerThreads();
+	StopTerrainCreation();
 	terrains.clear();
 	//instancedWaters->RemoveAllInstances();
 	//instancedWaters->CleanUp();
 	activeTerrains.clear();
-
-
-	//delete terrainQuadPool;
-	//terrainQuadPool = new MemoryPool<TerrainQuadData, 2 * sizeof(TerrainQuadData)>();
 }
 //
 //void TerrainManager::GenerateTerrain(std::shared_ptr<Camera> camera) {
@@ -340,17 +389,23 @@ void TerrainManager::CleanUpTerrain() {
 //	recreateTerrain = false;
 //}
 
-void TerrainManager::UpdateTerrains(glm::vec3 cameraPos)
+void TerrainManager::UpdateTerrains(glm::vec3 cameraPos, glm::vec3 cameraDir)
 {
-	curCameraPos = cameraPos;
+	{
+		std::lock_guard<std::mutex> lk(pendingChunksLock);
+		curCameraPos = cameraPos;
+		curCameraDir = cameraDir;
+	}
 
 	if (recreateTerrain) {
-		StopWorkerThreads();
 		CleanUpTerrain();
-		StartWorkerThreads();
+		StartTerrainCreation();
 		//need to rework to involve remaking the graph
 		//GenerateTerrain(resourceMan, renderer, camera);
 		recreateTerrain = false;
+
+		timeToGroundTimer.StartTimer();
+		isWaitingForGround = true;
 	}
 
 	terrainUpdateTimer.StartTimer();
@@ -374,11 +429,7 @@ void TerrainManager::UpdateTerrains(glm::vec3 cameraPos)
 				if (activeIt != std::end(activeTerrains))
 					activeTerrains.erase(activeIt);
 
-				InstancedSceneObject::InstanceData water;
-				water.pos = glm::vec3((*it)->coordinateData.pos.x, 0, (*it)->coordinateData.pos.y);
-				water.rot = glm::vec3(0, 0, 0);
-				water.scale = settings.width;
-				instancedWaters->RemoveInstance(water);
+				instancedWaters->RemoveInstance((*it)->waterInstance);
 			}
 
 		}
@@ -395,6 +446,30 @@ void TerrainManager::UpdateTerrains(glm::vec3 cameraPos)
 	glm::ivec2 camGrid((int)((cameraPos.x + 0 * settings.width / 2.0) / settings.width),
 		(int)((cameraPos.z + 0 * settings.width / 2.0) / settings.width));
 
+	UpdateTimeToGround(cameraPos, camGrid);
+
+	//drop and cancel requests the camera has since moved away from, so they can be asked for again if it comes back
+	{
+		std::lock_guard<std::mutex> lk(pendingChunksLock);
+		auto outOfRange = [&](const TerrainCreationData& data) {
+			glm::vec3 center = glm::vec3(data.coord.pos.x, cameraPos.y, data.coord.pos.y);
+			return glm::distance(cameraPos, center) > settings.viewDistance * settings.width * 1.5;
+		};
+		auto dropOutOfRange = [&](std::vector<TerrainCreationData>& chunks) {
+			for (auto& data : chunks) {
+				if (outOfRange(data)) {
+					data.cancelToken.Cancel();
+					auto activeIt = std::find(std::begin(activeTerrains), std::end(activeTerrains), data.coord.gridPos);
+					if (activeIt != std::end(activeTerrains))
+						activeTerrains.erase(activeIt);
+				}
+			}
+			chunks.erase(std::remove_if(chunks.begin(), chunks.end(), outOfRange), chunks.end());
+		};
+		dropOutOfRange(pendingChunks);
+		dropOutOfRange(buildingChunks);
+	}
+
 
 	//Log::Debug << "cam grid x: " << camGridX << " z: " << camGridZ << "\n";
 	for (int i = 0; i < settings.viewDistance * 2; i++) {
@@ -435,12 +510,18 @@ void TerrainManager::UpdateTerrains(glm::vec3 cameraPos)
 					settings.sourceImageResolution + 1,
 					terGrid);
 
-				terrain_mutex.lock();
-				terrainCreationWork.push_back(TerrainCreationData(
-					settings.numCells, settings.maxLevels, settings.sourceImageResolution, settings.heightScale,
-					coord));
-				terrain_mutex.unlock();
-				workerConditionVariable.notify_one();
+				{
+					std::lock_guard<std::mutex> lk(pendingChunksLock);
+					pendingChunks.push_back(TerrainCreationData(
+						settings.numCells, settings.maxLevels, settings.sourceImageResolution, settings.heightScale,
+						coord));
+				}
+
+				//async so chunk building never holds up a frame, it soaks up whatever the workers have spare
+				terrainCreationTasks++;
+				job::Task task(job::TaskType::async);
+				task.Add(job::Job([this] { TerrainCreationTask(this); }));
+				taskManager.AddTask(std::move(task));
 
 				/*InstancedSceneObject::InstanceData water;
 				water.pos = glm::vec3(pos.x, 0, pos.y);
@@ -471,7 +552,109 @@ void TerrainManager::UpdateTerrains(glm::vec3 cameraPos)
 	chunkBuffer.UpdateChunks();
 }
 
+//Lower values are built first. The chunk under the camera always goes first, then chunks
+//past their deadline, then the rest by distance, where chunks behind the camera count as
+//up to twice as far away as ones in front of it
+struct ChunkPriority {
+	int tier;
+	float value;
+
+	bool operator<(const ChunkPriority& other) const {
+		return tier != other.tier ? tier < other.tier : value < other.value;
+	}
+};
+
+static ChunkPriority CalcChunkPriority(const TerrainCreationData& data,
+	glm::vec3 cameraPos, glm::vec3 cameraDir, std::chrono::steady_clock::time_point now)
+{
+	glm::vec2 center = data.coord.pos + data.coord.size * 0.5f;
+	glm::vec2 toChunk = center - glm::vec2(cameraPos.x, cameraPos.z);
+	float distance = glm::length(toChunk);
+
+	glm::vec2 halfSize = data.coord.size * 0.5f;
+	if (glm::abs(toChunk.x) <= halfSize.x && glm::abs(toChunk.y) <= halfSize.y)
+		return { 0, distance };
+
+	auto waited = now - data.requestTime;
+	if (waited > ChunkCreationDeadline)
+		return { 1, -std::chrono::duration<float>(waited).count() };
+
+	float facing = 0.0f;
+	glm::vec2 viewDir = glm::vec2(cameraDir.x, cameraDir.z);
+	if (glm::length(viewDir) > 0.0001f && distance > 0.0001f)
+		facing = glm::dot(glm::normalize(viewDir), toChunk / distance);
+	return { 2, distance * (1.5f - 0.5f * facing) };
+}
+
+std::optional<TerrainCreationData> TerrainManager::PopHighestPriorityChunk(glm::vec3& cameraPos) {
+	std::lock_guard<std::mutex> lk(pendingChunksLock);
+	cameraPos = curCameraPos;
+	if (pendingChunks.empty())
+		return {};
+
+	auto now = std::chrono::steady_clock::now();
+	auto best = pendingChunks.begin();
+	ChunkPriority bestPriority = CalcChunkPriority(*best, curCameraPos, curCameraDir, now);
+	for (auto it = pendingChunks.begin() + 1; it != pendingChunks.end(); it++) {
+		ChunkPriority priority = CalcChunkPriority(*it, curCameraPos, curCameraDir, now);
+		if (priority < bestPriority) {
+			best = it;
+			bestPriority = priority;
+		}
+	}
+
+	TerrainCreationData data = *best;
+	*best = pendingChunks.back();
+	pendingChunks.pop_back();
+	buildingChunks.push_back(data);
+	return data;
+}
+
+bool TerrainManager::CommitChunk(const TerrainCreationData& data) {
+	std::lock_guard<std::mutex> lk(pendingChunksLock);
+	auto it = std::find_if(buildingChunks.begin(), buildingChunks.end(), [&](const TerrainCreationData& building) {
+		return building.coord.gridPos == data.coord.gridPos && building.requestTime == data.requestTime;
+	});
+	if (it != buildingChunks.end())
+		buildingChunks.erase(it);
+
+	if (data.cancelToken.IsCancelled()) {
+		cancelledChunkCount++;
+		return false;
+	}
+	return true;
+}
+
+void TerrainManager::UpdateTimeToGround(glm::vec3 cameraPos, glm::ivec2 camGrid) {
+	//moving more than a chunk in one update can only be a teleport
+	glm::ivec2 moved = glm::abs(camGrid - lastCamGrid);
+	lastCamGrid = camGrid;
+	if (moved.x > 1 || moved.y > 1) {
+		timeToGroundTimer.StartTimer();
+		isWaitingForGround = true;
+	}
+
+	if (!isWaitingForGround)
+		return;
+
+	std::lock_guard<std::mutex> lk(terrain_mutex);
+	for (auto& ter : terrains) {
+		glm::vec2 pos = ter->coordinateData.pos;
+		glm::vec2 size = ter->coordinateData.size;
+		if (pos.x <= cameraPos.x && pos.x + size.x >= cameraPos.x &&
+			pos.y <= cameraPos.z && pos.y + size.y >= cameraPos.z &&
+			*ter->terrainVulkanSplatMap->readyToUse == true)
+		{
+			timeToGroundTimer.EndTimer();
+			isWaitingForGround = false;
+			Log::Debug << "Time to ground: " << timeToGroundTimer.GetElapsedTimeMilliSeconds() << "ms\n";
+			return;
+		}
+	}
+}
+
 void TerrainManager::RenderDepthPrePass(VkCommandBuffer commandBuffer){
+	if (*chunkBuffer.indexBufferReady)
 	{
 		std::lock_guard<std::mutex> lock(terrain_mutex);
 		for (auto& ter : terrains) {
@@ -481,6 +664,7 @@ void TerrainManager::RenderDepthPrePass(VkCommandBuffer commandBuffer){
 }
 
 void TerrainManager::RenderTerrain(VkCommandBuffer commandBuffer, bool wireframe) {
+	if (*chunkBuffer.indexBufferReady) //every chunk draws with the shared indices
 	{
 		std::lock_guard<std::mutex> lock(terrain_mutex);
 		for (auto& ter : terrains) {
@@ -515,7 +699,6 @@ void TerrainManager::SaveSettingsToFile() {
 	j["grid_dimentions"] = settings.gridDimentions;
 	j["view_distance"] = settings.viewDistance;
 	j["souce_iamge_resolution"] = settings.sourceImageResolution;
-	j["worker_threads"] = settings.workerThreads;
 
 	std::ofstream outFile(TerrainSettingsFileName);
 	outFile << std::setw(4) << j;
@@ -536,9 +719,6 @@ void TerrainManager::LoadSettingsFromFile() {
 		settings.gridDimentions = j["grid_dimentions"];
 		settings.viewDistance = j["view_distance"];
 		settings.sourceImageResolution = j["souce_iamge_resolution"];
-		settings.workerThreads = j["worker_threads"];
-		if (settings.workerThreads < 1)
-			settings.workerThreads = 1;
 	}
 	else {
 
@@ -575,7 +755,13 @@ void TerrainManager::UpdateTerrainGUI() {
 			recreateTerrain = true;
 		}
 		ImGui::Text("Terrain Count %lu", terrains.size());
-		ImGui::Text("Generating %i Terrains", terrainCreationWork.size());
+		{
+			std::lock_guard<std::mutex> lk(pendingChunksLock);
+			ImGui::Text("Generating %i Terrains, %i Queued", static_cast<int>(buildingChunks.size()),
+				static_cast<int>(pendingChunks.size()));
+			ImGui::Text("Cancelled %i Terrains", cancelledChunkCount);
+		}
+		ImGui::Text("Time to ground after teleport: %lu(mS)", timeToGroundTimer.GetElapsedTimeMilliSeconds());
 		ImGui::Text("Quad Count %i", chunkBuffer.ActiveQuadCount());
 		ImGui::Text("All terrains update Time: %lu(uS)", terrainUpdateTimer.GetElapsedTimeMicroSeconds());
 
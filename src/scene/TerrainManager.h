@@ -7,15 +7,19 @@
 #include <queue>
 #include <atomic>
 #include <unordered_map>
+#include <optional>
+#include <chrono>
 
 //#include <foonathan/memory/container.hpp> // vector, list, list_node_size
 //#include <foonathan/memory/memory_pool.hpp> // memory_pool
 
 #include "../core/CoreTools.h"
 #include "../core/TimeManager.h"
+#include "../core/JobSystem.h"
 
 #include "../util/ConcurrentQueue.h"
-#include "../util/MemoryPool.h"
+#include "../util/IndexFreeList.h"
+#include "../util/RingBuffer.h"
 
 #include "../rendering/Renderer.h"
 
@@ -28,10 +32,18 @@
 
 #include "InstancedSceneObject.h"
 
-constexpr size_t vert_size = sizeof(TerrainMeshVertices);
-constexpr size_t ind_size = sizeof(TerrainMeshIndices);
+constexpr size_t vert_size = sizeof(TerrainChunkVertices);
+static_assert(vert_size % sizeof(float) == 0, "VulkanBufferVertex is sized in floats");
+constexpr VkIndexType TerrainIndexType = VK_INDEX_TYPE_UINT16;
+static_assert(sizeof(TerrainMeshIndex) == sizeof(uint16_t), "TerrainIndexType has to match TerrainMeshIndex");
 constexpr int MaxChunkCount = 2048;
 
+//Chunks are generated into a staging ring instead of a host copy of the whole vertex buffer,
+//so host memory only depends on how many chunks upload per frame, not on MaxChunkCount
+constexpr int ChunkUploadsPerFrame = 32;
+constexpr int StagingRingFrames = 3; //frames of uploads the ring holds while their fences are pending
+constexpr int StagingRingSlots = ChunkUploadsPerFrame * StagingRingFrames;
+
 struct GeneralSettings {
 	bool show_terrain_manager_window = true;
 	float width = 1000;
@@ -41,7 +53,6 @@ struct GeneralSettings {
 	int viewDistance = 1; //terrain chunks to load away from camera;
 	int sourceImageResolution = 256;
 	int numCells = 64; //compile time currently
-	int workerThreads = 1;
 };
 
 struct TerrainTextureNamedHandle {
@@ -57,6 +68,8 @@ struct TerrainCreationData {
 	int sourceImageResolution;
 	float heightScale;
 	TerrainCoordinateData coord;
+	std::chrono::steady_clock::time_point requestTime;
+	job::CancellationToken cancelToken; //cancelled once the camera moves out of range
 
 	TerrainCreationData(
 		int numCells, int maxLevels, int sourceImageResolution, float heightScale, TerrainCoordinateData coord);
@@ -64,53 +77,78 @@ struct TerrainCreationData {
 
 class TerrainManager;
 
+//Allocating, freeing and marking chunks written are lock free, as generators on every worker do
+//them. UpdateChunks only looks at chunks written since the last frame, never the whole pool
 class TerrainChunkBuffer {
 public:
 
-	enum class ChunkState {
-		free,
-		allocated,
-		written,
-		ready,
-	};
+	using ChunkState = TerrainChunkState;
 
 	TerrainChunkBuffer(VulkanRenderer& renderer, int count,
 		TerrainManager& man);
 	~TerrainChunkBuffer();
 
-	int Allocate();
-	void Free(int index);
+	TerrainChunkHandle Allocate();
+	void Free(TerrainChunkHandle chunk);
 
 	void UpdateChunks();
 
 	int ActiveQuadCount();
 
-	ChunkState GetChunkState(int index);
-	void SetChunkWritten(int index);
+	ChunkState GetChunkState(TerrainChunkHandle chunk);
+	void SetChunkWritten(TerrainChunkHandle chunk); //queues the chunk for the next UpdateChunks
 
-	Signal GetChunkSignal(int index);
+	Signal GetChunkSignal(TerrainChunkHandle chunk);
 
-	TerrainMeshVertices* GetDeviceVertexBufferPtr(int index);
-	TerrainMeshIndices* GetDeviceIndexBufferPtr(int index);
+	//Staging ring space for the chunk's vertices, nullptr if the ring is full.
+	//Call SetChunkWritten once the vertices are written, the chunk uploads with the next UpdateChunks
+	TerrainChunkVertices* BeginChunkWrite(TerrainChunkHandle chunk);
 
 	VulkanBufferVertex vert_buffer;
-	VulkanBufferIndex index_buffer;
+	VulkanBufferIndex index_buffer; //one chunk's worth of indices, shared by every chunk
+
+	Signal indexBufferReady;
 
 	TerrainManager& man;
 
 private:
-	std::mutex lock;
-
 	VulkanRenderer& renderer;
 
+	//one chunk per slot, slots are handed out at the head and reclaimed in order from the tail
+	//once the transfer that read them has signalled
+	struct StagingSlot {
+		std::atomic_bool inUse = false;
+		Signal uploaded; //set when the slot's upload is submitted, only touched by UpdateChunks
+	};
+
+	std::mutex stagingLock; //guards the ring's head and tail
 	VulkanBufferData vert_staging;
-	TerrainMeshVertices* vert_staging_ptr;
+	TerrainChunkVertices* vert_staging_ptr;
+	std::unique_ptr<StagingSlot[]> stagingSlots;
+	int stagingHead = 0;
+	int stagingTail = 0;
+	int stagingUsed = 0;
+
+	void ReclaimStagingSlots();
+
+	//Per chunk index. Like SlotMap the generation is odd while the chunk is allocated, stale handles
+	//don't match it. The staging slot is only used by the chunk's generator between
+	//BeginChunkWrite and SetChunkWritten
+	int chunkCapacity;
+	std::unique_ptr<std::atomic<uint32_t>[]> chunkGenerations;
+	std::unique_ptr<std::atomic<ChunkState>[]> chunkStates;
+	std::unique_ptr<int[]> chunkStagingSlots;
+	std::vector<Signal> chunkReadySignals;
 
-	VulkanBufferData index_staging;
-	TerrainMeshIndices* index_staging_ptr;
+	IndexFreeList freeChunks;
 
-	std::vector<ChunkState> chunkStates;
-	std::vector<Signal> chunkReadySignals;
+	//Waiting for upload. An entry owns its staging slot till UpdateChunks drains it, even if the
+	//chunk was freed meanwhile, so there are never more entries than the ring has slots
+	struct WrittenChunk {
+		TerrainChunkHandle chunk;
+		int slot;
+	};
+	RingBuffer<WrittenChunk> writtenChunks;
 
 	std::atomic_int chunkCount = 0;
 };
@@ -119,14 +157,15 @@ class TerrainManager
 {
 public:
 	TerrainManager(InternalGraph::GraphPrototype& protoGraph,
-		Resource::ResourceManager& resourceMan, VulkanRenderer& renderer);
+		Resource::ResourceManager& resourceMan, VulkanRenderer& renderer,
+		job::TaskManager& taskManager);
 	~TerrainManager();
 
 	void CleanUpTerrain();
 
 	//void GenerateTerrain(std::shared_ptr<Camera> camera);
 
-	void UpdateTerrains(glm::vec3 cameraPos);
+	void UpdateTerrains(glm::vec3 cameraPos, glm::vec3 cameraDir);
 
 	void RenderDepthPrePass(VkCommandBuffer commandBuffer);
 	void RenderTerrain(VkCommandBuffer commandBuffer, bool wireframe);
@@ -138,20 +177,31 @@ public:
 
 	Resource::ResourceManager& resourceMan;
 	VulkanRenderer& renderer;
+	job::TaskManager& taskManager;
 
 	TerrainChunkBuffer chunkBuffer;
 
-	std::mutex workerMutex;
-	std::condition_variable workerConditionVariable;
+	//Chunks waiting to be built. Priorities depend on where the camera is now, so they are
+	//worked out when a creation task starts rather than when the chunk is requested
+	std::vector<TerrainCreationData> pendingChunks;
+	std::vector<TerrainCreationData> buildingChunks; //generating their height and splat maps, can still be cancelled
+	std::mutex pendingChunksLock;
+	//cameraPos gets the camera position the priorities were worked out with, read under the lock
+	std::optional<TerrainCreationData> PopHighestPriorityChunk(glm::vec3& cameraPos);
 
-	ConcurrentQueue<TerrainCreationData> terrainCreationWork;
+	//Called before a chunk starts uploading to the gpu, after which it can't be thrown away
+	//Returns false if it was cancelled while generating
+	bool CommitChunk(const TerrainCreationData& data);
+	int cancelledChunkCount = 0;
+	std::atomic_int terrainCreationTasks = 0; //queued or running on the job system
 
-	bool isCreatingTerrain = true; //while condition for worker threads
+	std::atomic_bool isCreatingTerrain = true; //creation tasks do nothing while this is false
 
 	std::mutex terrain_mutex;
 	std::vector<std::unique_ptr<Terrain>> terrains;
 	std::vector<glm::i32vec2> activeTerrains;
-	glm::vec3 curCameraPos;
+	glm::vec3 curCameraPos; //written by UpdateTerrains under pendingChunksLock
+	glm::vec3 curCameraDir = glm::vec3(0, 0, 1);
 	InternalGraph::GraphPrototype& protoGraph;
 	std::shared_ptr<VulkanTexture> terrainVulkanTextureArrayAlbedo;
 	std::shared_ptr<VulkanTexture> terrainVulkanTextureArrayRoughness;
@@ -167,8 +217,8 @@ private:
 	void SaveSettingsToFile();
 	void LoadSettingsFromFile();
 
-	void StartWorkerThreads();
-	void StopWorkerThreads();
+	void StartTerrainCreation();
+	void StopTerrainCreation(); //waits for every creation task to finish
 
 	std::shared_ptr<Mesh> WaterMesh;
 
@@ -177,19 +227,21 @@ private:
 	Resource::Texture::TexID terrainTextureArrayMetallic;
 	Resource::Texture::TexID terrainTextureArrayNormal;
 
-	std::vector<std::thread> terrainCreationWorkers;
-
 	bool recreateTerrain = true;
 	float nextTerrainWidth = 1000;
 	SimpleTimer terrainUpdateTimer;
 
+	//time from a teleport (or recreating the terrain) till the chunk under the camera can be drawn
+	void UpdateTimeToGround(glm::vec3 cameraPos, glm::ivec2 camGrid);
+	SimpleTimer timeToGroundTimer;
+	bool isWaitingForGround = false;
+	glm::ivec2 lastCamGrid = glm::ivec2(0, 0);
+
 	int maxNumQuads = 1; //maximum quads managed by this
 
 	bool drawWindow;
 	int selectedTexture;
 
-	int WorkerThreads = 6;
-
 
 	std::vector<TerrainTextureNamedHandle> terrainTextureHandles;
 
@@ -28,18 +28,30 @@ void TransformManager::Set(int index, TransformData& data) {
 	transformData.Write(index, data);
 }
 
-void TransformManager::CalcMatrices(TransformMatrixData* writeLoc) {
-	for (int i = 0; i < MaxTransformCount; i++) {
-		glm::mat4 transform;
-		glm::mat4 normal;
+void TransformManager::Publish() {
+	transformData.Publish();
+}
+
+void TransformManager::CalcMatrices(job::TaskManager& taskManager, TransformMatrixData* writeLoc) {
+	if (!transformData.Swap())
+		return; //nothing was published since last time
+
+	taskManager.ParallelFor(0, MaxTransformCount, 0, [&](int begin, int end) {
+		transformData.ForEachDirtyRange(begin, end, [&](int rangeBegin, int rangeEnd) {
+			for (int i = rangeBegin; i < rangeEnd; i++) {
+				TransformData data = Get(i);
 
-		transform = glm::translate(transform, Get(i).pos);
-		transform = transform * glm::mat4_cast(Get(i).rot);
-		transform = glm::scale(transform, Get(i).scale);
+				glm::mat4 transform;
+				glm::mat4 normal;
 
-		normal = glm::transpose(glm::inverse(glm::mat3(transform)));
+				transform = glm::translate(transform, data.pos);
+				transform = transform * glm::mat4_cast(data.rot);
+				transform = glm::scale(transform, data.scale);
 
-		writeLoc[i] = { transform, normal };
-	}
+				normal = glm::transpose(glm::inverse(glm::mat3(transform)));
 
+				writeLoc[i] = { transform, normal };
+			}
+		});
+	});
 }
\ No newline at end of file
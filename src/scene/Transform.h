@@ -5,6 +5,8 @@
 
 #include "../rendering/RenderStructs.h"
 
+#include "../core/JobSystem.h"
+
 #include "../util/DoubleBuffer.h"
 
 struct TransformData {
@@ -29,7 +31,11 @@ public:
 	TransformData Get(int index);
 	void Set(int index, TransformData& data);
 
-	void CalcMatrices(TransformMatrixData* writeLoc);
+	//Hands every Set since the last call over to CalcMatrices, call once the frame's updates are done
+	void Publish();
+
+	//Only recalculates transforms that changed since the last call, so writeLoc has to keep its contents
+	void CalcMatrices(job::TaskManager& taskManager, TransformMatrixData* writeLoc);
 
 private:
 	DoubleBufferArray<TransformData, MaxTransformCount> transformData;
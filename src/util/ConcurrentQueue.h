@@ -2,9 +2,13 @@
 
 #include <vector>
 #include <queue>
+#include <deque>
 #include <mutex>
 #include <condition_variable>
 #include <optional>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
 
 
 template <typename T>
@@ -23,21 +27,40 @@ public:
 
 	void push_back(T&& item);
 
+	//Pushes every item in [first, last) under a single lock
+	template <typename Iter>
+	void push_range(Iter first, Iter last);
+
+	//Pops up to max items into out under a single lock, returns how many were popped
+	template <typename OutIter>
+	size_t pop_n(OutIter out, size_t max);
+
+	//Pops everything currently queued into out, returns how many were popped
+	template <typename OutIter>
+	size_t drain_all(OutIter out);
+
+	//Waits till an item is available and pops it, returns nothing if the timeout ran out
+	//or notify_all was called first
+	template <typename Rep, typename Period>
+	std::optional<T> wait_pop(const std::chrono::duration<Rep, Period>& timeout);
+
 	void remove(T& item);
 
 	int size();
 
 	bool empty();
 
+	//Waits till the queue has an item or notify_all is called
 	void wait_on_value();
 
+	//Wakes every waiting thread, even if the queue is empty
 	void notify_all();
 
 private:
 	std::deque<T> m_queue;
-	std::mutex m_mutex;
+	std::mutex m_mutex; //guards m_queue and m_wake_count, waiters wait on it too so pushes can't be missed
 	std::condition_variable m_cond;
-	std::mutex m_cond_lock;
+	size_t m_wake_count = 0; //bumped by notify_all
 };
 
 
@@ -60,9 +83,9 @@ std::optional<T> ConcurrentQueue<T>::pop_if()
 {
 	std::unique_lock<std::mutex> mlock(m_mutex);
 	if (!m_queue.empty()) {
-		auto ret = m_queue.front();
+		std::optional<T> ret(std::move(m_queue.front()));
 		m_queue.pop_front();
-		return std::move(ret);
+		return ret;
 	}
 	return {};
 }
@@ -87,11 +110,68 @@ void ConcurrentQueue<T>::push_back(T&& item)
 
 }
 
+template <typename T>
+template <typename Iter>
+void ConcurrentQueue<T>::push_range(Iter first, Iter last)
+{
+	size_t count = 0;
+	{
+		std::unique_lock<std::mutex> mlock(m_mutex);
+		for (; first != last; ++first, ++count)
+			m_queue.push_back(*first);
+	}
+	if (count == 1)
+		m_cond.notify_one();
+	else if (count > 1)
+		m_cond.notify_all();
+}
+
+template <typename T>
+template <typename OutIter>
+size_t ConcurrentQueue<T>::pop_n(OutIter out, size_t max)
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+	size_t count = std::min(max, m_queue.size());
+	auto end = m_queue.begin() + count;
+	std::move(m_queue.begin(), end, out);
+	m_queue.erase(m_queue.begin(), end);
+	return count;
+}
+
+template <typename T>
+template <typename OutIter>
+size_t ConcurrentQueue<T>::drain_all(OutIter out)
+{
+	std::deque<T> drained;
+	{
+		std::unique_lock<std::mutex> mlock(m_mutex);
+		drained.swap(m_queue);
+	}
+	std::move(drained.begin(), drained.end(), out);
+	return drained.size();
+}
+
+template <typename T>
+template <typename Rep, typename Period>
+std::optional<T> ConcurrentQueue<T>::wait_pop(const std::chrono::duration<Rep, Period>& timeout)
+{
+	std::unique_lock<std::mutex> mlock(m_mutex);
+	size_t wakeCount = m_wake_count;
+	m_cond.wait_for(mlock, timeout, [&] { return !m_queue.empty() || m_wake_count != wakeCount; });
+	if (m_queue.empty())
+		return {};
+
+	std::optional<T> ret(std::move(m_queue.front()));
+	m_queue.pop_front();
+	return ret;
+}
+
 template <typename T>
 void ConcurrentQueue<T>::remove(T& item) {
 	std::unique_lock<std::mutex> mlock(m_mutex);
 	auto iter = std::find(std::begin(m_queue), std::end(m_queue), item);
-	m_queue.erase(iter);
+	if (iter != std::end(m_queue))
+		m_queue.erase(iter);
 }
 
 template <typename T>
@@ -110,12 +190,16 @@ bool ConcurrentQueue<T>::empty()
 
 template <typename T>
 void ConcurrentQueue<T>::wait_on_value() {
-	std::unique_lock<std::mutex> lk(m_cond_lock);
-	m_cond.wait(lk);
+	std::unique_lock<std::mutex> lk(m_mutex);
+	size_t wakeCount = m_wake_count;
+	m_cond.wait(lk, [&] { return !m_queue.empty() || m_wake_count != wakeCount; });
 }
 
 template <typename T>
 void ConcurrentQueue<T>::notify_all() {
-	std::unique_lock<std::mutex> lk(m_cond_lock);
+	{
+		std::unique_lock<std::mutex> lk(m_mutex);
+		m_wake_count++;
+	}
 	m_cond.notify_all();
 }
\ No newline at end of file
@@ -1,12 +1,22 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <array>
+#include <memory>
 #include <mutex>
 #include <atomic>
-#include <shared_mutex>
-
+#include <stdexcept>
+
+//Array of slots shared between writers (game logic) and one reader (usually a gpu upload).
+//Despite the name it keeps three copies: writers fill the back buffer, Publish hands it over
+//through the middle slot with a single atomic exchange and Swap lets the reader pick up the
+//newest one, so neither side ever waits on the other.
+//
+//Write can be called from any number of threads as long as they use different indices,
+//Publish must be called from one thread once those writes are done.
+//Swap, Read, ReadAll and ForEachDirtyRange belong to the reader thread.
 template<typename T, int size>
 class DoubleBufferArray {
 public:
@@ -21,97 +31,192 @@ public:
 	//mostly for transfering to gpu
 	std::array<T, size>* ReadAll();
 
-	//write element at index in current write buffer, wait if swap is inprogress
+	//write element at index in the back buffer and mark it dirty
 	void Write(int index, T data);
 
-	//Swap current read and write buffers, wait for all writes to finish
-	void Swap();
+	//Make everything written so far visible to the reader, never blocks
+	void Publish();
+
+	//Switch the read buffer to the newest published one, returns false if nothing new was published
+	bool Swap();
+
+	//Calls func(rangeBegin, rangeEnd) for each run of slots in [begin, end) that changed between
+	//the previous read buffer and the current one
+	template<typename Func>
+	void ForEachDirtyRange(int begin, int end, Func&& func) const;
 
 private:
+	static constexpr int WordBits = 64;
+	static constexpr int WordCount = (size + WordBits - 1) / WordBits;
+	using DirtyBits = std::array<uint64_t, WordCount>;
+
+	static constexpr uint8_t IndexMask = 0b011;
+	static constexpr uint8_t FreshBit = 0b100; //middle holds a buffer the reader hasn't seen
+
+	struct Buffer {
+		std::array<T, size> items;
+		DirtyBits dirty; //slots changed since the publish before this one was read
+	};
+
+	std::array<std::unique_ptr<Buffer>, 3> buffers;
+
+	//reader side
+	int front = 2;
+	bool frontIsNew = false;
+
+	//shared, index of the buffer in the middle plus FreshBit
+	std::atomic<uint8_t> middle = 1;
 
-	std::atomic_bool which = false;
-	std::array<T, size> a; //which == false, read a, write b;
-	std::array<T, size> b; //which == true,  read b, write a;
-	std::array<T, size>* currentRead; //ptr references
-	std::array<T, size>* currentWrite;//ptr references
-	std::array<bool, size> freeElems;
-	int lastFreed;
+	//writer side
+	int back = 0;
+	std::array<std::atomic<uint64_t>, WordCount> writeDirty; //written since the last Publish
+	DirtyBits unreadDirty; //changes in publishes the reader might not have picked up yet
+	std::array<DirtyBits, 3> staleSlots; //per buffer, slots that are older than the newest publish
 
-	std::shared_mutex writeLock;
+	std::mutex freeListLock;
+	std::vector<int> freeList;
+	std::vector<bool> usedElems;
 };
 
 template<typename T, int size>
-DoubleBufferArray<T, size>::DoubleBufferArray() :
-	which(false)
+DoubleBufferArray<T, size>::DoubleBufferArray()
 {
-	std::fill(std::begin(freeElems), std::end(freeElems), false);
+	for (auto& buffer : buffers) {
+		buffer = std::make_unique<Buffer>();
+		buffer->dirty.fill(0);
+	}
+	for (auto& word : writeDirty)
+		word.store(0, std::memory_order_relaxed);
+	unreadDirty.fill(0);
+	for (auto& stale : staleSlots)
+		stale.fill(0);
+
+	//reversed so the lowest indices get handed out first
+	freeList.reserve(size);
+	for (int i = size - 1; i >= 0; i--)
+		freeList.push_back(i);
+	usedElems.resize(size, false);
 }
 
 template<typename T, int size>
 int DoubleBufferArray<T, size>::Allocate()
 {
-	std::unique_lock<std::shared_mutex> lock(writeLock);
-	for (int i = 0; i < size; i++)
-		if (freeElems[i] == false) {
-			freeElems[i] == true;
-			return i;
-		}
-	throw std::runtime_error("Ran out of indicies to give!");
+	std::lock_guard<std::mutex> lock(freeListLock);
+	if (freeList.empty())
+		throw std::runtime_error("Ran out of indicies to give!");
+
+	int index = freeList.back();
+	freeList.pop_back();
+	usedElems[index] = true;
+	return index;
 }
 
 template<typename T, int size>
 void DoubleBufferArray<T, size>::Free(int index)
 {
-	std::unique_lock<std::shared_mutex> lock(writeLock);
-
-	if (freeElems[index] == true) {
-		freeElems[index] == false;
-	}
-	else {
+	std::lock_guard<std::mutex> lock(freeListLock);
+	if (!usedElems[index])
 		throw std::runtime_error("Trying to free already freed indices!");
-	}
-}
 
+	usedElems[index] = false;
+	freeList.push_back(index);
+}
 
 template<typename T, int size>
 T DoubleBufferArray<T, size>::Read(int index)
 {
-	std::shared_lock<std::shared_mutex> lock(writeLock);
-	return (*currentRead)[index];
+	return buffers[front]->items[index];
 }
 
 template<typename T, int size>
 std::array<T, size>* DoubleBufferArray<T, size>::ReadAll()
 {
-	std::shared_lock<std::shared_mutex> lock(writeLock);
-	return currentRead;
+	return &buffers[front]->items;
 }
 
 template<typename T, int size>
 void DoubleBufferArray<T, size>::Write(int index, T data)
 {
-
-	std::unique_lock<std::shared_mutex> lock(writeLock);
-
-
-	(*currentWrite)[index] = data;
-
+	buffers[back]->items[index] = data;
+	writeDirty[index / WordBits].fetch_or(uint64_t(1) << (index % WordBits), std::memory_order_relaxed);
 }
 
 template<typename T, int size>
-void DoubleBufferArray<T, size>::Swap()
+void DoubleBufferArray<T, size>::Publish()
 {
+	Buffer& published = *buffers[back];
+	for (int w = 0; w < WordCount; w++) {
+		uint64_t written = writeDirty[w].exchange(0, std::memory_order_relaxed);
+		published.dirty[w] = unreadDirty[w] | written;
+		unreadDirty[w] = written;
+		for (int b = 0; b < 3; b++)
+			if (b != back)
+				staleSlots[b][w] |= written;
+	}
 
-	std::unique_lock<std::shared_mutex> lock(writeLock);
+	uint8_t prev = middle.exchange(static_cast<uint8_t>(back) | FreshBit, std::memory_order_acq_rel);
+	back = prev & IndexMask;
+
+	//the reader never saw the last publish, so its changes still need to reach the reader
+	if (prev & FreshBit)
+		for (int w = 0; w < WordCount; w++)
+			unreadDirty[w] = published.dirty[w];
+
+	//bring the new back buffer up to date, copying only what changed since it was last written.
+	//The reader may be reading the published buffer too, but nobody writes to it
+	Buffer& next = *buffers[back];
+	DirtyBits& stale = staleSlots[back];
+	for (int w = 0; w < WordCount; w++) {
+		uint64_t bits = stale[w];
+		while (bits != 0) {
+			int bit = 0;
+			while (((bits >> bit) & 1) == 0)
+				bit++;
+			int index = w * WordBits + bit;
+			next.items[index] = published.items[index];
+			bits &= bits - 1;
+		}
+		stale[w] = 0;
+	}
+}
 
-	which = !which;
+template<typename T, int size>
+bool DoubleBufferArray<T, size>::Swap()
+{
+	frontIsNew = false;
+	if ((middle.load(std::memory_order_relaxed) & FreshBit) == 0)
+		return false;
+
+	uint8_t prev = middle.exchange(static_cast<uint8_t>(front), std::memory_order_acq_rel);
+	front = prev & IndexMask;
+	frontIsNew = true;
+	return true;
+}
 
-	if (which) {
-		currentRead = &a;
-		currentWrite = &b;
-	}
-	else {
-		currentRead = &b;
-		currentWrite = &a;
+template<typename T, int size>
+template<typename Func>
+void DoubleBufferArray<T, size>::ForEachDirtyRange(int begin, int end, Func&& func) const
+{
+	if (!frontIsNew)
+		return;
+
+	const DirtyBits& dirty = buffers[front]->dirty;
+	auto isDirty = [&](int i) { return (dirty[i / WordBits] >> (i % WordBits)) & 1; };
+
+	int i = begin;
+	while (i < end) {
+		//skip whole clean words
+		if ((i % WordBits) == 0 && dirty[i / WordBits] == 0) {
+			i += WordBits;
+			continue;
+		}
+		if (!isDirty(i)) {
+			i++;
+			continue;
+		}
+		int rangeBegin = i;
+		while (i < end && isDirty(i))
+			i++;
+		func(rangeBegin, i);
 	}
 }
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "LinearAllocator.h"
+
+//Scratch memory for data that only lives for one frame, such as draw offsets and copy regions.
+//Each frame in flight gets its own bump allocator which is reset by begin_frame, which must only
+//be called once that frame's fence has signalled. Nothing allocated may outlive the frame.
+//Safe to allocate from any thread. When a frame runs out of room the rest comes from the heap,
+//and the frame's block grows to fit on its next reset so a steady state frame never hits the heap.
+class FrameAllocator
+{
+public:
+	FrameAllocator(size_t frameCapacity, int frameCount);
+
+	FrameAllocator(const FrameAllocator& other) = delete;
+	FrameAllocator& operator=(const FrameAllocator& other) = delete;
+
+	~FrameAllocator();
+
+	void* allocate(size_t size, size_t alignment);
+
+	//Resets the memory of frameIndex and makes it the frame being allocated from
+	void begin_frame(int frameIndex);
+
+	size_t used() const; //in the current frame, including any overflow
+	size_t capacity() const; //of the current frame
+
+private:
+	struct Frame {
+		Frame(size_t capacity) : allocator(std::make_unique<LinearAllocator>(capacity)) {}
+		std::unique_ptr<LinearAllocator> allocator;
+		std::atomic<size_t> overflowBytes = 0;
+		std::mutex overflowLock;
+		std::vector<void*> overflow; //heap blocks handed out after the allocator filled up
+	};
+
+	std::vector<std::unique_ptr<Frame>> frames;
+	std::atomic_int currentFrame = 0;
+};
+
+//Lets standard containers use the frame allocator, deallocate does nothing as the memory goes
+//away with the frame
+template<typename T>
+class FrameStlAllocator
+{
+public:
+	using value_type = T;
+
+	FrameStlAllocator(FrameAllocator& frameAllocator) noexcept : frameAllocator(&frameAllocator) {}
+
+	template<typename U>
+	FrameStlAllocator(const FrameStlAllocator<U>& other) noexcept : frameAllocator(other.frameAllocator) {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(frameAllocator->allocate(n * sizeof(T), alignof(T)));
+	}
+	void deallocate(T*, size_t) noexcept {}
+
+	template<typename U>
+	bool operator==(const FrameStlAllocator<U>& other) const noexcept { return frameAllocator == other.frameAllocator; }
+	template<typename U>
+	bool operator!=(const FrameStlAllocator<U>& other) const noexcept { return frameAllocator != other.frameAllocator; }
+
+private:
+	template<typename U> friend class FrameStlAllocator;
+	FrameAllocator* frameAllocator;
+};
+
+template<typename T>
+using FrameVector = std::vector<T, FrameStlAllocator<T>>;
+
+inline FrameAllocator::FrameAllocator(size_t frameCapacity, int frameCount)
+{
+	for (int i = 0; i < frameCount; i++)
+		frames.push_back(std::make_unique<Frame>(frameCapacity));
+}
+
+inline FrameAllocator::~FrameAllocator()
+{
+	for (auto& frame : frames)
+		for (void* block : frame->overflow)
+			std::free(block);
+}
+
+inline void* FrameAllocator::allocate(size_t size, size_t alignment)
+{
+	Frame& frame = *frames[currentFrame.load(std::memory_order_acquire)];
+	if (void* memory = frame.allocator->allocate(size, alignment))
+		return memory;
+
+	//malloc only guarantees alignment up to max_align_t, over aligning manually isn't worth it here
+	if (alignment > alignof(std::max_align_t))
+		throw std::bad_alloc();
+	void* block = std::malloc(size == 0 ? 1 : size);
+	if (block == nullptr)
+		throw std::bad_alloc();
+
+	frame.overflowBytes.fetch_add(size, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lk(frame.overflowLock);
+	frame.overflow.push_back(block);
+	return block;
+}
+
+inline void FrameAllocator::begin_frame(int frameIndex)
+{
+	//the number of swapchain images can change when it is recreated, so wrap instead of growing
+	//frames, which other threads may be reading
+	frameIndex %= static_cast<int>(frames.size());
+
+	Frame& frame = *frames[frameIndex];
+	size_t overflowBytes = frame.overflowBytes.exchange(0, std::memory_order_relaxed);
+	if (overflowBytes > 0) {
+		for (void* block : frame.overflow)
+			std::free(block);
+		frame.overflow.clear();
+
+		size_t needed = frame.allocator->capacity() + overflowBytes;
+		size_t grown = frame.allocator->capacity() * 2;
+		frame.allocator = std::make_unique<LinearAllocator>(grown > needed ? grown : needed);
+	}
+	else {
+		frame.allocator->reset();
+	}
+	currentFrame.store(frameIndex, std::memory_order_release);
+}
+
+inline size_t FrameAllocator::used() const
+{
+	const Frame& frame = *frames[currentFrame.load(std::memory_order_acquire)];
+	return frame.allocator->used() + frame.overflowBytes.load(std::memory_order_relaxed);
+}
+
+inline size_t FrameAllocator::capacity() const
+{
+	return frames[currentFrame.load(std::memory_order_acquire)]->allocator->capacity();
+}
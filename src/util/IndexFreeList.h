@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+//Lock free stack of the free indices in [0, capacity), for pools that hand out slots by index.
+//The head packs a tag next to the index, every successful push or pop bumps the tag so a thread
+//holding an old head can't swap in a next link that changed underneath it (ABA).
+//Unlike RingBuffer a push never fails, so freed indices can't get lost. Most recently freed
+//indices are handed out first.
+class IndexFreeList {
+public:
+	//starts with every index free
+	IndexFreeList(uint32_t capacity);
+
+	IndexFreeList(const IndexFreeList& other) = delete;
+	IndexFreeList& operator=(const IndexFreeList& other) = delete;
+
+	//returns nothing if every index is in use
+	std::optional<uint32_t> pop();
+
+	//index must have come from pop and not been pushed since
+	void push(uint32_t index);
+
+	uint32_t capacity() const { return count; }
+
+private:
+	static constexpr uint32_t EndIndex = UINT32_MAX;
+
+	static uint64_t Pack(uint32_t tag, uint32_t index) { return (uint64_t(tag) << 32) | index; }
+	static uint32_t Tag(uint64_t head) { return uint32_t(head >> 32); }
+	static uint32_t Index(uint64_t head) { return uint32_t(head); }
+
+	uint32_t count;
+	std::unique_ptr<std::atomic<uint32_t>[]> next;
+	std::atomic<uint64_t> head;
+};
+
+inline IndexFreeList::IndexFreeList(uint32_t capacity) :
+	count(capacity), next(std::make_unique<std::atomic<uint32_t>[]>(capacity))
+{
+	for (uint32_t i = 0; i < capacity; i++)
+		next[i].store(i + 1 < capacity ? i + 1 : EndIndex, std::memory_order_relaxed);
+	head.store(Pack(0, capacity > 0 ? 0 : EndIndex), std::memory_order_release);
+}
+
+inline std::optional<uint32_t> IndexFreeList::pop() {
+	uint64_t old = head.load(std::memory_order_acquire);
+	while (true) {
+		uint32_t index = Index(old);
+		if (index == EndIndex)
+			return {};
+
+		//may be stale if another thread popped index meanwhile, then the tag has moved and the CAS fails
+		uint32_t nextIndex = next[index].load(std::memory_order_relaxed);
+		if (head.compare_exchange_weak(old, Pack(Tag(old) + 1, nextIndex),
+			std::memory_order_acquire, std::memory_order_acquire))
+			return index;
+	}
+}
+
+inline void IndexFreeList::push(uint32_t index) {
+	uint64_t old = head.load(std::memory_order_relaxed);
+	while (true) {
+		next[index].store(Index(old), std::memory_order_relaxed);
+		if (head.compare_exchange_weak(old, Pack(Tag(old) + 1, index),
+			std::memory_order_release, std::memory_order_relaxed))
+			return;
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+
+//Thread safe bump allocator over a fixed block of memory.
+//Allocations are never freed individually, reset() releases everything at once and
+//must only be called when nothing allocated from it is still in use.
+class LinearAllocator
+{
+public:
+	LinearAllocator(size_t capacity);
+
+	LinearAllocator(const LinearAllocator& other) = delete;
+	LinearAllocator& operator=(const LinearAllocator& other) = delete;
+
+	//returns nullptr when out of space, alignment must be a power of two
+	void* allocate(size_t size, size_t alignment);
+
+	void reset();
+
+	size_t capacity() const;
+	size_t used() const;
+
+private:
+	std::unique_ptr<std::byte[]> memory;
+	size_t size;
+	std::atomic<size_t> offset;
+};
+
+inline LinearAllocator::LinearAllocator(size_t capacity) :
+	memory(new std::byte[capacity]), size(capacity), offset(0)
+{
+}
+
+inline void* LinearAllocator::allocate(size_t allocSize, size_t alignment)
+{
+	uintptr_t base = reinterpret_cast<uintptr_t>(memory.get());
+	size_t current = offset.load(std::memory_order_relaxed);
+	size_t alignedOffset;
+	do {
+		uintptr_t aligned = (base + current + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+		alignedOffset = static_cast<size_t>(aligned - base);
+		if (alignedOffset + allocSize > size)
+			return nullptr;
+	} while (!offset.compare_exchange_weak(current, alignedOffset + allocSize,
+		std::memory_order_relaxed, std::memory_order_relaxed));
+
+	return memory.get() + alignedOffset;
+}
+
+inline void LinearAllocator::reset()
+{
+	offset.store(0, std::memory_order_relaxed);
+}
+
+inline size_t LinearAllocator::capacity() const
+{
+	return size;
+}
+
+inline size_t LinearAllocator::used() const
+{
+	return offset.load(std::memory_order_relaxed);
+}
@@ -1,37 +1,275 @@
 #pragma once
 
-
 #include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <utility>
 #include <vector>
-#include <variant>
-#include <algorithm>
 
+//Freed slots get filled with this in debug builds (or when MEMORY_POOL_POISON is defined) so
+//reads through dangling pointers stand out, and writes to freed objects get caught on reuse
+#if !defined(NDEBUG) || defined(MEMORY_POOL_POISON)
+constexpr bool MemoryPoolPoisoning = true;
+#else
+constexpr bool MemoryPoolPoisoning = false;
+#endif
+constexpr unsigned char MemoryPoolPoisonByte = 0xDD;
+
+namespace MemoryPoolDetail {
+	constexpr size_t MagazineSize = 32;
+
+	//Lets a thread hand its free slots back to a pool without knowing the pool's type
+	class PoolBase {
+	public:
+		virtual void return_slots(void** slots, size_t slotCount) = 0;
+	protected:
+		~PoolBase() = default;
+	};
+
+	//Pools by id, so a thread exiting after a pool was destroyed knows not to touch it.
+	//Ids are never reused, so a magazine can't end up with a newer pool at the same address
+	inline std::mutex livePoolsLock;
+	inline std::unordered_map<uint64_t, PoolBase*> livePools;
+	inline std::atomic<uint64_t> nextPoolId = 1;
+
+	//Free slots of one pool, only ever touched by the thread owning it
+	struct Magazine {
+		uint64_t poolId = 0;
+		void* slots[MagazineSize];
+		size_t size = 0;
+	};
+
+	//A thread's magazines, one for each pool it has used. They go back to their pools when the thread exits
+	class ThreadCache {
+	public:
+		~ThreadCache();
+		Magazine& get(uint64_t poolId);
+	private:
+		std::vector<std::unique_ptr<Magazine>> magazines;
+	};
+
+	inline thread_local ThreadCache threadCache;
+
+	inline ThreadCache::~ThreadCache() {
+		std::lock_guard<std::mutex> lk(livePoolsLock);
+		for (auto& magazine : magazines) {
+			auto pool = livePools.find(magazine->poolId);
+			if (pool != livePools.end() && magazine->size > 0)
+				pool->second->return_slots(magazine->slots, magazine->size);
+		}
+	}
+
+	inline Magazine& ThreadCache::get(uint64_t poolId) {
+		for (auto& magazine : magazines)
+			if (magazine->poolId == poolId)
+				return *magazine;
+
+		//first time this thread uses the pool, a good time to drop magazines of pools that are gone
+		{
+			std::lock_guard<std::mutex> lk(livePoolsLock);
+			for (size_t i = 0; i < magazines.size();) {
+				if (livePools.count(magazines[i]->poolId) == 0) {
+					magazines[i] = std::move(magazines.back());
+					magazines.pop_back();
+				}
+				else
+					i++;
+			}
+		}
+		magazines.push_back(std::make_unique<Magazine>());
+		magazines.back()->poolId = poolId;
+		return *magazines.back();
+	}
+}
+
+//Fixed size object pool. Objects live in blocks of `count` slots that are only given back to the
+//system when the pool is destroyed, so allocate and deallocate are O(1) and neighbouring objects
+//stay close in memory.
+//Every thread keeps a thread_local magazine of free slots for each pool, allocate and deallocate
+//only take a lock when it runs dry or overflows and half of it moves to or from the shared free list.
+//Objects freed on a different thread than they were allocated on flow back through that list in batches.
 template<typename T, size_t count>
-class MemoryPool {
+class MemoryPool : private MemoryPoolDetail::PoolBase {
 public:
+	static_assert(count > 0, "MemoryPool blocks need at least one slot");
+
 	MemoryPool();
+	~MemoryPool();
+
+	MemoryPool(const MemoryPool& other) = delete;
+	MemoryPool& operator=(const MemoryPool& other) = delete;
 
-	T * allocate();
+	//Constructs a T in a free slot
+	template<typename... Args>
+	T* allocate(Args&&... args);
+
+	//Destroys the object and gives its slot back, del must have come from this pool
 	void deallocate(T* del);
+
+	size_t allocated_count() const; //objects currently alive
+	size_t block_count() const;
+
 private:
+	union Slot {
+		Slot* next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+	struct Block {
+		Slot slots[count];
+	};
+
+	using Magazine = MemoryPoolDetail::Magazine;
+	static constexpr size_t MagazineSize = MemoryPoolDetail::MagazineSize;
+
+	Magazine& local_magazine();
+
+	//moves up to MagazineSize / 2 slots from the shared free list into magazine, making a new
+	//block if there aren't enough
+	void refill(Magazine& magazine);
+	//moves half the magazine back onto the shared free list
+	void flush(Magazine& magazine);
 
+	//a thread exiting gives its whole magazine back
+	void return_slots(void** slots, size_t slotCount) override;
+
+	static void poison(Slot* slot);
+	static void check_poison(Slot* slot);
+
+	mutable std::mutex lock; //guards freeList and blocks
+	Slot* freeList = nullptr;
+	std::vector<std::unique_ptr<Block>> blocks;
+
+	std::atomic<size_t> liveCount = 0;
+
+	uint64_t poolId;
 };
 
 template<typename T, size_t count>
-MemoryPool<T, count>::MemoryPool()
+MemoryPool<T, count>::MemoryPool() :
+	poolId(MemoryPoolDetail::nextPoolId.fetch_add(1, std::memory_order_relaxed))
+{
+	std::lock_guard<std::mutex> lk(MemoryPoolDetail::livePoolsLock);
+	MemoryPoolDetail::livePools[poolId] = this;
+}
+
+//Objects still alive are not destroyed, whoever allocated them should have given them back.
+//Magazines other threads still hold for this pool are dropped the next time they look
+template<typename T, size_t count>
+MemoryPool<T, count>::~MemoryPool()
 {
+	assert(liveCount.load() == 0 && "MemoryPool destroyed with live objects");
+	std::lock_guard<std::mutex> lk(MemoryPoolDetail::livePoolsLock);
+	MemoryPoolDetail::livePools.erase(poolId);
+}
 
+template<typename T, size_t count>
+typename MemoryPool<T, count>::Magazine& MemoryPool<T, count>::local_magazine() {
+	return MemoryPoolDetail::threadCache.get(poolId);
 }
 
 template<typename T, size_t count>
-T* MemoryPool<T, count>::allocate() {
+template<typename... Args>
+T* MemoryPool<T, count>::allocate(Args&&... args) {
+	Magazine& magazine = local_magazine();
+	if (magazine.size == 0)
+		refill(magazine);
+	Slot* slot = static_cast<Slot*>(magazine.slots[--magazine.size]);
+	check_poison(slot);
 
-	return new T();
+	T* obj = new (slot->storage) T(std::forward<Args>(args)...);
+	liveCount.fetch_add(1, std::memory_order_relaxed);
+	return obj;
 }
 
 template<typename T, size_t count>
 void MemoryPool<T, count>::deallocate(T* del) {
+	if (del == nullptr)
+		return;
+
+	del->~T();
+	liveCount.fetch_sub(1, std::memory_order_relaxed);
+
+	Slot* slot = reinterpret_cast<Slot*>(del);
+	poison(slot);
+
+	Magazine& magazine = local_magazine();
+	if (magazine.size == MagazineSize)
+		flush(magazine);
+	magazine.slots[magazine.size++] = slot;
+}
 
+template<typename T, size_t count>
+void MemoryPool<T, count>::refill(Magazine& magazine) {
+	std::lock_guard<std::mutex> lk(lock);
+	while (magazine.size < MagazineSize / 2) {
+		if (freeList == nullptr) {
+			blocks.push_back(std::make_unique<Block>());
+			Block& block = *blocks.back();
+			//push in reverse so slots get handed out in address order
+			for (size_t i = count; i > 0; i--) {
+				Slot* slot = &block.slots[i - 1];
+				poison(slot);
+				slot->next = freeList;
+				freeList = slot;
+			}
+		}
+		Slot* slot = freeList;
+		freeList = slot->next;
+		magazine.slots[magazine.size++] = slot;
+	}
+}
 
-	delete del;
-}
\ No newline at end of file
+template<typename T, size_t count>
+void MemoryPool<T, count>::flush(Magazine& magazine) {
+	std::lock_guard<std::mutex> lk(lock);
+	while (magazine.size > MagazineSize / 2) {
+		Slot* slot = static_cast<Slot*>(magazine.slots[--magazine.size]);
+		slot->next = freeList;
+		freeList = slot;
+	}
+}
+
+template<typename T, size_t count>
+void MemoryPool<T, count>::return_slots(void** slots, size_t slotCount) {
+	std::lock_guard<std::mutex> lk(lock);
+	for (size_t i = 0; i < slotCount; i++) {
+		Slot* slot = static_cast<Slot*>(slots[i]);
+		slot->next = freeList;
+		freeList = slot;
+	}
+}
+
+//The first pointer's worth of a free slot may hold the free list link, so it isn't poisoned
+template<typename T, size_t count>
+void MemoryPool<T, count>::poison(Slot* slot) {
+	if constexpr (MemoryPoolPoisoning) {
+		if (sizeof(Slot) > sizeof(Slot*))
+			std::memset(slot->storage + sizeof(Slot*), MemoryPoolPoisonByte, sizeof(Slot) - sizeof(Slot*));
+	}
+}
+
+template<typename T, size_t count>
+void MemoryPool<T, count>::check_poison(Slot* slot) {
+	if constexpr (MemoryPoolPoisoning) {
+		for (size_t i = sizeof(Slot*); i < sizeof(Slot); i++)
+			assert(slot->storage[i] == MemoryPoolPoisonByte && "MemoryPool slot written to after being freed");
+	}
+}
+
+template<typename T, size_t count>
+size_t MemoryPool<T, count>::allocated_count() const {
+	return liveCount.load(std::memory_order_relaxed);
+}
+
+template<typename T, size_t count>
+size_t MemoryPool<T, count>::block_count() const {
+	std::lock_guard<std::mutex> lk(lock);
+	return blocks.size();
+}
@@ -1,28 +1,229 @@
 #pragma once
 
-
-#include <vector>
-#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
 #include <optional>
+#include <utility>
 
+//Bounded lock free multi producer, multi consumer queue (Vyukov's sequence number ring)
+//Every cell carries a sequence number saying which lap of the ring it is ready for, so
+//producers and consumers only ever contend on one atomic counter each.
+//Capacity is rounded up to a power of two and never grows, push fails when full.
 template <typename T>
 class RingBuffer {
 public:
-	RingBuffer();
+	RingBuffer(size_t capacity = 1024);
+	~RingBuffer();
+
+	RingBuffer(const RingBuffer& other) = delete;
+	RingBuffer& operator=(const RingBuffer& other) = delete;
 
-	T top();
-	void pop();
+	//returns false if the ring is full
+	bool push(const T& item);
+	bool push(T&& item);
+
+	//Optionally returns the front value if it exists, else returns nothing
 	std::optional<T> pop_if();
 
-	void push(T data);
+	//Moves as many items from [first, last) in as fit, claiming the slots with a single
+	//atomic operation, returns how many went in. Items that went in are moved from.
+	template <typename Iter>
+	size_t push_range(Iter first, Iter last);
+
+	//Pops up to max items into out, returns how many were popped
+	template <typename OutIter>
+	size_t pop_n(OutIter out, size_t max);
+
+	//Approximate, safe to call from any thread
+	bool empty() const;
+	size_t size() const;
+	size_t capacity() const;
 
 private:
+	struct Cell {
+		std::atomic<size_t> sequence;
+		alignas(T) unsigned char storage[sizeof(T)];
+
+		T* item() { return reinterpret_cast<T*>(storage); }
+	};
+
+	template <typename U>
+	bool emplace(U&& item);
+
+	//how many cells from pos on are ready for a producer (lap = 0) or a consumer (lap = 1), up to max
+	size_t ready_count(size_t pos, size_t lap, size_t max) const;
 
+	size_t mask;
+	std::unique_ptr<Cell[]> cells;
 
+	alignas(64) std::atomic<size_t> enqueuePos;
+	alignas(64) std::atomic<size_t> dequeuePos;
+};
 
+template <typename T>
+RingBuffer<T>::RingBuffer(size_t capacity) :
+	enqueuePos(0), dequeuePos(0)
+{
+	size_t size = 2;
+	while (size < capacity)
+		size <<= 1;
+	mask = size - 1;
+	cells.reset(new Cell[size]);
+	for (size_t i = 0; i < size; i++)
+		cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template <typename T>
+RingBuffer<T>::~RingBuffer()
+{
+	while (pop_if().has_value()) {}
+}
+
+template <typename T>
+bool RingBuffer<T>::push(const T& item) {
+	return emplace(item);
+}
 
+template <typename T>
+bool RingBuffer<T>::push(T&& item) {
+	return emplace(std::move(item));
+}
 
-	std::vector<T> buffer;
+template <typename T>
+template <typename U>
+bool RingBuffer<T>::emplace(U&& item) {
+	size_t pos = enqueuePos.load(std::memory_order_relaxed);
+	while (true) {
+		Cell& cell = cells[pos & mask];
+		size_t seq = cell.sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if (diff == 0) {
+			if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				new (cell.storage) T(std::forward<U>(item));
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0) {
+			return false; //full, the cell still holds an item from the last lap
+		}
+		else {
+			pos = enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
 
+template <typename T>
+std::optional<T> RingBuffer<T>::pop_if() {
+	size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	while (true) {
+		Cell& cell = cells[pos & mask];
+		size_t seq = cell.sequence.load(std::memory_order_acquire);
+		intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+		if (diff == 0) {
+			if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				std::optional<T> ret(std::move(*cell.item()));
+				cell.item()->~T();
+				cell.sequence.store(pos + mask + 1, std::memory_order_release);
+				return ret;
+			}
+		}
+		else if (diff < 0) {
+			return {}; //empty
+		}
+		else {
+			pos = dequeuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
 
-};
\ No newline at end of file
+template <typename T>
+size_t RingBuffer<T>::ready_count(size_t pos, size_t lap, size_t max) const {
+	size_t count = 0;
+	while (count < max && cells[(pos + count) & mask].sequence.load(std::memory_order_acquire) == pos + count + lap)
+		count++;
+	return count;
+}
+
+//A cell's sequence only moves on once whoever claimed its position is done with it, so if the
+//cells are ready when checked they are still ready once the counter CAS succeeds
+template <typename T>
+template <typename Iter>
+size_t RingBuffer<T>::push_range(Iter first, Iter last) {
+	size_t wanted = static_cast<size_t>(std::distance(first, last));
+	if (wanted == 0)
+		return 0;
+
+	size_t pos = enqueuePos.load(std::memory_order_relaxed);
+	size_t count;
+	while (true) {
+		count = ready_count(pos, 0, wanted);
+		if (count == 0) {
+			size_t latest = enqueuePos.load(std::memory_order_relaxed);
+			if (latest == pos)
+				return 0; //full
+			pos = latest;
+		}
+		else if (enqueuePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++, ++first) {
+		Cell& cell = cells[(pos + i) & mask];
+		new (cell.storage) T(std::move(*first));
+		cell.sequence.store(pos + i + 1, std::memory_order_release);
+	}
+	return count;
+}
+
+template <typename T>
+template <typename OutIter>
+size_t RingBuffer<T>::pop_n(OutIter out, size_t max) {
+	if (max == 0)
+		return 0;
+
+	size_t pos = dequeuePos.load(std::memory_order_relaxed);
+	size_t count;
+	while (true) {
+		count = ready_count(pos, 1, max);
+		if (count == 0) {
+			size_t latest = dequeuePos.load(std::memory_order_relaxed);
+			if (latest == pos)
+				return 0; //empty
+			pos = latest;
+		}
+		else if (dequeuePos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		Cell& cell = cells[(pos + i) & mask];
+		*out++ = std::move(*cell.item());
+		cell.item()->~T();
+		cell.sequence.store(pos + i + mask + 1, std::memory_order_release);
+	}
+	return count;
+}
+
+template <typename T>
+bool RingBuffer<T>::empty() const {
+	return size() == 0;
+}
+
+template <typename T>
+size_t RingBuffer<T>::size() const {
+	size_t dequeue = dequeuePos.load(std::memory_order_relaxed);
+	size_t enqueue = enqueuePos.load(std::memory_order_relaxed);
+	return enqueue > dequeue ? enqueue - dequeue : 0;
+}
+
+template <typename T>
+size_t RingBuffer<T>::capacity() const {
+	return mask + 1;
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+//Handle into a SlotMap<T>. The generation says which occupant of the slot the handle refers to,
+//so a handle to an erased element stays invalid even after its slot is reused.
+template <typename T>
+struct SlotHandle {
+	static constexpr uint32_t InvalidIndex = UINT32_MAX;
+
+	uint32_t index = InvalidIndex;
+	uint32_t generation = 0;
+
+	bool valid() const { return index != InvalidIndex; }
+
+	bool operator==(const SlotHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const SlotHandle& other) const { return !(*this == other); }
+};
+
+//Unordered container with O(1) insert, erase and lookup through generational handles.
+//Values are kept densely packed so iterating (or uploading them) touches no holes, erasing moves
+//the last value into the gap, so pointers and iterators into the values don't survive an erase.
+//A handle's index is stable for as long as the element lives and slot indices are reused before
+//new ones are made, so they never exceed the most elements that were alive at once.
+//Not thread safe.
+template <typename T>
+class SlotMap {
+public:
+	using Handle = SlotHandle<T>;
+	using iterator = typename std::vector<T>::iterator;
+	using const_iterator = typename std::vector<T>::const_iterator;
+
+	SlotMap(size_t reserveCount = 0);
+
+	Handle insert(const T& value);
+	Handle insert(T&& value);
+
+	template <typename... Args>
+	Handle emplace(Args&&... args);
+
+	//returns false if the handle was already stale
+	bool erase(Handle handle);
+
+	bool contains(Handle handle) const;
+
+	//returns nullptr if the handle is stale
+	T* get(Handle handle);
+	const T* get(Handle handle) const;
+
+	//throws std::out_of_range if the handle is stale
+	T& at(Handle handle);
+	const T& at(Handle handle) const;
+
+	//handle of the value at a position in the dense array, for when iterating needs the handles too
+	Handle handle_at(size_t denseIndex) const;
+
+	size_t size() const;
+	bool empty() const;
+	void reserve(size_t count);
+	void clear();
+
+	T* data();
+	const T* data() const;
+
+	iterator begin();
+	iterator end();
+	const_iterator begin() const;
+	const_iterator end() const;
+
+private:
+	//generation is odd while the slot is occupied, so a default handle never matches a free slot
+	struct Slot {
+		uint32_t generation = 0;
+		uint32_t denseIndex = 0; //next free slot while the slot is free
+	};
+
+	//claims a slot for the value just pushed onto values
+	Handle add_slot();
+
+	std::vector<Slot> slots;
+	std::vector<T> values;
+	std::vector<uint32_t> denseToSlot;
+	uint32_t freeHead = Handle::InvalidIndex;
+};
+
+template <typename T>
+SlotMap<T>::SlotMap(size_t reserveCount) {
+	reserve(reserveCount);
+}
+
+template <typename T>
+typename SlotMap<T>::Handle SlotMap<T>::add_slot() {
+	uint32_t index;
+	if (freeHead != Handle::InvalidIndex) {
+		index = freeHead;
+		freeHead = slots[index].denseIndex;
+	}
+	else {
+		index = static_cast<uint32_t>(slots.size());
+		slots.emplace_back();
+	}
+	Slot& slot = slots[index];
+	slot.generation++;
+	slot.denseIndex = static_cast<uint32_t>(values.size() - 1);
+	denseToSlot.push_back(index);
+	return Handle{ index, slot.generation };
+}
+
+template <typename T>
+typename SlotMap<T>::Handle SlotMap<T>::insert(const T& value) {
+	return emplace(value);
+}
+
+template <typename T>
+typename SlotMap<T>::Handle SlotMap<T>::insert(T&& value) {
+	return emplace(std::move(value));
+}
+
+//The value is constructed before the slot is claimed, so a throwing constructor leaves the map as it was
+template <typename T>
+template <typename... Args>
+typename SlotMap<T>::Handle SlotMap<T>::emplace(Args&&... args) {
+	values.emplace_back(std::forward<Args>(args)...);
+	return add_slot();
+}
+
+template <typename T>
+bool SlotMap<T>::erase(Handle handle) {
+	if (!contains(handle))
+		return false;
+
+	Slot& slot = slots[handle.index];
+	uint32_t dense = slot.denseIndex;
+	uint32_t last = static_cast<uint32_t>(values.size() - 1);
+	if (dense != last) {
+		values[dense] = std::move(values[last]);
+		denseToSlot[dense] = denseToSlot[last];
+		slots[denseToSlot[dense]].denseIndex = dense;
+	}
+	values.pop_back();
+	denseToSlot.pop_back();
+
+	slot.generation++;
+	slot.denseIndex = freeHead;
+	freeHead = handle.index;
+	return true;
+}
+
+template <typename T>
+bool SlotMap<T>::contains(Handle handle) const {
+	return handle.index < slots.size() && slots[handle.index].generation == handle.generation
+		&& (handle.generation & 1) == 1;
+}
+
+template <typename T>
+T* SlotMap<T>::get(Handle handle) {
+	return contains(handle) ? &values[slots[handle.index].denseIndex] : nullptr;
+}
+
+template <typename T>
+const T* SlotMap<T>::get(Handle handle) const {
+	return contains(handle) ? &values[slots[handle.index].denseIndex] : nullptr;
+}
+
+template <typename T>
+T& SlotMap<T>::at(Handle handle) {
+	if (!contains(handle))
+		throw std::out_of_range("Stale or invalid slot map handle");
+	return values[slots[handle.index].denseIndex];
+}
+
+template <typename T>
+const T& SlotMap<T>::at(Handle handle) const {
+	if (!contains(handle))
+		throw std::out_of_range("Stale or invalid slot map handle");
+	return values[slots[handle.index].denseIndex];
+}
+
+template <typename T>
+typename SlotMap<T>::Handle SlotMap<T>::handle_at(size_t denseIndex) const {
+	uint32_t index = denseToSlot[denseIndex];
+	return Handle{ index, slots[index].generation };
+}
+
+template <typename T>
+size_t SlotMap<T>::size() const {
+	return values.size();
+}
+
+template <typename T>
+bool SlotMap<T>::empty() const {
+	return values.empty();
+}
+
+template <typename T>
+void SlotMap<T>::reserve(size_t count) {
+	slots.reserve(count);
+	values.reserve(count);
+	denseToSlot.reserve(count);
+}
+
+//Every slot is freed rather than forgotten, so handles from before the clear stay stale
+template <typename T>
+void SlotMap<T>::clear() {
+	for (size_t i = 0; i < denseToSlot.size(); i++) {
+		uint32_t index = denseToSlot[i];
+		slots[index].generation++;
+		slots[index].denseIndex = freeHead;
+		freeHead = index;
+	}
+	values.clear();
+	denseToSlot.clear();
+}
+
+template <typename T>
+T* SlotMap<T>::data() {
+	return values.data();
+}
+
+template <typename T>
+const T* SlotMap<T>::data() const {
+	return values.data();
+}
+
+template <typename T>
+typename SlotMap<T>::iterator SlotMap<T>::begin() {
+	return values.begin();
+}
+
+template <typename T>
+typename SlotMap<T>::iterator SlotMap<T>::end() {
+	return values.end();
+}
+
+template <typename T>
+typename SlotMap<T>::const_iterator SlotMap<T>::begin() const {
+	return values.begin();
+}
+
+template <typename T>
+typename SlotMap<T>::const_iterator SlotMap<T>::end() const {
+	return values.end();
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <type_traits>
+
+//Chase-Lev work stealing deque (Le, Pop, Cohen, Nardelli 2013 C11 formulation)
+//The owning thread pushes and pops from the bottom, any other thread may steal from the top.
+//Only trivially copyable types (ie pointers) are supported, values are stored in atomics.
+template <typename T>
+class WorkStealingQueue
+{
+public:
+	WorkStealingQueue(int64_t initialCapacity = 256);
+	~WorkStealingQueue();
+
+	WorkStealingQueue(const WorkStealingQueue& other) = delete;
+	WorkStealingQueue& operator=(const WorkStealingQueue& other) = delete;
+
+	//Owner only
+	void push(T item);
+
+	//Owner only, returns false if empty
+	bool pop(T& out);
+
+	//Any thread, returns false if empty or it lost a race with another thief/the owner
+	bool steal(T& out);
+
+	//Approximate, safe to call from any thread
+	bool empty() const;
+	int64_t size() const;
+
+private:
+	static_assert(std::is_trivially_copyable<T>::value, "WorkStealingQueue requires trivially copyable types");
+
+	struct CircularArray {
+		int64_t capacity;
+		int64_t mask;
+		std::unique_ptr<std::atomic<T>[]> items;
+
+		CircularArray(int64_t capacity) :
+			capacity(capacity), mask(capacity - 1), items(new std::atomic<T>[capacity])
+		{}
+
+		T get(int64_t index) { return items[index & mask].load(std::memory_order_relaxed); }
+		void put(int64_t index, T item) { items[index & mask].store(item, std::memory_order_relaxed); }
+
+		CircularArray* grow(int64_t bottom, int64_t top) {
+			CircularArray* newArray = new CircularArray(capacity * 2);
+			for (int64_t i = top; i != bottom; i++)
+				newArray->put(i, get(i));
+			return newArray;
+		}
+	};
+
+	alignas(64) std::atomic<int64_t> top;
+	alignas(64) std::atomic<int64_t> bottom;
+	alignas(64) std::atomic<CircularArray*> array;
+
+	//old arrays may still be read by thieves, so they are kept alive till destruction
+	std::vector<std::unique_ptr<CircularArray>> garbage;
+};
+
+template <typename T>
+WorkStealingQueue<T>::WorkStealingQueue(int64_t initialCapacity) :
+	top(0), bottom(0)
+{
+	int64_t capacity = 1;
+	while (capacity < initialCapacity)
+		capacity <<= 1;
+	array.store(new CircularArray(capacity), std::memory_order_relaxed);
+}
+
+template <typename T>
+WorkStealingQueue<T>::~WorkStealingQueue()
+{
+	delete array.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+void WorkStealingQueue<T>::push(T item)
+{
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_acquire);
+	CircularArray* a = array.load(std::memory_order_relaxed);
+
+	if (b - t > a->capacity - 1) {
+		CircularArray* bigger = a->grow(b, t);
+		garbage.emplace_back(a);
+		array.store(bigger, std::memory_order_release);
+		a = bigger;
+	}
+	a->put(b, item);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+template <typename T>
+bool WorkStealingQueue<T>::pop(T& out)
+{
+	int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	CircularArray* a = array.load(std::memory_order_relaxed);
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+
+	if (t <= b) {
+		out = a->get(b);
+		if (t == b) {
+			//last item, race against thieves for it
+			bool won = top.compare_exchange_strong(t, t + 1,
+				std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+	bottom.store(b + 1, std::memory_order_relaxed);
+	return false;
+}
+
+template <typename T>
+bool WorkStealingQueue<T>::steal(T& out)
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = bottom.load(std::memory_order_acquire);
+
+	if (t < b) {
+		CircularArray* a = array.load(std::memory_order_acquire);
+		T item = a->get(t);
+		if (!top.compare_exchange_strong(t, t + 1,
+			std::memory_order_seq_cst, std::memory_order_relaxed))
+			return false;
+		out = item;
+		return true;
+	}
+	return false;
+}
+
+template <typename T>
+bool WorkStealingQueue<T>::empty() const
+{
+	return size() <= 0;
+}
+
+template <typename T>
+int64_t WorkStealingQueue<T>::size() const
+{
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_relaxed);
+	return b - t;
+}